@@ -63,6 +63,13 @@ end
 -- l_currentTime(), returns the currently active timestep.		--
 -- l_getMacroFactor(), returns the macrofactor value			--
 -- l_getTimeResolution(), returns the timeresolution [s]		--	
+-- l_setPropagationModel(desc, model, params), sets the propagation	--
+--	model for events with the given desc, model is "spherical" or	--
+--	"sigmoid", params is a table with the optional fields:		--
+--	sourceLevel, referenceDistance, distanceThreshold, absorption	--
+--	and threshold. Events received below threshold are dropped.	--
+-- l_receivedLevel(desc, x, y, origX, origY), level at x,y of an event	--
+--	from origX,origY, or nil if desc has no propagation model.	--
 -- 									--
 -- 									--
 -- 									--
@@ -70,6 +77,11 @@ end
 --									--
 -- GENERAL FUNCTIONS:							--
 -- l_debug(msg), print a string in the output window of the simulator.	--
+-- l_debug(format, ...), same with printf style arguments, cheap when	--
+--	the binary debug log is enabled (-D), as only the arguments	--
+--	are stored.							--
+-- l_log(level, format, ...), same as l_debug at a given level:		--
+--	0 = error, 1 = warn, 2 = info, 3 = debug.			--
 -- l_generateEventID(), returns a unique ID which can be assigned to	-- 
 -- 	an event.							--
 --......................................................................--
@@ -131,6 +143,10 @@ function initAuton(x, y, id, macroFactor, timeResolution)
 	intensityThr = 0.5
 	callStrength = 0.5
 	energyLevel = 0.1
+	--native version of func.soundIntensity.f1, calls heard with an 
+	--intensity below intensityThr are never delivered:
+	--l_setPropagationModel("sound", "sigmoid", 
+	--	{distanceThreshold = 10, threshold = intensityThr})
 end
 
 -- Handling of an external event
@@ -144,8 +160,9 @@ end
 -- @param origID originators id.
 -- @param origDesc origniators description.
 -- @param origTable originiators information table.
+-- @param receivedLevel level from the propagation model, nil if none is set.
 -- @return "null" string if no event is to be initiated. or 
-function handleExternalEvent(origX, origY, eventID, eventDesc , eventTable)
+function handleExternalEvent(origX, origY, eventID, eventDesc , eventTable, receivedLevel)
 	activationTime = l_speedOfSound(posX, posY, origX, origX)
 
 	--l_debug("Auton with ID" .. ID .. " received event :\n")
@@ -156,6 +173,26 @@ function handleExternalEvent(origX, origY, eventID, eventDesc , eventTable)
 
 	return 1,2,3,"null"	
 end
+
+-- Optional batched handling of external events.
+-- If defined it is called once pr. microstep with every external event 
+-- reaching this auton, instead of calling handleExternalEvent once pr. event.
+-- @param batch array of event records, each with the fields:
+-- originX, originY, id, propagationSpeed, desc, table and receivedLevel.
+-- @return "null" if no internal events are to be made, or a table indexed 
+-- like the batch holding a record {desc, id, activationTime} for each event
+-- that should cause an internal event.
+--function handleExternalEvents(batch)
+--	local responses = {}
+--	for i, event in ipairs(batch) do
+--		local activationTime = l_speedOfSound(posX, posY, 
+--			event.originX, event.originY, event.propagationSpeed)
+--		responses[i] = {desc = "heard", id = l_generateEventID(), 
+--			activationTime = activationTime}
+--	end
+--	return responses
+--end
+
 -- Handling an internal event, will recieve all data from the external event
 -- that caused it, can return data for an external event or a 'null' string 
 -- for no external event.
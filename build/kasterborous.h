@@ -0,0 +1,2 @@
+#define Kasterborous_VERSION_MAJOR 0
+#define Kasterborous_VERSION_MINOR 794
@@ -70,6 +70,11 @@ end
 --									--
 -- GENERAL FUNCTIONS:							--
 -- l_debug(msg), print a string in the output window of the simulator.	--
+-- l_debug(format, ...), same with printf style arguments, cheap when	--
+--	the binary debug log is enabled (-D), as only the arguments	--
+--	are stored.							--
+-- l_log(level, format, ...), same as l_debug at a given level:		--
+--	0 = error, 1 = warn, 2 = info, 3 = debug.			--
 -- l_generateEventID(), returns a unique ID which can be assigned to	-- 
 -- 	an event.							--
 --......................................................................--
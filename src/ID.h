@@ -22,44 +22,113 @@
 #ifndef ID_H
 #define ID_H
 
+#include <atomic>
+
+/**
+ * ID counters of a simulation.
+ * Owned by the SimContext, so every simulation numbers its autons,
+ * nestenes and events from 1.
+ *
+ * The counters are atomic. Event IDs are handed out in blocks, each
+ * thread takes a block of BLOCK_SIZE IDs from the shared counter and
+ * numbers its events from it without touching shared memory, so IDs are
+ * unique but only increasing within a thread.
+ *
+ * With nestene encoding enabled the ID of the issuing Nestene is stored
+ * above the sequence number, the uniqueness still comes from the
+ * sequence number. Encoded IDs are kept below 2^53, so they survive the
+ * conversion to a Lua number.
+ */
 class ID
 {
 	public :
+		static const unsigned long long BLOCK_SIZE = 1024;
+		static const int SEQUENCE_BITS = 37;
+		static const int NESTENE_BITS = 16;
+
+		ID()
+			:aID(0), eID(0), tmu(0), nID(0), nesteneEncoding(false)
+		{
+			newGeneration();
+		}
+
+		int generateAutonID(){
+			return aID.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
 
-		static int generateAutonID(){
-			ID::aID++;
-			return ID::aID;
+		int generateNesteneID(){
+			return nID.fetch_add(1, std::memory_order_relaxed) + 1;
 		}
 
-		static int generateNesteneID(){
-			ID::nID++;
-			return ID::nID;
+		unsigned long long generateEventID(){
+			//the block of the calling thread:
+			static thread_local Block block = {0, 0, 0};
+
+			if(block.generation != generation || block.next == block.end){
+				block.generation = generation;
+				block.next = eID.fetch_add(BLOCK_SIZE, std::memory_order_relaxed) + 1;
+				block.end = block.next + BLOCK_SIZE;
+			}
+			return block.next++;
 		}
 
-		static unsigned long long generateEventID(){
-			ID::eID++;
-			return ID::eID;
+		/**
+		 * Generate an event ID on behalf of a Nestene.
+		 * @param nestene ID of the issuing Nestene, encoded in the event
+		 * ID if nestene encoding is enabled.
+		 */
+		unsigned long long generateEventID(int nestene){
+			unsigned long long id = generateEventID();
+			if(!nesteneEncoding)
+				return id;
+
+			const unsigned long long sequenceMask = (1ULL << SEQUENCE_BITS) - 1;
+			const unsigned long long nesteneMask = (1ULL << NESTENE_BITS) - 1;
+			return (((unsigned long long)nestene & nesteneMask) << SEQUENCE_BITS)
+				| (id & sequenceMask);
 		}
 
-		static unsigned long long incrementTime(){
-			ID::tmu++;
-			return ID::tmu;
+		static int nesteneOf(unsigned long long eventID){
+			return (int)(eventID >> SEQUENCE_BITS);
 		}
 
-		static void resetSystem(){
-			ID::aID = 0;
-			ID::nID = 0;
-			ID::eID = 0;
-			ID::tmu = 0;
+		void setNesteneEncoding(bool enabled){
+			nesteneEncoding = enabled;
+		}
+
+		unsigned long long incrementTime(){
+			return tmu.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+
+		void resetSystem(){
+			aID = 0;
+			nID = 0;
+			eID = 0;
+			tmu = 0;
+			//blocks taken before the reset are no longer valid:
+			newGeneration();
 		}
 	private : 
-		static int aID;
-		static unsigned long long eID;
-		static unsigned long long tmu;
-		static unsigned long long nID;
+		struct Block{
+			unsigned long long generation;
+			unsigned long long next;
+			unsigned long long end;
+		};
+
+		//makes blocks of other, or earlier, ID objects invalid:
+		void newGeneration(){
+			static std::atomic<unsigned long long> generations(0);
+			generation = generations.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+
+		std::atomic<int> aID;
+		std::atomic<unsigned long long> eID;
+		std::atomic<unsigned long long> tmu;
+		std::atomic<unsigned long long> nID;
+		unsigned long long generation;
+		bool nesteneEncoding;
 
 };
 
 
 #endif // ID_H
-
@@ -23,9 +23,12 @@
 #include<climits>
 #include "agentdomain.h"
 #include "master.h"
-#include "phys.h"
+#include "simcontext.h"
 #include "output.h"
-#include "ID.h"
+#include "metrics.h"
+#include "memaccount.h"
+#include "luamemory.h"
+#include "positionsnapshot.h"
 
 using std::chrono::duration_cast;
 using std::chrono::milliseconds;
@@ -33,14 +36,12 @@ using std::chrono::seconds;
 using std::chrono::steady_clock;
 
 AgentDomain::AgentDomain()
-	:mapGenerated(false), stop(false)
+	:mapGenerated(false), runSeconds(0), simulatedTmu(0), stop(false)
 	 {
-		 Phys::seedMersenne();
+		 master.getContext()->phys.seedMersenne();
 }
 
 AgentDomain::~AgentDomain(){
-	ID::resetSystem();
-	Phys::setCTime(0);
 }
 /**
  * Checks if an environment has been generated.
@@ -57,26 +58,32 @@ void AgentDomain::interpret(std::string function){
  * Generates the environment.
  * Upon environment generation the nestenes will be placed, autons will be 
  * assigned to a nestene and placed within it's parameters.
+ * Native autons are only generated if a plugin filename is given.
  */
 void AgentDomain::generateEnvironment(double width, double height, int resolution,
 		int listenerSize, int screamerSize, int LUASize,
-		double timeResolution, int macroFactor, std::string filename){
+		double timeResolution, int macroFactor, std::string filename,
+		int nativeSize, std::string pluginFilename){
 
 	this->timeResolution = timeResolution;
 	this->macroFactor = macroFactor;
 	macroResolution = macroFactor * timeResolution;
 
 
-	Phys::setTimeRes(timeResolution);
-	Phys::setCTime(0);
-	Phys::setMacroFactor(macroFactor);
-	Phys::setEnvironment(width, height);
+	Phys &phys = master.getContext()->phys;
+	phys.setTimeRes(timeResolution);
+	phys.setCTime(0);
+	phys.setMacroFactor(macroFactor);
+	phys.setEnvironment(width, height);
 
 	master.generateMap(width,height,resolution,timeResolution, macroResolution);
 	mapWidth = width;
 	mapHeight = height;
 
-	master.populateSystem(listenerSize, screamerSize, LUASize, filename);
+	if(pluginFilename.empty())
+		nativeSize = 0;
+	master.populateSystem(listenerSize, screamerSize, LUASize, filename,
+			nativeSize, pluginFilename);
 	mapGenerated = true;
 }
 
@@ -93,10 +100,11 @@ void AgentDomain::generateSquaredEnvironment(double width, double height, int re
 	macroResolution = macroFactor * timeResolution;
 
 
-	Phys::setTimeRes(timeResolution);
-	Phys::setCTime(0);
-	Phys::setMacroFactor(macroFactor);
-	Phys::setEnvironment(width, height);
+	Phys &phys = master.getContext()->phys;
+	phys.setTimeRes(timeResolution);
+	phys.setCTime(0);
+	phys.setMacroFactor(macroFactor);
+	phys.setEnvironment(width, height);
 
 
 	master.generateMap(width,height,resolution,timeResolution, macroResolution);
@@ -121,10 +129,11 @@ void AgentDomain::generateSquaredListenerEnvironment(double width, double height
 	macroResolution = macroFactor * timeResolution;
 
 
-	Phys::setTimeRes(timeResolution);
-	Phys::setCTime(0);
-	Phys::setMacroFactor(macroFactor);
-	Phys::setEnvironment(width, height);
+	Phys &phys = master.getContext()->phys;
+	phys.setTimeRes(timeResolution);
+	phys.setCTime(0);
+	phys.setMacroFactor(macroFactor);
+	phys.setEnvironment(width, height);
 
 
 	master.generateMap(width,height,resolution,timeResolution, macroResolution);
@@ -140,23 +149,21 @@ void AgentDomain::generateSquaredListenerEnvironment(double width, double height
 
 
 /**
- * Retrieval of auton positions.
- * Will write the positions of all autons to the std::lists given as arguments.
- * @param sylist y positions of all Screamer autons
- * @param sxlist x positions of all Screamer autons
- * @param lylist y positions of all Listener autons
- * @param lxlist x positions of all Listener autons
- * @param aylist y positions of all Lua autons
- * @param axlist x positions of all Lua autons
+ * Publication of auton positions.
+ * Publishes the positions of all autons to the position snapshot, where the
+ * map view reads them. Must not be called while a simulation is running,
+ * the run publishes them itself.
+ * @see PositionSnapshot
  */
-void AgentDomain::retrievePopPos(std::list<double> &sylist, std::list<double> &sxlist,
-		std::list<double> &lylist, std::list<double> &lxlist,
-		std::list<double> &aylist, std::list<double> &axlist,
-		double &width, double &height){
+void AgentDomain::publishPositions(){
+	master.publishPositions(master.getContext()->phys.getCTime(), mapWidth, mapHeight);
+}
 
-	master.retrievePopPos(sylist, sxlist, lylist, lxlist, aylist, axlist);
-	width = mapWidth;
-	height = mapHeight;
+/**
+ * Get the published auton positions of this simulation, for the map view.
+ */
+PositionSnapshot* AgentDomain::getPositionSnapshot(){
+	return &master.getContext()->positions;
 }
 
 /**
@@ -172,18 +179,29 @@ void AgentDomain::runSimulation(int time){
 
 	unsigned long long iterations = (double)time/timeResolution;
 	Output::Inst()->clearProgressBar();
+	if(Metrics::isEnabled())
+		Metrics::Inst()->beginRun(iterations, timeResolution);
+	master.getPhaseTimer()->beginRun(master.getEEventAmount() + master.getIEventAmount());
+	MemAccount::beginRun();
+	LuaMemory::beginRun();
+	master.beginHealthCheck(timeResolution);
 	auto start = steady_clock::now();
 	auto start2 = steady_clock::now();
 
 	unsigned long long run_time = 0;
 
+	if(!streamFile.empty())
+		master.streamExternalEvents(streamFile);
+
 	unsigned long long cMacroStep = 0;
 	unsigned long long cMicroStep = ULLONG_MAX;
 	unsigned long long i = 0, j = 0;
 
+	Phys &phys = master.getContext()->phys;
+
 	for(i = 0; i < iterations;){
 
-		Phys::setCTime(i);
+		phys.setCTime(i);
 
 		if(i == cMicroStep && cMicroStep != ULLONG_MAX){
 			master.microStep(i);		
@@ -192,6 +210,10 @@ void AgentDomain::runSimulation(int time){
 		if(i == cMacroStep){
 			master.macroStep(i);
 			cMacroStep +=macroFactor;
+			if(Doctor::isEnabled() && !master.checkHealth(i))
+				stop = true;
+			if(master.getContext()->positions.due())
+				master.publishPositions(i, mapWidth, mapHeight);
 		}		
 		i = cMacroStep;
 		cMicroStep = master.getNextMicroTmu();
@@ -205,6 +227,8 @@ void AgentDomain::runSimulation(int time){
 
 		if(duration_cast<milliseconds>(end-start).count() > 350){
 			master.printStatus();
+			if(Metrics::isEnabled())
+				master.publishMetrics();
 			Output::Inst()->progressBar(cMacroStep,iterations);
 			//Output::Inst()->kprintf("i is not : %d\n", i );
 			start = end;
@@ -215,10 +239,16 @@ void AgentDomain::runSimulation(int time){
 		}
 	}
 	master.simDone();
+	master.publishPositions(i, mapWidth, mapHeight);
 	master.printStatus();
+	if(Metrics::isEnabled()){
+		master.publishMetrics();
+		Metrics::Inst()->endRun();
+	}
 	Output::Inst()->progressBar(i,iterations);
 	auto endsim = steady_clock::now();
-	duration_cast<seconds>(start2-endsim).count();
+	runSeconds = duration_cast<std::chrono::duration<double>>(endsim - start2).count();
+	simulatedTmu = i;
 	Output::Inst()->kprintf("Simulation run took:\t %llu[s] "
 			, duration_cast<seconds>(endsim - start2).count()			
 			);
@@ -234,6 +264,45 @@ void AgentDomain::stopSimulation(){
 	Output::Inst()->clearProgressBar();
 }
 
+/**
+ * Encode the issuing Nestene in the event IDs.
+ * @see ID::generateEventID(int)
+ */
+void AgentDomain::setNesteneEventIDs(bool enabled){
+	master.getContext()->id.setNesteneEncoding(enabled);
+}
+
+/**
+ * Stream the external events to disk during the runs.
+ * @param filename name of the .kas file, without the extension.
+ * @see EventQueue::startStream
+ */
+void AgentDomain::setStreamFile(std::string filename){
+	streamFile = filename;
+}
+
+/**
+ * Set the .kas version of saved and streamed event data.
+ * @see EventQueue::setKasVersion
+ */
+void AgentDomain::setKasVersion(int version){
+	master.setKasVersion(version);
+}
+
+/**
+ * Select the events written to .kas files.
+ * @param spec the filter, an empty string exports all events.
+ * @return false if the filter could not be parsed.
+ * @see ExportFilter
+ */
+bool AgentDomain::setExportFilter(std::string spec){
+	ExportFilter filter;
+	if(!filter.parse(spec))
+		return false;
+	master.setExportFilter(filter);
+	return true;
+}
+
 /**
  * Save eEvent data to disk
  * @see EventQueue::saveEEventData
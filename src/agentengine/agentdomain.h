@@ -41,24 +41,35 @@ class AgentDomain
 
 		void generateEnvironment(double width, double height, int resolution,
 				int listenerSize, int screamerSize, int LUASize,
-				double timeResolution, int macroFactor, std::string filename);
+				double timeResolution, int macroFactor, std::string filename,
+				int nativeSize = 0, std::string pluginFilename = "");
 
 		void generateSquaredEnvironment(double width, double height, int resolution,int LUASize,double timeResolution, int macroFactor, std::string filename);
 
 		void generateSquaredListenerEnvironment(double width, double height, int resolution,int LUASize,double timeResolution, int macroFactor);
 
 
-		void retrievePopPos(std::list<double> &sylist, std::list<double> &sxlist,
-				std::list<double> &lylist, std::list<double> &lxlist,
-				std::list<double> &aylist, std::list<double> &axlist, double &width, double &height);
+		void publishPositions();
+		PositionSnapshot* getPositionSnapshot();
 
 		void runSimulation(int time);
 
 		bool checkEnvPresence();
 		void stopSimulation();
 		void saveExternalEvents(std::string filename);
+		void setNesteneEventIDs(bool enabled);
+		void setStreamFile(std::string filename);
+		void setKasVersion(int version);
+		bool setExportFilter(std::string spec);
 		void updateStatus();
 
+		//statistics of the last run:
+		double getRunSeconds(){ return runSeconds; }
+		unsigned long long getSimulatedTmu(){ return simulatedTmu; }
+		unsigned long long getEEventInitAmount(){ return master.getEEventInitAmount(); }
+		unsigned long long getEEventAmount(){ return master.getEEventAmount(); }
+		unsigned long long getIEventAmount(){ return master.getIEventAmount(); }
+
 	private:		
 		bool mapGenerated;
 		Master master;
@@ -66,8 +77,12 @@ class AgentDomain
 		double macroResolution;
 		int macroFactor;
 		int mapWidth, mapHeight;
+		//events are streamed to this file during runs, if set:
+		std::string streamFile;
 		unsigned long long iterations;
 		unsigned long long i;
+		double runSeconds;
+		unsigned long long simulatedTmu;
 
 
 		//Atomic thread controllers:
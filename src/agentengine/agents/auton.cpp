@@ -23,12 +23,17 @@
 
 #include "auton.h"
 #include "nestene.h"
+#include "autonlistener.h"
+#include "autonscreamer.h"
+#include "autonLUA.h"
+#include "autonplugin.h"
 //#include "ID.h"
 
 
 
-	Auton::Auton(int ID, double posX, double posY, double posZ, Nestene* nestene)
-:ID(ID), posX(posX), posY(posY), posZ(posZ), nestene(nestene)
+	Auton::Auton(int ID, double posX, double posY, double posZ, Nestene* nestene, AutonType type)
+:ID(ID), type(type), posX(posX), posY(posY), posZ(posZ), nestene(nestene),
+	ctx(nestene->getContext())
 {
 
 }
@@ -53,17 +58,53 @@ void Auton::distroEEvent(EventQueue::eEvent *event){
 	nestene->eEventsOutbox.push_back(event);
 }
 
-EventQueue::iEvent* Auton::handleEvent(EventQueue::eEvent* event){
-	return NULL;
-}
-
-
-EventQueue::eEvent* Auton::initEvent(int macroResolution, unsigned long long tmu){
-	return NULL;
+/**
+ * Act on an internal event.
+ * Dispatches to the actOnEvent of the concrete auton type, the 
+ * built-in types are not virtual so the calls can be inlined.
+ * @param event the internal event.
+ * @return always NULL, responses are sent via the Nestene outbox.
+ */
+EventQueue::eEvent* Auton::actOnEvent(EventQueue::iEvent *event){
+	switch(type){
+		case LISTENER:
+			return static_cast<AutonListener*>(this)->actOnEvent(event);
+		case SCREAMER:
+			return NULL;
+		case LUA:
+			return static_cast<AutonLUA*>(this)->actOnEvent(event);
+		case PLUGIN:
+			return static_cast<AutonPlugin*>(this)->actOnEvent(event);
+		default:
+			return NULL;
+	}
 }
 
-EventQueue::eEvent* Auton::actOnEvent(EventQueue::iEvent *event){
-	return NULL;
+/**
+ * Act on a batch of internal events.
+ * All events in the batch must originate from autons of the given type,
+ * which lets the loop call the concrete actOnEvent directly.
+ * @param events internal events of one auton type.
+ * @param type the auton type of the events origins.
+ */
+void Auton::actOnEvents(std::vector<EventQueue::iEvent*> &events, AutonType type){
+	std::vector<EventQueue::iEvent*>::iterator it;
+	switch(type){
+		case LISTENER:
+			for(it = events.begin(); it != events.end(); ++it)
+				static_cast<AutonListener*>((*it)->origin)->actOnEvent(*it);
+			break;
+		case LUA:
+			for(it = events.begin(); it != events.end(); ++it)
+				static_cast<AutonLUA*>((*it)->origin)->actOnEvent(*it);
+			break;
+		case PLUGIN:
+			for(it = events.begin(); it != events.end(); ++it)
+				static_cast<AutonPlugin*>((*it)->origin)->actOnEvent(*it);
+			break;
+		default:
+			break;
+	}
 }
 
 bool Auton::operator==(Auton &other) const{
@@ -28,21 +28,24 @@
 
 class EventQueue;
 class Nestene;
+class SimContext;
 class Auton
 {
 public:
-    Auton(int ID, double posX, double posY, double posZ, Nestene *nestene);
+    //the built-in auton types, used for static dispatch:
+    enum AutonType { LISTENER, SCREAMER, LUA, PLUGIN, TYPE_AMOUNT };
 
-    virtual EventQueue::iEvent* handleEvent(EventQueue::eEvent* event);
-    virtual EventQueue::eEvent* actOnEvent(EventQueue::iEvent* event);
-    virtual EventQueue::eEvent* initEvent(int macroResolution, unsigned long long tmu);
-    //virtual double eventChance();
+    Auton(int ID, double posX, double posY, double posZ, Nestene *nestene, AutonType type);
+
+    //dispatches to the actOnEvent of the concrete auton type:
+    EventQueue::eEvent* actOnEvent(EventQueue::iEvent* event);
+    static void actOnEvents(std::vector<EventQueue::iEvent*> &events, AutonType type);
 
-	
     std::string getDesc();
     int getID();
     double getPosX();
     double getPosY();
+    AutonType getType(){ return type; }
 
     void simDone(){};
 
@@ -54,10 +57,12 @@ protected:
     void distroEEvent(EventQueue::eEvent* event);
 
     int ID;
+    AutonType type;
     std::string desc;
     double posX, posY, posZ;
     std::vector<double> statusVector;
     Nestene* nestene;
+    SimContext* ctx;
 
     friend class Nestene;
 };
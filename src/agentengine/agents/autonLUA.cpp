@@ -24,19 +24,35 @@
 #include <string>
 #include <random>
 #include <chrono>
+#include <cmath>
+#include <new>
 
 #include "lua.hpp"
 #include "lauxlib.h"
 #include "lualib.h"
 
-#include "ID.h"
+#include "simcontext.h"
 #include "autonLUA.h"
+#include "luaprofiler.h"
+#include "luawatchdog.h"
+#include "doctor.h"
+#include "metrics.h"
+#include "tracer.h"
 #include "phys.h"
 
+namespace {
+	//the panic function luaL_newstate would set, for errors outside lua_pcall:
+	int panic(lua_State *L){
+		const char *error = lua_tostring(L, -1);
+		Output::Inst()->kprintf("PANIC: unprotected error in call to Lua API (%s)\n",
+				error != NULL ? error : "unknown error");
+		return 0;
+	}
+}
  
 
 	AutonLUA::AutonLUA(int ID, double posX, double posY, double posZ, Nestene *nestene, std::string filename)
-: Auton(ID, posX, posY, posZ, nestene), filename(filename)
+: Auton(ID, posX, posY, posZ, nestene, LUA), filename(filename)
 {
 	desc = "LUA";
 
@@ -44,29 +60,56 @@
 
 	//Output::Inst()->kprintf("%f,%f", posX, posY);
 	/*
-	 * Setup up the LUA stack:
+	 * Setup up the LUA stack, allocating through the memory governor:
 	 */
-	L = luaL_newstate();
+	heap = new LuaMemory::State();
+	L = lua_newstate(LuaMemory::alloc, heap);
+	if(L == NULL){
+		Output::Inst()->kprintf("Auton %i: could not create a Lua state, Lua Auton disabled\n", ID);
+		delete heap;
+		heap = NULL;
+		nofile = true;
+		return;
+	}
+	lua_atpanic(L, panic);
+	LuaMemory::setup(L);
 	luaL_openlibs(L);
 	/*
-	 * Register all the physics wrapper functions:
+	 * Register all the physics wrapper functions, with the simulation
+	 * context, the Nestene, the debug rate limit and the auton ID as upvalues.
+	 * The rate limit is a userdata so copies of the auton share it:
 	 */
-	lua_register(L, "l_speedOfSound", l_speedOfSound);
-	lua_register(L, "l_distance", l_distance);
-	lua_register(L, "l_currentTime",l_currentTime);
-	lua_register(L, "l_debug", l_debug);
-	lua_register(L, "l_generateEventID", l_generateEventID);
-	lua_register(L, "l_getMacroFactor", l_getMacroFactor);
-	lua_register(L, "l_getTimeResolution", l_getTimeResolution);
-	lua_register(L, "l_getMersenneFloat", l_getMersenneFloat);
-	lua_register(L, "l_getMersenneInteger", l_getMersenneInteger);
-	lua_register(L, "l_getEnvironmentSize", l_getEnvironmentSize); 
+	const luaL_Reg wrappers[] = {
+		{"l_speedOfSound", l_speedOfSound},
+		{"l_distance", l_distance},
+		{"l_currentTime", l_currentTime},
+		{"l_debug", l_debug},
+		{"l_log", l_log},
+		{"l_generateEventID", l_generateEventID},
+		{"l_getMacroFactor", l_getMacroFactor},
+		{"l_getTimeResolution", l_getTimeResolution},
+		{"l_getMersenneFloat", l_getMersenneFloat},
+		{"l_getMersenneInteger", l_getMersenneInteger},
+		{"l_getEnvironmentSize", l_getEnvironmentSize},
+		{"l_setPropagationModel", l_setPropagationModel},
+		{"l_receivedLevel", l_receivedLevel},
+		{NULL, NULL}
+	};
+	lua_pushglobaltable(L);
+	lua_pushlightuserdata(L, ctx);
+	lua_pushlightuserdata(L, nestene);
+	debugBudget = new (lua_newuserdata(L, sizeof(DebugLog::Budget))) DebugLog::Budget();
+	lua_pushnumber(L, ID);
+	luaL_setfuncs(L, wrappers, 4);
+	lua_pop(L,1);
+
+	LuaWatchdog::attach(L);
 	//Load the LUA frog:
 	//std::string pre = "../src/frog.lua";
 	//std::string file = pre;
 	//
 
-	if(luaL_loadfile(L, filename.c_str() ) || lua_pcall(L,0,0,0)){
+	if(luaL_loadfile(L, filename.c_str() ) || callLua(0,0,"load")){
 		Output::Inst()->kprintf("error : %s \n", lua_tostring(L, -1));
 		nofile = true;
 		Output::Inst()->kprintf("Lua Auton disabled\n");
@@ -76,12 +119,12 @@
 	lua_pushnumber(L,posX);
 	lua_pushnumber(L,posY);
 	lua_pushnumber(L,ID);
-	int mf = Phys::getMacroFactor();
-	double tr = Phys::getTimeRes();
+	int mf = ctx->phys.getMacroFactor();
+	double tr = ctx->phys.getTimeRes();
 	lua_pushnumber(L,mf);
 	lua_pushnumber(L,tr);
 	//Call the initAuton function (3 arguments, 0 results):
-	if(lua_pcall(L,5,0,0)!=LUA_OK){
+	if(callLua(5,0,"initAuton")!=LUA_OK){
 		Output::Inst()->kprintf("error on init autonLUA: %s\n",	lua_tostring(L,-1));
 		nofile = true;
 		Output::Inst()->kprintf("Lua Auton disabled\n");
@@ -90,28 +133,84 @@
 	//sync positions:
 	lua_getglobal(L,"getSyncData");
 
-	if(lua_pcall(L,0,2,0)!=LUA_OK)
+	if(callLua(0,2,"getSyncData")!=LUA_OK)
 		Output::Inst()->kprintf("error on initiateEvent:getSyncData:\t %s\n",lua_tostring(L,-1));
 
 	posX = lua_tonumber(L,-2);
 	posY = lua_tonumber(L,-1);
 	lua_settop(L,0);
 
+	//check if the script wants its external events delivered in batches:
+	lua_getglobal(L,"handleExternalEvents");
+	batchHandler = lua_isfunction(L,-1);
+	lua_settop(L,0);
 }
 
 AutonLUA::~AutonLUA(){
 }
 
 
+/**
+ * Calls the Lua function on top of the stack.
+ * All calls into the Lua script goes through here, so they can be 
+ * timed by the LuaProfiler when it is enabled, and held to the instruction
+ * budget. An auton exceeding the budget is disabled.
+ * @param nargs number of arguments pushed after the function.
+ * @param nresults number of results.
+ * @param callback name of the called function, used by the profiler.
+ * @return the lua_pcall status.
+ * @see LuaWatchdog
+ */
+int AutonLUA::callLua(int nargs, int nresults, const char *callback){
+	int status;
+	Metrics::countLuaCallback();
+	Tracer::Scope span(Tracer::sampleLua() ? callback : NULL, "auton", ID);
+	LuaWatchdog::arm(L);
+	std::chrono::steady_clock::time_point start;
+	if(Doctor::timesCallbacks())
+		start = std::chrono::steady_clock::now();
+	//the memory cap is only enforced where Lua can raise the error:
+	heap->limited = true;
+	if(!LuaProfiler::isEnabled())
+		status = lua_pcall(L,nargs,nresults,0);
+	else{
+		LuaProfiler::Inst()->beginCallback(ID, callback);
+		status = lua_pcall(L,nargs,nresults,0);
+		LuaProfiler::Inst()->endCallback();
+	}
+	heap->limited = false;
+	ctx->doctor.luaCallback(status != LUA_OK);
+	if(Doctor::timesCallbacks())
+		ctx->doctor.callbackTime(ID, std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - start).count());
+
+	if(status != LUA_OK && DebugLog::isEnabled()
+			&& DebugLog::Inst()->allow(DebugLog::LEVEL_ERROR, *debugBudget)){
+		static const int format = DebugLog::Inst()->format("error on '%s': %s");
+		const char *error = lua_tostring(L,-1);
+		DebugLog::Inst()->log(DebugLog::LEVEL_ERROR, format, ID, ctx->phys.getCTime(),
+				callback, error != NULL ? error : "");
+	}
+	if(LuaWatchdog::isEnabled() && LuaWatchdog::tripped()){
+		Output::Inst()->kprintf("Auton %i disabled, '%s' exceeded the instruction budget\n",
+				ID, callback);
+		LuaWatchdog::disabled(ID);
+		nofile = true;
+	}
+	return status;
+}
+
 /**
  * Handler for external events.
  * Will send all relevant event data to the LUA script which will then 
  * process the event and either return a null string, or arguments
  * to initiate an internal event.
  * @param event pointer to the external event.
+ * @param level received level from the events propagation model, 
+ * passed as nil if it is NaN.
  * @return internal event.
  */
-EventQueue::iEvent* AutonLUA::handleEvent(EventQueue::eEvent *event){
+EventQueue::iEvent* AutonLUA::handleEvent(EventQueue::eEvent *event, double level){
 	if(nofile)
 		return NULL;
 
@@ -131,8 +230,13 @@ EventQueue::iEvent* AutonLUA::handleEvent(EventQueue::eEvent *event){
 	lua_pushstring(L,event->desc.c_str());
 	//push the table to the stack
 	lua_pushstring(L,event->table.c_str());
-	//make the function call with 5 arguments and 3 results
-	if(lua_pcall(L,6,3,0)!=LUA_OK)
+	//push the received level to the stack
+	if(std::isnan(level))
+		lua_pushnil(L);
+	else
+		lua_pushnumber(L,level);
+	//make the function call with 7 arguments and 3 results
+	if(callLua(7,3,"handleExternalEvent")!=LUA_OK)
 		Output::Inst()->kprintf("error on handleEvent:\t %s\n",lua_tostring(L,-1));
 
 	//Test if the handleevent method returns a null string
@@ -153,6 +257,10 @@ EventQueue::iEvent* AutonLUA::handleEvent(EventQueue::eEvent *event){
 		Output::Inst()->kprintf("LUA function handleEvent activation must be a number");
 		delete ievent;
 		return NULL;
+	} else if(activationTime < ctx->phys.getCTime()){
+		Output::Inst()->kprintf("Activation TMU must be > than current TMU, returning NULL\n");
+		delete ievent;
+		return NULL;
 	} else ievent->activationTime = activationTime;
 
 	unsigned long long id = lua_tonumberx(L,-2, &isnum);
@@ -169,6 +277,109 @@ EventQueue::iEvent* AutonLUA::handleEvent(EventQueue::eEvent *event){
 	return ievent;
 }
 
+/**
+ * Batched handler for external events.
+ * Sends every external event reaching this auton in the current tmu to the 
+ * LUA 'handleExternalEvents' function as one array of records, with the fields
+ * originX, originY, id, propagationSpeed, desc, table and receivedLevel, the
+ * latter only if the event type has a propagation model. The function returns
+ * a table of responses indexed like the batch, each either nil, 'null' or a 
+ * record {desc, id, activationTime} from which an internal event is made.
+ * @param batch the external events, in delivery order.
+ * @param levels received level of each event, NaN if there is no model.
+ * @param responses list the generated internal events are appended to.
+ */
+void AutonLUA::handleEvents(std::vector<EventQueue::eEvent*> &batch,
+		std::vector<double> &levels,
+		std::list<EventQueue::iEvent*> &responses){
+	if(nofile)
+		return;
+
+	lua_settop(L,0);
+
+	int isnum;
+	lua_getglobal(L,"handleExternalEvents");
+	//build the batch table:
+	lua_createtable(L,batch.size(),0);
+	for(unsigned int i = 0; i < batch.size(); i++){
+		EventQueue::eEvent *event = batch[i];
+		lua_createtable(L,0,7);
+		lua_pushnumber(L,event->origin->getPosX());
+		lua_setfield(L,-2,"originX");
+		lua_pushnumber(L,event->origin->getPosY());
+		lua_setfield(L,-2,"originY");
+		lua_pushnumber(L,event->id);
+		lua_setfield(L,-2,"id");
+		lua_pushnumber(L,event->propagationSpeed);
+		lua_setfield(L,-2,"propagationSpeed");
+		lua_pushstring(L,event->desc.c_str());
+		lua_setfield(L,-2,"desc");
+		lua_pushstring(L,event->table.c_str());
+		lua_setfield(L,-2,"table");
+		if(!std::isnan(levels[i])){
+			lua_pushnumber(L,levels[i]);
+			lua_setfield(L,-2,"receivedLevel");
+		}
+		lua_rawseti(L,-2,i+1);
+	}
+	//make the function call with the batch as argument and 1 result:
+	if(callLua(1,1,"handleExternalEvents")!=LUA_OK){
+		Output::Inst()->kprintf("error on handleEvents:\t %s\n",lua_tostring(L,-1));
+		lua_settop(L,0);
+		return;
+	}
+	if(!lua_istable(L,-1)){
+		//a 'null' string or nil, means no responses at all:
+		lua_settop(L,0);
+		return;
+	}
+	//traverse the response table:
+	lua_pushnil(L);
+	while(lua_next(L,-2) != 0){
+		unsigned int index = lua_tonumberx(L,-2,&isnum);
+		if(!isnum || index < 1 || index > batch.size() || !lua_istable(L,-1)){
+			lua_pop(L,1);
+			continue;
+		}
+		EventQueue::iEvent *ievent = new EventQueue::iEvent();
+		ievent->origin = this;
+		ievent->event = batch[index-1];
+
+		lua_getfield(L,-1,"activationTime");
+		double activationTime = lua_tonumberx(L,-1,&isnum);
+		lua_pop(L,1);
+		if(!isnum){
+			Output::Inst()->kprintf("LUA function handleExternalEvents activation must be a number\n");
+			delete ievent;
+			lua_pop(L,1);
+			continue;
+		} else if(activationTime < ctx->phys.getCTime()){
+			Output::Inst()->kprintf("Activation TMU must be > than current TMU, returning NULL\n");
+			delete ievent;
+			lua_pop(L,1);
+			continue;
+		} else ievent->activationTime = activationTime;
+
+		lua_getfield(L,-1,"id");
+		unsigned long long id = lua_tonumberx(L,-1,&isnum);
+		lua_pop(L,1);
+		if(!isnum){
+			Output::Inst()->kprintf("LUA function handleExternalEvents id must be a number\n");
+			delete ievent;
+			lua_pop(L,1);
+			continue;
+		} else ievent->id = id;
+
+		lua_getfield(L,-1,"desc");
+		if(lua_isstring(L,-1))
+			ievent->desc = lua_tostring(L,-1);
+		lua_pop(L,2);
+
+		responses.push_back(ievent);
+	}
+	lua_settop(L,0);
+}
+
 /**
  * Query if the auton will initiate an event.
  * This will call up the LUA autons initEvent function which will
@@ -188,7 +399,7 @@ EventQueue::eEvent* AutonLUA::initEvent(){
 	//sync positions:
 	lua_getglobal(L,"getSyncData");
 
-	if(lua_pcall(L,0,2,0)!=LUA_OK)
+	if(callLua(0,2,"getSyncData")!=LUA_OK)
 		Output::Inst()->kprintf("error on initiateEvent:getSyncData:\t %s\n",lua_tostring(L,-1));
 
 	posX = lua_tonumber(L,-2);
@@ -200,7 +411,7 @@ EventQueue::eEvent* AutonLUA::initEvent(){
 	//Call the initiate event function:
 	lua_getglobal(L,"initiateEvent");
 	
-	if(lua_pcall(L,0,6,0)!=LUA_OK)
+	if(callLua(0,6,"initiateEvent")!=LUA_OK)
 		Output::Inst()->kprintf("error on initiateEvent:\t %s\n",lua_tostring(L,-1));
 
 	  
@@ -231,7 +442,7 @@ EventQueue::eEvent* AutonLUA::initEvent(){
 		return NULL;
 	} else{	
 		unsigned long long activationTime = lua_tonumber(L,-2) +1;
-		if(activationTime < Phys::getCTime()){
+		if(activationTime < ctx->phys.getCTime()){
 			Output::Inst()->kprintf("Activation TMU must be > than current TMU, returning NULL\n");
 			delete sendEvent;
 			return NULL;
@@ -292,7 +503,7 @@ EventQueue::eEvent* AutonLUA::actOnEvent(EventQueue::iEvent *ievent){
 	//push the table to the stack
 	lua_pushstring(L,ievent->event->table.c_str());
 	//make the function call with 5 arguments and 6 returnvalues
-	if(lua_pcall(L,5,6,0)!=LUA_OK)
+	if(callLua(5,6,"handleInternalEvent")!=LUA_OK)
 		Output::Inst()->kprintf("error on 'handleInternalEvent':\t %s\n",lua_tostring(L,-1));	
 
 	//Test if the handleevent method returns a null string
@@ -320,7 +531,7 @@ EventQueue::eEvent* AutonLUA::actOnEvent(EventQueue::iEvent *ievent){
 		return NULL;
 	} else{
 		unsigned long long activationTime = lua_tonumber(L,-2);
-		if(activationTime < Phys::getCTime()){
+		if(activationTime < ctx->phys.getCTime()){
 			Output::Inst()->kprintf("Activation time must be > than current time, returning NULL\n");
 			delete sendEvent;
 			return NULL;
@@ -349,6 +560,16 @@ EventQueue::eEvent* AutonLUA::actOnEvent(EventQueue::iEvent *ievent){
 	sendEvent->posY = posY;
 
 	distroEEvent(sendEvent);
+	return NULL;
+}
+
+/**
+ * Collect garbage between macro steps.
+ * @see LuaMemory::collect()
+ */
+void AutonLUA::collectGarbage(){
+	if(!nofile)
+		LuaMemory::collect(L);
 }
 
 void AutonLUA::simDone(){
@@ -356,11 +577,12 @@ void AutonLUA::simDone(){
 		return;
 
 	lua_getglobal(L,"simDone");
-	if(lua_pcall(L,0,0,0)!=LUA_OK)
+	if(callLua(0,0,"simDone")!=LUA_OK)
 		Output::Inst()->kprintf("error on 'simDone':\t %s\n",lua_tostring(L,-1));
 
 	lua_settop(L,0);
 	lua_close(L);
+	delete heap;
 }
 
 /*********************************************
@@ -368,12 +590,87 @@ void AutonLUA::simDone(){
  *********************************************/
 
 /**
- * Calls my printf wrapper function with a given string.
+ * Writes a debug message.
+ * Called either with a single string, or with a printf style format and
+ * its arguments. The message goes to the binary debug log if it is
+ * enabled, otherwise it is written with my printf wrapper.
  * @param L LUA state pointer.
  * @return 0.
+ * @see DebugLog
  */
 int AutonLUA::l_debug(lua_State *L){
-	Output::Inst()->kprintf(lua_tostring(L,-1));
+	return debugMessage(L, DebugLog::LEVEL_DEBUG, 1);
+}
+
+/**
+ * Writes a message at a given level.
+ * Same as l_debug, with the level as the first argument:
+ * 0 = error, 1 = warn, 2 = info, 3 = debug.
+ * @param L LUA state pointer.
+ * @return 0.
+ */
+int AutonLUA::l_log(lua_State *L){
+	int level = lua_tonumber(L,1);
+	if(level < DebugLog::LEVEL_ERROR)
+		level = DebugLog::LEVEL_ERROR;
+	else if(level > DebugLog::LEVEL_DEBUG)
+		level = DebugLog::LEVEL_DEBUG;
+	return debugMessage(L, level, 2);
+}
+
+/**
+ * Rate limits and writes a message from the script.
+ * @param level the DebugLog level.
+ * @param first stack index of the message, or the format.
+ */
+int AutonLUA::debugMessage(lua_State *L, int level, int first){
+	int top = lua_gettop(L);
+	if(top < first || !DebugLog::Inst()->allow((DebugLog::Level)level, *getBudget(L)))
+		return 0;
+
+	if(!DebugLog::isEnabled()){
+		if(top > first){
+			//let Lua do the formatting:
+			lua_getglobal(L,"string");
+			lua_getfield(L,-1,"format");
+			lua_remove(L,-2);
+			for(int i = first; i <= top; i++)
+				lua_pushvalue(L,i);
+			if(lua_pcall(L,top-first+1,1,0) != LUA_OK)
+				Output::Inst()->kprintf("error on l_debug: ");
+		}
+		const char *msg = lua_tostring(L,-1);
+		if(msg != NULL)
+			Output::Inst()->kprintf("%s", msg);
+		return 0;
+	}
+
+	int format;
+	if(top == first){
+		static const int plain = DebugLog::Inst()->format("%s");
+		format = plain;
+	}else{
+		const char *fmt = lua_tostring(L,first);
+		format = DebugLog::Inst()->format(fmt != NULL ? fmt : "");
+		first++;
+	}
+
+	DebugLog::Record record((DebugLog::Level)level, format, getAutonID(L),
+			getContext(L)->phys.getCTime());
+	for(int i = first; i <= top; i++){
+		int type = lua_type(L,i);
+		if(type == LUA_TNUMBER)
+			record.add((double)lua_tonumber(L,i));
+		else if(type == LUA_TSTRING){
+			size_t length;
+			const char *value = lua_tolstring(L,i,&length);
+			record.add(value, length);
+		}else if(type == LUA_TBOOLEAN)
+			record.add(lua_toboolean(L,i) ? "true" : "false");
+		else
+			record.add(lua_typename(L,type));
+	}
+	DebugLog::Inst()->commit(record);
 	return 0;
 }
 
@@ -384,7 +681,7 @@ int AutonLUA::l_debug(lua_State *L){
  */
 int AutonLUA::l_generateEventID(lua_State *L){
 
-	unsigned long long id = ID::generateEventID();
+	unsigned long long id = getNestene(L)->generateEventID();
 	lua_pushnumber(L,id);
 	return 1;
 }
@@ -407,7 +704,7 @@ int AutonLUA::l_speedOfSound(lua_State *L){
 	double propagationSpeed = lua_tonumber(L,-5);
 
 
-	unsigned long long t = Phys::speedOfSound(posX, posY, origX, origY, propagationSpeed);
+	unsigned long long t = getContext(L)->phys.speedOfSound(posX, posY, origX, origY, propagationSpeed);
 
 	lua_pushnumber(L,t);	
 
@@ -438,27 +735,115 @@ int AutonLUA::l_distance(lua_State *L){
  * @see l_speedOfSound
  */
 int AutonLUA::l_currentTime(lua_State *L){
-	unsigned long long t = Phys::getCTime();
+	unsigned long long t = getContext(L)->phys.getCTime();
 	lua_pushnumber(L,t);
 	return 1;
 }
 
 int AutonLUA::l_getEnvironmentSize(lua_State *L){
-	lua_pushnumber(L,Phys::getEnvX());
-	lua_pushnumber(L,Phys::getEnvY());
+	SimContext *ctx = getContext(L);
+	lua_pushnumber(L,ctx->phys.getEnvX());
+	lua_pushnumber(L,ctx->phys.getEnvY());
 	return 2;
 
 }
 
 
+/**
+ * Set the propagation model of an event type.
+ * Lua arguments are the event desc, the model name ('spherical' or 
+ * 'sigmoid') and an optional table with the fields sourceLevel, 
+ * referenceDistance, distanceThreshold, absorption and threshold.
+ * @see Propagation::setModel
+ */
+int AutonLUA::l_setPropagationModel(lua_State *L){
+	std::string desc = luaL_checkstring(L,1);
+	std::string model = luaL_checkstring(L,2);
+
+	Propagation::ModelType type;
+	if(model.compare("spherical") == 0)
+		type = Propagation::SPHERICAL;
+	else if(model.compare("sigmoid") == 0)
+		type = Propagation::SIGMOID;
+	else
+		return luaL_error(L, "unknown propagation model '%s'", model.c_str());
+
+	const char *names[] = {"sourceLevel", "referenceDistance", 
+		"distanceThreshold", "absorption", "threshold"};
+	double values[] = {100, 1, 10, 0, -HUGE_VAL};
+
+	if(lua_istable(L,3)){
+		for(int i = 0; i < 5; i++){
+			lua_getfield(L,3,names[i]);
+			if(lua_isnumber(L,-1))
+				values[i] = lua_tonumber(L,-1);
+			lua_pop(L,1);
+		}
+	}
+	getNestene(L)->master->getPropagation()->setModel(desc, type, values[0],
+			values[1], values[2], values[3], values[4]);
+	return 0;
+}
+
+/**
+ * Received level of an event type.
+ * Lua arguments are the event desc, x, y, origin x and origin y, returns
+ * the level from the lookup table or nil if the type has no model.
+ */
+int AutonLUA::l_receivedLevel(lua_State *L){
+	std::string desc = luaL_checkstring(L,1);
+	const Propagation::Model *model = 
+		getNestene(L)->master->getPropagation()->getModel(desc);
+	if(model == NULL){
+		lua_pushnil(L);
+		return 1;
+	}
+	double distance = Phys::calcDistance(lua_tonumber(L,4), lua_tonumber(L,5),
+			lua_tonumber(L,2), lua_tonumber(L,3));
+	lua_pushnumber(L, model->level(distance));
+	return 1;
+}
+
+/**
+ * Get the Nestene of the auton owning a Lua state.
+ * The Nestene is the second upvalue of every registered wrapper.
+ */
+Nestene* AutonLUA::getNestene(lua_State *L){
+	return (Nestene*)lua_touserdata(L, lua_upvalueindex(2));
+}
+
+/**
+ * Get the simulation context of a wrapper function call.
+ * The context is the upvalue of every registered wrapper.
+ */
+SimContext* AutonLUA::getContext(lua_State *L){
+	return (SimContext*)lua_touserdata(L, lua_upvalueindex(1));
+}
+
+/**
+ * Get the debug rate limit of the auton calling a wrapper function.
+ * It is the third upvalue of every registered wrapper.
+ */
+DebugLog::Budget* AutonLUA::getBudget(lua_State *L){
+	return (DebugLog::Budget*)lua_touserdata(L, lua_upvalueindex(3));
+}
+
+/**
+ * Get the ID of the auton calling a wrapper function.
+ * It is the fourth upvalue of every registered wrapper.
+ */
+int AutonLUA::getAutonID(lua_State *L){
+	return lua_tonumber(L, lua_upvalueindex(4));
+}
+
 int AutonLUA::l_getMacroFactor(lua_State *L){
-	int mf = Phys::getMacroFactor();
+	int mf = getContext(L)->phys.getMacroFactor();
 	lua_pushnumber(L,mf);
 	return 1;
 }
 
 int AutonLUA::l_getTimeResolution(lua_State *L){	
-	double tr = Phys::getTimeRes();
+	double tr = getContext(L)->phys.getTimeRes();
 	lua_pushnumber(L,tr);
 	return 1;
 }
@@ -467,7 +852,7 @@ int AutonLUA::l_getMersenneFloat(lua_State *L){
 	double low = lua_tonumber(L,-2);
 	double high = lua_tonumber(L, -1);
 
-	double number = Phys::getMersenneFloat(low,high);
+	double number = getContext(L)->phys.getMersenneFloat(low,high);
 
 	lua_pushnumber(L,number);
 	return 1;
@@ -477,7 +862,7 @@ int AutonLUA::l_getMersenneInteger(lua_State *L){
 	uint64_t low = lua_tonumber(L,-2);
 	uint64_t high = lua_tonumber(L, -1);
 
-	uint64_t number = Phys::getMersenneInteger(low,high);
+	uint64_t number = getContext(L)->phys.getMersenneInteger(low,high);
 	lua_pushnumber(L,number);
 	return 1;
 }
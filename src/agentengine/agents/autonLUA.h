@@ -23,6 +23,8 @@
 #define AUTONLUA_H
 
 #include <random>
+#include <vector>
+#include <list>
 
 #include "lua.hpp"
 #include "lauxlib.h"
@@ -31,8 +33,11 @@
 #include "auton.h"
 #include "nestene.h"
 #include "output.h"
+#include "debuglog.h"
+#include "luamemory.h"
 
 class Nestene;
+class SimContext;
 
 class AutonLUA : public Auton
 {
@@ -47,6 +52,7 @@ class AutonLUA : public Auton
 		 * General LUA wrapper functions
 		 */
 		static int l_debug(lua_State *L);
+		static int l_log(lua_State *L);
 		static int l_registerIEvent(lua_State *L);
 		static int l_registerEEvent(lua_State *L);
 		static int l_generateEventID(lua_State *L);
@@ -64,23 +70,43 @@ class AutonLUA : public Auton
 		static int l_getMersenneFloat(lua_State *L);
 		static int l_getMersenneInteger(lua_State *L);
 		static int l_getEnvironmentSize(lua_State *L);	
+		static int l_setPropagationModel(lua_State *L);
+		static int l_receivedLevel(lua_State *L);
 
 	private:
 			//function to receive an event from nestene responsible for this auton, returns an internal Event 'thinking':
-			EventQueue::iEvent* handleEvent(EventQueue::eEvent* event);
+			//the received level is NaN if there is no propagation model for the event:
+			EventQueue::iEvent* handleEvent(EventQueue::eEvent* event, double level);
+			//batched version, used when the script defines handleExternalEvents:
+			void handleEvents(std::vector<EventQueue::eEvent*> &batch,
+					std::vector<double> &levels,
+					std::list<EventQueue::iEvent*> &responses);
 			EventQueue::eEvent* actOnEvent(EventQueue::iEvent *event);
 			//returns an event:
 			EventQueue::eEvent* initEvent();
 
 			void simDone();
+			void collectGarbage();
+			int callLua(int nargs, int nresults, const char *callback);
+			static Nestene* getNestene(lua_State *L);
+			static SimContext* getContext(lua_State *L);
+			static DebugLog::Budget* getBudget(lua_State *L);
+			static int getAutonID(lua_State *L);
+			static int debugMessage(lua_State *L, int level, int first);
 
 			double eventChance();
 			std::string filename;
 			//The LUA state:
 			lua_State* L;
 			friend class Nestene;
+			friend class Auton;
 
 			bool nofile = false;
+			bool batchHandler = false;
+			//rate limit of the debug messages, owned by the LUA state:
+			DebugLog::Budget *debugBudget;
+			//memory of the LUA state, freed after it is closed:
+			LuaMemory::State *heap;
 
 
 };
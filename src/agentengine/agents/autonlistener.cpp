@@ -24,41 +24,29 @@
 #include <stdlib.h>
 #include <time.h>
 
-#include "ID.h"
+#include "nestene.h"
 #include "autonlistener.h"
 #include "phys.h"
 #include "output.h"
 
 	AutonListener::AutonListener(int ID, double posX, double posY, double posZ, Nestene *nestene)
-: Auton(ID, posX, posY, posZ, nestene), eventChance(0.0)
+: Auton(ID, posX, posY, posZ, nestene, LISTENER), eventChance(0.0)
 {
 	desc = "Listener";
 }
 
-EventQueue::iEvent* AutonListener::handleEvent(EventQueue::eEvent *event){
-	unsigned long long time = 
-		Phys::speedOfSound(event->origin->getPosX(),event->origin->getPosY(), posX, posY);
-
-	EventQueue::iEvent *ievent = new EventQueue::iEvent();
-
-	ievent->origin = this;
-	ievent->activationTime = time;
-	ievent->event = event;
-	return ievent;
-}
-
-
 EventQueue::eEvent* AutonListener::initEvent(double macroResolution, unsigned long long tmu){
 	if(!eventInitiated){
 		eventInitiated = true;
 		EventQueue::eEvent *event = new EventQueue::eEvent();
 		event->desc = "callEvent";
 		event->duration = 5;
-		event->id = ID::generateEventID();
+		event->id = nestene->generateEventID();
 		event->activationTime = tmu+1;
 		event->origin = this;
 		return event;
 	}
+	return NULL;
 }
 
 EventQueue::eEvent* AutonListener::actOnEvent(EventQueue::iEvent *event){
@@ -66,11 +54,12 @@ EventQueue::eEvent* AutonListener::actOnEvent(EventQueue::iEvent *event){
 	EventQueue::eEvent *sendEvent = new EventQueue::eEvent();
 	sendEvent->desc = "callEvent";
 	sendEvent->duration = 5;
-	sendEvent->id = ID::generateEventID();
+	sendEvent->id = nestene->generateEventID();
 	sendEvent->activationTime = event->activationTime+1;
 	sendEvent->origin = this;
 
 	distroEEvent(sendEvent);
+	return NULL;
 }
 
 bool AutonListener::operator==(AutonListener &other) const{
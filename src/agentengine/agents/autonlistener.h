@@ -34,8 +34,15 @@ class AutonListener : public Auton
 		bool operator!=(AutonListener &other) const;
 
 	private:
-		//function to receive an event from nestene responsible for this auton, returns an internal Event 'thinking':
-		EventQueue::iEvent* handleEvent(EventQueue::eEvent* event);
+		//function to receive an event from nestene responsible for this auton, returns an internal Event 'thinking',
+		//the Nestene calculates the arrival times for all its listeners in one pass:
+		EventQueue::iEvent* handleEvent(EventQueue::eEvent* event, unsigned long long time){
+			EventQueue::iEvent *ievent = new EventQueue::iEvent();
+			ievent->origin = this;
+			ievent->activationTime = time;
+			ievent->event = event;
+			return ievent;
+		}
 		EventQueue::eEvent* actOnEvent(EventQueue::iEvent *event);
 
 		//returns an event:
@@ -46,6 +53,7 @@ class AutonListener : public Auton
 		bool eventInitiated = false;
 
 		friend class Nestene;
+		friend class Auton;
 		//Nestene *nestene;
 };
 
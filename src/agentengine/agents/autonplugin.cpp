@@ -0,0 +1,320 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <map>
+#include <cstring>
+#include <dlfcn.h>
+
+#include "autonplugin.h"
+#include "nestene.h"
+#include "simcontext.h"
+#include "output.h"
+
+/*********************************************
+ * Host functions available to the plugins,
+ * ctx is the Nestene of the plugin group:
+ *********************************************/
+namespace {
+	Phys& phys(void *ctx){
+		return ((Nestene*)ctx)->getContext()->phys;
+	}
+	unsigned long long host_currentTime(void *ctx){
+		return phys(ctx).getCTime();
+	}
+	unsigned long long host_generateEventID(void *ctx){
+		return ((Nestene*)ctx)->generateEventID();
+	}
+	double host_getTimeResolution(void *ctx){
+		return phys(ctx).getTimeRes();
+	}
+	int host_getMacroFactor(void *ctx){
+		return phys(ctx).getMacroFactor();
+	}
+	double host_getMersenneFloat(void *ctx, double low, double high){
+		return phys(ctx).getMersenneFloat(low, high);
+	}
+	unsigned long long host_speedOfSound(void *ctx, double x, double y,
+			double originX, double originY, double propagationSpeed){
+		return phys(ctx).speedOfSound(x, y, originX, originY, propagationSpeed);
+	}
+	void host_debug(void * /*ctx*/, const char *msg){
+		Output::Inst()->kprintf("%s", msg);
+	}
+}
+
+	AutonPlugin::AutonPlugin(int ID, double posX, double posY, double posZ,
+		Nestene *nestene, AutonPluginGroup *group, int index)
+: Auton(ID, posX, posY, posZ, nestene, PLUGIN), group(group), index(index)
+{
+	desc = "Native";
+}
+
+EventQueue::eEvent* AutonPlugin::actOnEvent(EventQueue::iEvent *event){
+	group->queueInternal(event);
+	return NULL;
+}
+
+	AutonPluginGroup::AutonPluginGroup()
+:plugin(NULL), disabled(false)
+{
+	host.ctx = NULL;
+	host.currentTime = host_currentTime;
+	host.generateEventID = host_generateEventID;
+	host.getTimeResolution = host_getTimeResolution;
+	host.getMacroFactor = host_getMacroFactor;
+	host.getMersenneFloat = host_getMersenneFloat;
+	host.speedOfSound = host_speedOfSound;
+	host.debug = host_debug;
+}
+
+/**
+ * Load a plugin.
+ * Opens the shared object and validates its ABI version, libraries are 
+ * only opened once and stay loaded for the lifetime of the process.
+ * @param filename path of the shared object.
+ * @return the plugin function table, or NULL if it could not be loaded.
+ */
+const rana_plugin* AutonPluginGroup::load(std::string filename){
+	static std::map<std::string, const rana_plugin*> plugins;
+
+	std::map<std::string, const rana_plugin*>::iterator it = plugins.find(filename);
+	if(it != plugins.end())
+		return it->second;
+
+	const rana_plugin *plugin = NULL;
+	void *handle = dlopen(filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+	if(handle == NULL){
+		Output::Inst()->kprintf("error loading plugin: %s\n", dlerror());
+	} else{
+		rana_plugin_entry_fn entry = 
+			(rana_plugin_entry_fn)dlsym(handle, RANA_PLUGIN_ENTRY);
+		if(entry == NULL){
+			Output::Inst()->kprintf("error loading plugin, no %s in %s\n",
+					RANA_PLUGIN_ENTRY, filename.c_str());
+		} else{
+			plugin = entry();
+			if(plugin == NULL || plugin->abiVersion != RANA_PLUGIN_ABI_VERSION){
+				Output::Inst()->kprintf("error loading plugin %s, ABI version %d expected\n",
+						filename.c_str(), RANA_PLUGIN_ABI_VERSION);
+				plugin = NULL;
+			} else
+				Output::Inst()->kprintf("Loaded native plugin '%s'\n", plugin->name);
+		}
+	}
+	plugins[filename] = plugin;
+	return plugin;
+}
+
+/**
+ * Add a native auton to the group.
+ * Must be done for all autons before AutonPluginGroup::init().
+ */
+void AutonPluginGroup::addAuton(int ID, double posX, double posY, Nestene *nestene){
+	host.ctx = nestene;
+	AutonPlugin auton(ID, posX, posY, 1, nestene, this, autons.size());
+	autons.push_back(auton);
+
+	rana_auton a;
+	a.id = ID;
+	a.posX = posX;
+	a.posY = posY;
+	a.data = NULL;
+	batch.push_back(a);
+}
+
+/**
+ * Initialize the group.
+ * Loads the plugin and calls its init function with the batch of autons.
+ * @param filename path of the plugins shared object.
+ */
+void AutonPluginGroup::init(std::string filename){
+	if(autons.empty())
+		return;
+
+	plugin = load(filename);
+	if(plugin == NULL || plugin->init(&host, &batch[0], batch.size()) < 0){
+		disabled = true;
+		Output::Inst()->kprintf("Native Autons disabled\n");
+		return;
+	}
+	responses.resize(batch.size());
+	syncPositions();
+}
+
+bool AutonPluginGroup::empty(){
+	return autons.empty();
+}
+
+/**
+ * Copy the positions set by the plugin to the auton proxies.
+ */
+void AutonPluginGroup::syncPositions(){
+	for(unsigned int i = 0; i < autons.size(); i++){
+		autons[i].posX = batch[i].posX;
+		autons[i].posY = batch[i].posY;
+	}
+}
+
+void AutonPluginGroup::fillEvent(rana_event &ev, EventQueue::eEvent *event){
+	ev.id = event->id;
+	ev.originID = event->origin->getID();
+	ev.originX = event->origin->getPosX();
+	ev.originY = event->origin->getPosY();
+	ev.propagationSpeed = event->propagationSpeed;
+	ev.duration = event->duration;
+	ev.activationTime = event->activationTime;
+	ev.desc = event->desc.c_str();
+	ev.table = event->table.c_str();
+}
+
+/**
+ * Make an external event from a plugin response.
+ * @return the event, or NULL if the response is invalid.
+ */
+EventQueue::eEvent* AutonPluginGroup::makeEEvent(rana_response &response){
+	if(response.auton < 0 || response.auton >= (int)autons.size()){
+		Output::Inst()->kprintf("Native auton response has an invalid auton index\n");
+		return NULL;
+	}
+	unsigned long long activationTime = response.activationTime + 1;
+	if(activationTime < phys(host.ctx).getCTime()){
+		Output::Inst()->kprintf("Activation TMU must be > than current TMU, returning NULL\n");
+		return NULL;
+	}
+	EventQueue::eEvent *event = new EventQueue::eEvent();
+	event->origin = &autons[response.auton];
+	event->id = response.id;
+	event->activationTime = activationTime;
+	event->duration = response.duration;
+	event->propagationSpeed = response.propagationSpeed;
+	event->desc = std::string(response.desc, strnlen(response.desc, RANA_DESC_SIZE));
+	event->table = std::string(response.table, strnlen(response.table, RANA_TABLE_SIZE));
+	event->posX = batch[response.auton].posX;
+	event->posY = batch[response.auton].posY;
+	return event;
+}
+
+/**
+ * Query the native autons on whether they will initiate an event.
+ * @param events list the initiated external events are appended to.
+ */
+void AutonPluginGroup::initEvents(std::list<EventQueue::eEvent*> &events){
+	if(disabled || autons.empty())
+		return;
+
+	int n = plugin->initiate(&host, &batch[0], batch.size(), &responses[0]);
+	syncPositions();
+
+	for(int i = 0; i < n && i < (int)responses.size(); i++){
+		EventQueue::eEvent *event = makeEEvent(responses[i]);
+		if(event != NULL)
+			events.push_back(event);
+	}
+}
+
+/**
+ * Deliver an external event to the native autons.
+ * @param event the external event.
+ * @param ievents list the resulting internal events are appended to.
+ */
+void AutonPluginGroup::handleEvent(EventQueue::eEvent *event, 
+		std::list<EventQueue::iEvent*> &ievents){
+	if(disabled || autons.empty())
+		return;
+
+	rana_event ev;
+	fillEvent(ev, event);
+
+	int n = plugin->handleExternal(&host, &batch[0], batch.size(), &ev, &responses[0]);
+
+	for(int i = 0; i < n && i < (int)responses.size(); i++){
+		rana_response &r = responses[i];
+		if(r.auton < 0 || r.auton >= (int)autons.size() || batch[r.auton].id == ev.originID)
+			continue;
+		//an event in the past would be queued but never handled:
+		if(r.activationTime < phys(host.ctx).getCTime()){
+			Output::Inst()->kprintf("Activation TMU must be > than current TMU, returning NULL\n");
+			continue;
+		}
+
+		EventQueue::iEvent *ievent = new EventQueue::iEvent();
+		ievent->origin = &autons[r.auton];
+		ievent->event = event;
+		ievent->id = r.id;
+		ievent->activationTime = r.activationTime;
+		ievent->desc = std::string(r.desc, strnlen(r.desc, RANA_DESC_SIZE));
+		ievents.push_back(ievent);
+	}
+}
+
+void AutonPluginGroup::queueInternal(EventQueue::iEvent *event){
+	if(!disabled)
+		inbox.push_back(event);
+}
+
+/**
+ * Handle the queued internal events.
+ * Called from the Nestene end phase, delivers all internal events due 
+ * in this microstep to the plugin in one call.
+ * @param events list the resulting external events are appended to.
+ */
+void AutonPluginGroup::actOnEvents(std::list<EventQueue::eEvent*> &events){
+	if(inbox.empty())
+		return;
+
+	ievents.resize(inbox.size());
+	for(unsigned int i = 0; i < inbox.size(); i++){
+		EventQueue::iEvent *ievent = inbox[i];
+		rana_ievent &ie = ievents[i];
+		ie.auton = static_cast<AutonPlugin*>(ievent->origin)->index;
+		ie.id = ievent->id;
+		ie.activationTime = ievent->activationTime;
+		ie.desc = ievent->desc.c_str();
+		fillEvent(ie.cause, ievent->event);
+	}
+	if(responses.size() < inbox.size())
+		responses.resize(inbox.size());
+
+	int n = plugin->handleInternal(&host, &batch[0], batch.size(), 
+			&ievents[0], ievents.size(), &responses[0]);
+
+	for(int i = 0; i < n && i < (int)responses.size(); i++){
+		EventQueue::eEvent *event = makeEEvent(responses[i]);
+		if(event != NULL)
+			events.push_back(event);
+	}
+	inbox.clear();
+}
+
+void AutonPluginGroup::simDone(){
+	if(disabled || autons.empty())
+		return;
+
+	plugin->done(&host, &batch[0], batch.size());
+}
+
+void AutonPluginGroup::retrievePositions(std::vector<double> &xs, std::vector<double> &ys){
+	for(unsigned int i = 0; i < autons.size(); i++){
+		xs.push_back(autons[i].getPosX());
+		ys.push_back(autons[i].getPosY());
+	}
+}
@@ -0,0 +1,100 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef AUTONPLUGIN_H
+#define AUTONPLUGIN_H
+
+#include <vector>
+#include <list>
+#include <string>
+
+#include "auton.h"
+#include "ranaplugin.h"
+
+class Nestene;
+class AutonPluginGroup;
+
+/**
+ * Proxy for a native auton.
+ * The behaviour of native autons is implemented by a plugin, see
+ * ranaplugin.h, this class gives them an identity within the engine so
+ * they can be the origin of events like any other auton.
+ */
+class AutonPlugin : public Auton
+{
+	public:
+		AutonPlugin(int ID, double posX, double posY, double posZ, 
+				Nestene *nestene, AutonPluginGroup *group, int index);
+
+	private:
+		//internal events are queued in the group and handled in one batch:
+		EventQueue::eEvent* actOnEvent(EventQueue::iEvent *event);
+
+		AutonPluginGroup *group;
+		int index;
+
+		friend class AutonPluginGroup;
+		friend class Nestene;
+		friend class Auton;
+};
+
+/**
+ * The native autons of a Nestene.
+ * Keeps the autons of a Nestene in a contiguous batch, and translates 
+ * between the engine events and the plugin interface.
+ */
+class AutonPluginGroup
+{
+	public:
+		AutonPluginGroup();
+
+		void addAuton(int ID, double posX, double posY, Nestene *nestene);
+		void init(std::string filename);
+		bool empty();
+
+		void initEvents(std::list<EventQueue::eEvent*> &events);
+		void handleEvent(EventQueue::eEvent *event, std::list<EventQueue::iEvent*> &ievents);
+		void queueInternal(EventQueue::iEvent *event);
+		void actOnEvents(std::list<EventQueue::eEvent*> &events);
+		void simDone();
+
+		void retrievePositions(std::vector<double> &xs, std::vector<double> &ys);
+
+	private:
+		static const rana_plugin* load(std::string filename);
+		EventQueue::eEvent* makeEEvent(rana_response &response);
+		void syncPositions();
+		void fillEvent(rana_event &ev, EventQueue::eEvent *event);
+
+		const rana_plugin *plugin;
+		bool disabled;
+		//host functions, with the Nestene as context:
+		rana_host host;
+
+		std::vector<AutonPlugin> autons;
+		std::vector<rana_auton> batch;
+		std::vector<rana_response> responses;
+		//internal events waiting for the end phase:
+		std::vector<EventQueue::iEvent*> inbox;
+		std::vector<rana_ievent> ievents;
+};
+
+#endif // AUTONPLUGIN_H
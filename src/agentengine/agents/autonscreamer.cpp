@@ -24,23 +24,18 @@
 #include <stdlib.h>
 #include <time.h>
 
-#include "ID.h"
+#include "nestene.h"
 #include "autonscreamer.h"
 #include "output.h"
 
 AutonScreamer::AutonScreamer(int ID, double posX, double posY, double posZ, Nestene *nestene)
-    : Auton(ID, posX, posY, posZ, nestene){
+    : Auton(ID, posX, posY, posZ, nestene, SCREAMER){
 
     desc = "screamer";
     //Output::Inst()->kprintf("Screamer Auton: %i, posX: %f, posY: %f \n", ID,posX,posY);
 }
 
 
-EventQueue::iEvent *AutonScreamer::handleEvent(EventQueue::eEvent *event){
-    return NULL;
-}
-
-
 EventQueue::eEvent *AutonScreamer::initEvent(double macroResolution, unsigned long long tmu ){
 	double random = (double)rand() /  double(RAND_MAX);
 	
@@ -48,7 +43,7 @@ EventQueue::eEvent *AutonScreamer::initEvent(double macroResolution, unsigned lo
 		EventQueue::eEvent *event = new EventQueue::eEvent();
 		event->desc = "callEvent";
 		event->duration = 5;
-		event->id = ID::generateEventID();
+		event->id = nestene->generateEventID();
 		event->activationTime = tmu+1;
 		event->origin = this;
 		//Output::Inst()->kprintf("auton starts event at time %lld \n",tmu);
@@ -32,15 +32,13 @@ public:
     AutonScreamer(int ID, double posX, double posY, double posZ, Nestene *nestene);
 
 private:
-    //function to receive an event from nestene responsible for this auton, returns an internal Event 'thinking':
-    EventQueue::iEvent* handleEvent(EventQueue::eEvent* event);
-
     //returns an event:
     EventQueue::eEvent* initEvent(double macroResolution, unsigned long long tmu);
 
     double eventChance();
 
     friend class Nestene;
+    friend class Auton;
 
 };
 
@@ -19,8 +19,303 @@
 //along with RANA.  If not, see <http://www.gnu.org/licenses/>.
 //
 //--end_license--
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <cmath>
+
 #include "doctor.h"
+#include "memaccount.h"
+#include "luawatchdog.h"
+#include "output.h"
+
+bool Doctor::enabled = false;
+unsigned long long Doctor::every = 100;
+double Doctor::limits[FLAG_AMOUNT];
+unsigned long long Doctor::stallLimit = 0;
+Doctor::Action Doctor::action = Doctor::WARN;
+int Doctor::pause = 100;
+unsigned int Doctor::trend = 10;
+
+namespace {
+	std::string format(const char *format, ...){
+		char buffer[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+		return buffer;
+	}
+
+	//parse a whole value as a number from 0 to max:
+	bool parseValue(const std::string &value, unsigned long long max,
+			unsigned long long &number){
+		if(value.empty() || value[0] < '0' || value[0] > '9')
+			return false;
+		char *end;
+		errno = 0;
+		number = strtoull(value.c_str(), &end, 10);
+		return errno == 0 && *end == '\0' && number <= max;
+	}
 
-Doctor::Doctor()
+	//parse a whole value as a limit, 0 or a positive finite number:
+	bool parseLimit(const std::string &value, double &limit){
+		if(value.empty() || ((value[0] < '0' || value[0] > '9') && value[0] != '.'))
+			return false;
+		char *end;
+		errno = 0;
+		limit = strtod(value.c_str(), &end);
+		return errno == 0 && *end == '\0' && std::isfinite(limit);
+	}
+}
+
+	Doctor::Doctor()
+:callbacks(0), errors(0), slowestNs(0), slowestAuton(-1), timeResolution(0),
+	macroSteps(0), aborted(false), samples(0)
 {
+	beginRun(0, 0, 0);
+}
+
+const char* Doctor::name(int flag){
+	static const char *names[FLAG_AMOUNT] =
+		{"storm", "queue", "memory", "stall", "ratio", "errors"};
+	if(flag < 0 || flag >= FLAG_AMOUNT)
+		return "unknown";
+	return names[flag];
+}
+
+/**
+ * Configure and enable the Doctor.
+ * @param spec terms separated by ';', @see Doctor.
+ * @return false if a term is invalid, nothing is changed then and the
+ * Doctor stays disabled.
+ */
+bool Doctor::configure(std::string spec){
+	double newLimits[FLAG_AMOUNT];
+	for(int i = 0; i < FLAG_AMOUNT; i++)
+		newLimits[i] = limits[i];
+	unsigned long long newEvery = every, newPause = pause, newTrend = trend;
+	Action newAction = action;
+
+	std::stringstream stream(spec);
+	std::string term;
+	while(std::getline(stream, term, ';')){
+		if(term.empty())
+			continue;
+		size_t eq = term.find('=');
+		if(eq == std::string::npos)
+			return false;
+		std::string key = term.substr(0, eq);
+		std::string value = term.substr(eq+1);
+		int flag = 0;
+		while(flag < FLAG_AMOUNT && key.compare(name(flag)) != 0)
+			flag++;
+		if(flag < FLAG_AMOUNT){
+			if(!parseLimit(value, newLimits[flag]))
+				return false;
+		}else if(key.compare("every") == 0){
+			if(!parseValue(value, ULLONG_MAX, newEvery) || newEvery == 0)
+				return false;
+		}else if(key.compare("action") == 0){
+			if(value.compare("warn") == 0)
+				newAction = WARN;
+			else if(value.compare("throttle") == 0)
+				newAction = THROTTLE;
+			else if(value.compare("abort") == 0)
+				newAction = ABORT;
+			else
+				return false;
+		}else if(key.compare("pause") == 0){
+			if(!parseValue(value, INT_MAX, newPause))
+				return false;
+		}else if(key.compare("trend") == 0){
+			if(!parseValue(value, UINT_MAX, newTrend))
+				return false;
+		}else
+			return false;
+	}
+
+	for(int i = 0; i < FLAG_AMOUNT; i++)
+		limits[i] = newLimits[i];
+	every = newEvery;
+	action = newAction;
+	pause = newPause;
+	trend = newTrend;
+	stallLimit = limits[STALL] * 1e6;
+	enabled = true;
+	return true;
+}
+
+/**
+ * Start monitoring a run.
+ * @param timeResolution seconds pr. tmu.
+ * @param events total number of events before the run.
+ * @param queued events in the queue.
+ */
+void Doctor::beginRun(double timeResolution, unsigned long long events,
+		unsigned long long queued){
+	this->timeResolution = timeResolution;
+	macroSteps = 0;
+	aborted = false;
+	lastTime = clock::now();
+	throttled = clock::duration::zero();
+	lastTmu = 0;
+	lastEvents = events;
+	lastQueued = queued;
+	lastCallbacks = callbacks;
+	runCallbacks = callbacks;
+	peakCallRate = 0;
+	lastErrors = errors;
+	lastDisabled = LuaWatchdog::disabledAutons();
+	lastMemory = MemAccount::liveTotal();
+	slowestNs = 0;
+	for(int i = 0; i < FLAG_AMOUNT; i++){
+		flagged[i] = false;
+		flagAmount[i] = 0;
+	}
+	queueGrowth = 0;
+	memoryGrowth = 0;
+	samples = 0;
+}
+
+/**
+ * A macro step is done.
+ * Samples the engine every 'every' macro steps, and applies the action
+ * while a limit is exceeded.
+ * @param tmu the current tmu.
+ * @param events total number of events.
+ * @param queued events in the queue.
+ * @return false if the run should be aborted.
+ */
+bool Doctor::macroStep(unsigned long long tmu, unsigned long long events,
+		unsigned long long queued){
+	if(aborted)
+		return false;
+	if(++macroSteps % every == 0)
+		sample(tmu, events, queued);
+
+	bool exceeded = false;
+	for(int i = 0; i < FLAG_AMOUNT; i++)
+		exceeded |= flagged[i];
+	if(!exceeded || action == WARN)
+		return true;
+
+	if(action == THROTTLE){
+		//the pause is not the engine's time, it must not keep the ratio up:
+		clock::time_point start = clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(pause));
+		throttled += clock::now() - start;
+		return true;
+	}
+	Output::Inst()->kprintf("[doctor] tmu %llu: limit exceeded, aborting the run\n", tmu);
+	aborted = true;
+	return false;
+}
+
+void Doctor::sample(unsigned long long tmu, unsigned long long events,
+		unsigned long long queued){
+	clock::time_point now = clock::now();
+	if(tmu <= lastTmu)
+		return;
+	samples++;
+	unsigned long long tmus = tmu - lastTmu;
+	double simSeconds = tmus * timeResolution;
+	double wallSeconds = std::chrono::duration<double>(now - lastTime - throttled).count();
+	size_t memory = MemAccount::liveTotal();
+	double megabytes = memory / (1024.0 * 1024.0);
+
+	double eventsPerTmu = (double)(events - lastEvents) / tmus;
+	check(STORM, eventsPerTmu > limits[STORM], tmu,
+			format("event storm, %.2f events/tmu (limit %g)", eventsPerTmu, limits[STORM]));
+	check(QUEUE, queued > limits[QUEUE], tmu,
+			format("%llu events queued (limit %g)", queued, limits[QUEUE]));
+	check(MEMORY, megabytes > limits[MEMORY], tmu,
+			format("%.1f MB accounted memory (limit %g)", megabytes, limits[MEMORY]));
+	check(STALL, slowestNs > stallLimit, tmu,
+			format("stalled auton %i, a Lua callback took %.1f ms (limit %g)",
+				slowestAuton, slowestNs / 1e6, limits[STALL]));
+	if(simSeconds > 0){
+		double ratio = wallSeconds / simSeconds;
+		check(RATIO, ratio > limits[RATIO], tmu,
+				format("%.2f wall seconds pr. simulated second (limit %g)", ratio, limits[RATIO]));
+	}
+	unsigned long long newCallbacks = callbacks - lastCallbacks;
+	if(simSeconds > 0)
+		peakCallRate = std::max(peakCallRate, newCallbacks / simSeconds);
+	unsigned long long newErrors = errors - lastErrors;
+	check(ERRORS, newErrors > limits[ERRORS], tmu,
+			format("%llu Lua errors in %llu callbacks (limit %g)", newErrors,
+				newCallbacks, limits[ERRORS]));
+
+	unsigned long long disabled = LuaWatchdog::disabledAutons();
+	if(disabled > lastDisabled)
+		Output::Inst()->kprintf("[doctor] tmu %llu: %llu autons disabled by the instruction budget\n",
+				tmu, disabled - lastDisabled);
+
+	//growth without limits, the queue in events pr. simulated second:
+	double queueRate = simSeconds > 0 ? ((double)queued - lastQueued) / simSeconds : 0;
+	trendWarning(queueGrowth, queued > lastQueued, tmu,
+			format("event queue growing, %.0f events pr. simulated second", queueRate).c_str());
+	trendWarning(memoryGrowth, memory > lastMemory, tmu,
+			format("memory growing, %.1f MB accounted", megabytes).c_str());
+
+	lastTime = now;
+	throttled = clock::duration::zero();
+	lastTmu = tmu;
+	lastEvents = events;
+	lastQueued = queued;
+	lastCallbacks = callbacks;
+	lastErrors = errors;
+	lastDisabled = disabled;
+	lastMemory = memory;
+	slowestNs = 0;
+}
+
+/**
+ * Flag a value when it exceeds its limit, and when it is back under it.
+ */
+void Doctor::check(Flag flag, bool exceeded, unsigned long long tmu, const std::string &message){
+	if(limits[flag] <= 0)
+		return;
+	if(exceeded && !flagged[flag]){
+		flagAmount[flag]++;
+		Output::Inst()->kprintf("[doctor] tmu %llu: %s\n", tmu, message.c_str());
+	}else if(!exceeded && flagged[flag])
+		Output::Inst()->kprintf("[doctor] tmu %llu: %s back under its limit\n", tmu, name(flag));
+	flagged[flag] = exceeded;
+}
+
+/**
+ * Warn once when a value has grown for 'trend' samples in a row.
+ */
+void Doctor::trendWarning(unsigned int &samples, bool growing, unsigned long long tmu,
+		const char *what){
+	samples = growing ? samples + 1 : 0;
+	if(trend > 0 && samples == trend)
+		Output::Inst()->kprintf("[doctor] tmu %llu: %s, for %u samples\n", tmu, what, trend);
+}
+
+/**
+ * Print the Lua call rates and the flags raised during the run.
+ */
+void Doctor::report(){
+	if(!enabled)
+		return;
+	std::string flags;
+	for(int i = 0; i < FLAG_AMOUNT; i++){
+		if(limits[i] > 0)
+			flags += format("%s %s %llu", flags.empty() ? "" : ",", name(i), flagAmount[i]);
+	}
+	unsigned long long runCalls = callbacks - runCallbacks;
+	double simSeconds = lastTmu * timeResolution;
+	Output::Inst()->kprintf("Doctor: %llu samples, %llu Lua callbacks, %.1f pr. sample, "
+			"%.1f pr. simulated second (peak %.1f), flags:%s%s\n", samples, runCalls,
+			samples > 0 ? (double)runCalls / samples : 0.0,
+			simSeconds > 0 ? runCalls / simSeconds : 0.0, peakCallRate,
+			flags.empty() ? " no limits" : flags.c_str(), aborted ? ", run aborted" : "");
 }
@@ -22,10 +22,125 @@
 #ifndef DOCTOR_H
 #define DOCTOR_H
 
+#include <string>
+#include <chrono>
+
+/**
+ * Health monitor of a simulation run.
+ * Every 'every' macro steps the Doctor samples the engine: events pr. tmu,
+ * the growth of the event queue, Lua callbacks and errors, the slowest Lua
+ * callback, wall seconds pr. simulated second and the accounted memory.
+ * Autons disabled by the instruction budget are logged, and the Lua call
+ * rates are reported after the run.
+ * A value over its limit is flagged when it crosses it, and handled by the
+ * action:
+ * warn		only flag it.
+ * throttle	pause the simulation thread 'pause' ms every macro step while
+ * 			a limit is exceeded, slowing down the growth of the queue, the
+ * 			memory and the streamed data, while the run can be inspected.
+ * abort	stop the run, as F6 would, the data so far is kept.
+ * The queue or the memory growing over 'trend' samples in a row is
+ * flagged as a warning, without limits.
+ *
+ * Configured with "every=N;storm=E;queue=N;memory=MB;stall=ms;ratio=R;
+ * errors=N;action=warn|throttle|abort;pause=ms;trend=N", a limit of 0 is
+ * not checked. Every simulation has a Doctor in its SimContext, and it
+ * runs on the simulation thread.
+ */
 class Doctor
 {
-public:
-    Doctor();
+	public:
+		enum Flag{
+			STORM = 0,	//events pr. tmu
+			QUEUE,		//queued events
+			MEMORY,		//accounted memory
+			STALL,		//slowest Lua callback
+			RATIO,		//wall seconds pr. simulated second
+			ERRORS,		//Lua errors pr. sample
+			FLAG_AMOUNT
+		};
+		enum Action{
+			WARN = 0,
+			THROTTLE,
+			ABORT
+		};
+
+		static bool configure(std::string spec);
+		static bool isEnabled(){ return enabled; }
+
+		//counted by AutonLUA:
+		static bool timesCallbacks(){ return enabled && stallLimit > 0; }
+		void luaCallback(bool failed){
+			if(enabled){
+				callbacks++;
+				if(failed)
+					errors++;
+			}
+		}
+		void callbackTime(int autonID, unsigned long long ns){
+			if(ns > slowestNs){
+				slowestNs = ns;
+				slowestAuton = autonID;
+			}
+		}
+
+		Doctor();
+
+		void beginRun(double timeResolution, unsigned long long events,
+				unsigned long long queued);
+		bool macroStep(unsigned long long tmu, unsigned long long events,
+				unsigned long long queued);
+		void report();
+
+		static const char* name(int flag);
+
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		void sample(unsigned long long tmu, unsigned long long events,
+				unsigned long long queued);
+		void check(Flag flag, bool exceeded, unsigned long long tmu,
+				const std::string &message);
+		void trendWarning(unsigned int &samples, bool growing, unsigned long long tmu,
+				const char *what);
+
+		static bool enabled;
+		static unsigned long long every;
+		static double limits[FLAG_AMOUNT];
+		static unsigned long long stallLimit; //[ns]
+		static Action action;
+		static int pause; //[ms]
+		static unsigned int trend;
+
+		//Lua callbacks of this simulation:
+		unsigned long long callbacks;
+		unsigned long long errors;
+		unsigned long long slowestNs;
+		int slowestAuton;
+
+		double timeResolution;
+		unsigned long long macroSteps;
+		bool aborted;
+
+		//state at the last sample, and the time throttled since:
+		clock::time_point lastTime;
+		clock::duration throttled;
+		unsigned long long lastTmu;
+		unsigned long long lastEvents;
+		unsigned long long lastQueued;
+		unsigned long long lastCallbacks;
+		//callbacks at the start of the run, and the highest rate of a sample:
+		unsigned long long runCallbacks;
+		double peakCallRate;
+		unsigned long long lastErrors;
+		unsigned long long lastDisabled;
+		size_t lastMemory;
+
+		bool flagged[FLAG_AMOUNT];
+		unsigned long long flagAmount[FLAG_AMOUNT];
+		unsigned int queueGrowth;
+		unsigned int memoryGrowth;
+		unsigned long long samples;
 };
 
 #endif // DOCTOR_H
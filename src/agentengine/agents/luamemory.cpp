@@ -0,0 +1,306 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <sstream>
+#include <vector>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include "lua.hpp"
+
+#include "luamemory.h"
+#include "memaccount.h"
+#include "output.h"
+
+size_t LuaMemory::cap = 0;
+LuaMemory::GCMode LuaMemory::mode = LuaMemory::INCREMENTAL;
+int LuaMemory::pause = 0;
+int LuaMemory::stepMultiplier = 0;
+int LuaMemory::stepSize = 0;
+unsigned int LuaMemory::run = 1;
+std::atomic<unsigned long long> LuaMemory::refused(0);
+std::atomic<unsigned long long> LuaMemory::refusingStates(0);
+
+namespace {
+	const size_t CLASS_AMOUNT = LuaMemory::SMALL_LIMIT / LuaMemory::GRANULE;
+
+	//a free block, linked through its first bytes:
+	struct Block{
+		Block *next;
+	};
+
+	/**
+	 * Size class free lists, carved from chunks which are never returned.
+	 * A block may be freed by another thread than the one allocating it,
+	 * it then goes to the free list of that thread.
+	 */
+	struct Arena{
+		Block *freeLists[CLASS_AMOUNT];
+		char *position;
+		char *end;
+
+		Arena():position(NULL), end(NULL){
+			for(size_t i = 0; i < CLASS_AMOUNT; i++)
+				freeLists[i] = NULL;
+		}
+	};
+
+	std::mutex orphanMutex;
+	std::vector<Arena*> orphans;
+
+	//hands the arena of a thread to the orphans when the thread exits:
+	struct ArenaHandle{
+		Arena *arena;
+		ArenaHandle():arena(NULL){}
+		~ArenaHandle(){
+			if(arena != NULL){
+				std::lock_guard<std::mutex> lock(orphanMutex);
+				orphans.push_back(arena);
+			}
+		}
+	};
+
+	Arena* threadArena(){
+		static thread_local ArenaHandle handle;
+		if(handle.arena == NULL){
+			std::lock_guard<std::mutex> lock(orphanMutex);
+			if(!orphans.empty()){
+				handle.arena = orphans.back();
+				orphans.pop_back();
+			}else
+				handle.arena = new Arena();
+		}
+		return handle.arena;
+	}
+
+	size_t sizeClass(size_t size){
+		return (size - 1) / LuaMemory::GRANULE;
+	}
+
+	//parse a whole value as a number from 0 to max:
+	bool parseValue(const std::string &value, unsigned long long max,
+			unsigned long long &number){
+		if(value.empty() || value[0] < '0' || value[0] > '9')
+			return false;
+		char *end;
+		errno = 0;
+		number = strtoull(value.c_str(), &end, 10);
+		return errno == 0 && *end == '\0' && number <= max;
+	}
+}
+
+/**
+ * Configure the allocator and the collector of the Lua states.
+ * @param spec terms separated by ';', @see LuaMemory.
+ * @return false if a term is invalid, nothing is changed then.
+ */
+bool LuaMemory::configure(std::string spec){
+	size_t newCap = cap;
+	GCMode newMode = mode;
+	unsigned long long newPause = pause, newStepMultiplier = stepMultiplier;
+	unsigned long long newStepSize = stepSize, kilobytes;
+
+	std::stringstream stream(spec);
+	std::string term;
+	while(std::getline(stream, term, ';')){
+		if(term.empty())
+			continue;
+		size_t eq = term.find('=');
+		if(eq == std::string::npos)
+			return false;
+		std::string key = term.substr(0, eq);
+		std::string value = term.substr(eq+1);
+		if(key.compare("cap") == 0){
+			if(!parseValue(value, SIZE_MAX / 1024, kilobytes))
+				return false;
+			newCap = kilobytes * 1024;
+		}else if(key.compare("gc") == 0){
+			if(value.compare("incremental") == 0)
+				newMode = INCREMENTAL;
+			else if(value.compare("generational") == 0)
+				newMode = GENERATIONAL;
+			else if(value.compare("macro") == 0)
+				newMode = MACRO;
+			else
+				return false;
+		}else if(key.compare("pause") == 0){
+			if(!parseValue(value, INT_MAX, newPause))
+				return false;
+		}else if(key.compare("stepmul") == 0){
+			if(!parseValue(value, INT_MAX, newStepMultiplier))
+				return false;
+		}else if(key.compare("step") == 0){
+			if(!parseValue(value, INT_MAX, newStepSize))
+				return false;
+		}else
+			return false;
+	}
+
+	cap = newCap;
+	mode = newMode;
+	pause = newPause;
+	stepMultiplier = newStepMultiplier;
+	stepSize = newStepSize;
+	return true;
+}
+
+void* LuaMemory::allocate(size_t size){
+	if(size > SMALL_LIMIT)
+		return malloc(size);
+
+	Arena *arena = threadArena();
+	size_t index = sizeClass(size);
+	Block *block = arena->freeLists[index];
+	if(block != NULL){
+		arena->freeLists[index] = block->next;
+		return block;
+	}
+	size_t blockSize = (index + 1) * GRANULE;
+	if(arena->position == NULL || arena->position + blockSize > arena->end){
+		//the rest of the old chunk is lost, it is less than a block:
+		arena->position = static_cast<char*>(malloc(CHUNK_SIZE));
+		if(arena->position == NULL)
+			return NULL;
+		arena->end = arena->position + CHUNK_SIZE;
+	}
+	void *ptr = arena->position;
+	arena->position += blockSize;
+	return ptr;
+}
+
+void LuaMemory::release(void *ptr, size_t size){
+	if(size > SMALL_LIMIT){
+		free(ptr);
+		return;
+	}
+	Arena *arena = threadArena();
+	Block *block = static_cast<Block*>(ptr);
+	size_t index = sizeClass(size);
+	block->next = arena->freeLists[index];
+	arena->freeLists[index] = block;
+}
+
+/**
+ * The lua_Alloc of every Lua state.
+ * @param ud the State of the Lua state.
+ * @see lua_Alloc in the Lua manual, osize is the type of a new block when
+ * ptr is NULL.
+ */
+void* LuaMemory::alloc(void *ud, void *ptr, size_t osize, size_t nsize){
+	State *state = static_cast<State*>(ud);
+	if(ptr == NULL)
+		osize = 0;
+
+	if(nsize == 0){
+		if(ptr != NULL)
+			release(ptr, osize);
+		MemAccount::freed(MemAccount::LUA, osize);
+		state->bytes -= osize;
+		return NULL;
+	}
+	if(cap > 0 && state->limited && nsize > osize && state->bytes + (nsize - osize) > cap){
+		if(state->refusedRun != run){
+			state->refusedRun = run;
+			refusingStates.fetch_add(1, std::memory_order_relaxed);
+		}
+		refused.fetch_add(1, std::memory_order_relaxed);
+		return NULL;
+	}
+
+	void *block;
+	if(ptr != NULL && osize > SMALL_LIMIT && nsize > SMALL_LIMIT)
+		block = realloc(ptr, nsize);
+	else if(ptr != NULL && osize <= SMALL_LIMIT && nsize <= SMALL_LIMIT
+			&& sizeClass(osize) == sizeClass(nsize))
+		block = ptr;
+	else{
+		block = allocate(nsize);
+		if(block != NULL && ptr != NULL){
+			memcpy(block, ptr, osize < nsize ? osize : nsize);
+			release(ptr, osize);
+		}
+	}
+	if(block == NULL)
+		return NULL;
+
+	if(ptr == NULL)
+		MemAccount::allocated(MemAccount::LUA, nsize);
+	else
+		MemAccount::resized(MemAccount::LUA, osize, nsize);
+	state->bytes += nsize - osize;
+	if(state->bytes > state->peak){
+		state->peak = state->bytes;
+		MemAccount::luaStatePeak(state->peak);
+	}
+	return block;
+}
+
+/**
+ * Set up the collector of a new Lua state.
+ */
+void LuaMemory::setup(lua_State *L){
+	switch(mode){
+		case GENERATIONAL:
+#ifdef LUA_GCGEN
+			lua_gc(L, LUA_GCGEN, 0);
+#endif
+			break;
+		case MACRO:
+			lua_gc(L, LUA_GCSTOP, 0);
+			break;
+		default:
+			break;
+	}
+	if(pause > 0)
+		lua_gc(L, LUA_GCSETPAUSE, pause);
+	if(stepMultiplier > 0)
+		lua_gc(L, LUA_GCSETSTEPMUL, stepMultiplier);
+}
+
+/**
+ * Collect garbage between two macro steps, when the collector is stopped.
+ */
+void LuaMemory::collect(lua_State *L){
+	if(mode == MACRO)
+		lua_gc(L, LUA_GCSTEP, stepSize);
+}
+
+void LuaMemory::beginRun(){
+	run++;
+	refused.store(0, std::memory_order_relaxed);
+	refusingStates.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Print the allocations refused by the cap during the run, if any.
+ */
+void LuaMemory::report(){
+	unsigned long long amount = refused.load(std::memory_order_relaxed);
+	if(amount == 0)
+		return;
+	Output::Inst()->kprintf("Lua memory cap of %llu[KB] refused %llu allocations, "
+			"in %llu autons\n", (unsigned long long)cap / 1024, amount,
+			refusingStates.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,102 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef LUAMEMORY_H
+#define LUAMEMORY_H
+
+#include <string>
+#include <atomic>
+#include <cstddef>
+
+struct lua_State;
+
+/**
+ * Memory governor of the Lua states.
+ * Every Lua state allocates through alloc(). Small blocks come from size
+ * class free lists in an arena of the allocating thread, so the churn of
+ * short strings and tables never reaches malloc. Larger blocks use
+ * realloc. Arenas of finished threads are adopted by new threads, and the
+ * memory of an arena is kept for the blocks of later states.
+ *
+ * Within a callback, an allocation that would bring a state over the cap
+ * fails, Lua then collects garbage and retries, and raises a memory error
+ * in the callback if that is not enough. The refused allocations are
+ * counted. Building the state is never refused.
+ *
+ * The garbage collector of every state is set up by setup():
+ * incremental	the default collector, paced by pause and stepmul.
+ * generational	the generational collector of Lua 5.2.
+ * macro		the collector is stopped, every state takes one step of
+ * 				'step' KB between the macro steps, see collect().
+ *
+ * Configured with "cap=KB;gc=mode;pause=N;stepmul=N;step=KB" before the
+ * states are created, pause and stepmul are percentages as in
+ * collectgarbage("setpause").
+ */
+class LuaMemory
+{
+	public:
+		enum GCMode{
+			INCREMENTAL = 0,
+			GENERATIONAL,
+			MACRO
+		};
+
+		//the allocator state of one Lua state:
+		struct State{
+			size_t bytes;
+			size_t peak;
+			//the last run an allocation of the state was refused:
+			unsigned int refusedRun;
+			//the cap applies, only set within protected calls, an
+			//allocation refused outside of them would abort the process:
+			bool limited;
+		};
+
+		static bool configure(std::string spec);
+		static bool collectsBetweenSteps(){ return mode == MACRO; }
+
+		static void* alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+		static void setup(lua_State *L);
+		static void collect(lua_State *L);
+		static void beginRun();
+		static void report();
+
+		static const size_t GRANULE = 16;
+		static const size_t SMALL_LIMIT = 512;
+		static const size_t CHUNK_SIZE = 256 * 1024;
+
+	private:
+		static void* allocate(size_t size);
+		static void release(void *ptr, size_t size);
+
+		static size_t cap;
+		static GCMode mode;
+		static int pause;
+		static int stepMultiplier;
+		static int stepSize;
+
+		static unsigned int run;
+		static std::atomic<unsigned long long> refused;
+		static std::atomic<unsigned long long> refusingStates;
+};
+
+#endif // LUAMEMORY_H
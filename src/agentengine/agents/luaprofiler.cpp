@@ -0,0 +1,334 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+
+#include "luaprofiler.h"
+#include "output.h"
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+
+LuaProfiler* LuaProfiler::profiler;
+bool LuaProfiler::enabled = false;
+
+/**
+ * Singleton accessor.
+ * Like Output::Inst() it is not threadsafe, the profiler is only used
+ * from the simulation thread.
+ */
+LuaProfiler* LuaProfiler::Inst(){
+	if(!profiler)
+		profiler = new LuaProfiler();
+
+	return profiler;
+}
+
+	LuaProfiler::LuaProfiler()
+:activeAuton(0)
+{
+}
+
+/**
+ * Enables the profiler.
+ * Must be called before the Lua autons are generated, as the
+ * hooks are attached when the Lua states are made.
+ * @see LuaWatchdog::attach()
+ * @param foldedFile filename for the folded stack output, or an empty
+ * string if no folded stack file should be written.
+ */
+void LuaProfiler::enable(std::string foldedFile){
+	enabled = true;
+	this->foldedFile = foldedFile;
+}
+
+/**
+ * Start timing a callback.
+ * Called by AutonLUA right before a lua_pcall.
+ * @param autonID ID of the auton making the call.
+ * @param callback name of the Lua function being called.
+ */
+void LuaProfiler::beginCallback(int autonID, const char *callback){
+	stack.clear();
+	activeAuton = autonID;
+
+	frame root;
+	root.name = callback;
+	root.childNs = 0;
+	root.start = clock::now();
+	stack.push_back(root);
+}
+
+/**
+ * Stop timing the active callback.
+ * Frames left on the stack by a Lua error are closed here.
+ */
+void LuaProfiler::endCallback(){
+	if(stack.empty())
+		return;
+
+	while(stack.size() > 1)
+		leaveFunction();
+
+	frame root = stack.back();
+	stack.clear();
+
+	unsigned long long elapsed =
+		duration_cast<nanoseconds>(clock::now() - root.start).count();
+	unsigned long long self = elapsed > root.childNs ? elapsed - root.childNs : 0;
+
+	addStat(callbackStats[root.name], elapsed, self);
+	addStat(autonStats[activeAuton], elapsed, self);
+	folded[root.name] += self;
+}
+
+/**
+ * Lua hook function.
+ * Called by Lua on every function call and return within a profiled state.
+ */
+void LuaProfiler::hook(lua_State *L, lua_Debug *ar){
+	LuaProfiler *p = LuaProfiler::Inst();
+	if(p->stack.empty())
+		return;
+
+	switch(ar->event){
+		case LUA_HOOKCALL:
+			p->enterFunction(L, ar);
+			break;
+		case LUA_HOOKTAILCALL:
+			//a tail call replaces the calling function's frame:
+			p->leaveFunction();
+			p->enterFunction(L, ar);
+			break;
+		case LUA_HOOKRET:
+			p->leaveFunction();
+			break;
+		default:
+			break;
+	}
+}
+
+void LuaProfiler::enterFunction(lua_State *L, lua_Debug *ar){
+	frame f;
+	f.name = functionName(L, ar);
+	f.childNs = 0;
+	f.start = clock::now();
+	stack.push_back(f);
+}
+
+void LuaProfiler::leaveFunction(){
+	//never pop the callback itself:
+	if(stack.size() <= 1)
+		return;
+
+	frame f = stack.back();
+	stack.pop_back();
+
+	unsigned long long elapsed =
+		duration_cast<nanoseconds>(clock::now() - f.start).count();
+	unsigned long long self = elapsed > f.childNs ? elapsed - f.childNs : 0;
+
+	addStat(functionStats[f.name], elapsed, self);
+	stack.back().childNs += elapsed;
+
+	std::string key;
+	for(unsigned int i = 0; i < stack.size(); i++){
+		key.append(stack[i].name);
+		key.append(";");
+	}
+	key.append(f.name);
+	folded[key] += self;
+}
+
+/**
+ * Resolve the name of the function being called.
+ * Functions reachable from the global table are named by their path,
+ * i.e 'func.soundIntensity.f1' or 'math.exp'. As all Lua autons run the
+ * same script, names are cached by source location, so the global table
+ * is only searched the first time a function is seen.
+ */
+std::string LuaProfiler::functionName(lua_State *L, lua_Debug *ar){
+	if(!lua_getinfo(L, "Snf", ar))
+		return "?";
+
+	int funcIndex = lua_gettop(L);
+	std::string key;
+	char buf[32];
+
+	if(ar->what[0] == 'C'){
+		snprintf(buf, sizeof(buf), "%p", lua_topointer(L, funcIndex));
+		key = std::string("C:") + buf;
+	} else if(ar->what[0] == 'm'){
+		lua_pop(L, 1);
+		return "main chunk";
+	} else{
+		snprintf(buf, sizeof(buf), ":%d", ar->linedefined);
+		key = std::string(ar->short_src) + buf;
+	}
+
+	std::unordered_map<std::string,std::string>::iterator it = nameCache.find(key);
+	if(it != nameCache.end()){
+		lua_pop(L, 1);
+		return it->second;
+	}
+
+	std::string name;
+	lua_checkstack(L, 10);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+	bool found = findGlobalName(L, funcIndex, lua_gettop(L), "", 0, name);
+	lua_pop(L, 2);
+
+	if(!found){
+		if(ar->what[0] == 'C')
+			name = ar->name != NULL ? std::string("[C] ") + ar->name : "[C]";
+		else
+			name = (ar->name != NULL ? std::string(ar->name) : "?") + "@" + key;
+	}
+	nameCache[key] = name;
+	return name;
+}
+
+/**
+ * Search a table, and the tables within it, for a function.
+ * @param funcIndex absolute stack index of the function.
+ * @param tableIndex absolute stack index of the table to search.
+ * @param prefix path of the table.
+ * @param depth current depth of the search.
+ * @param name set to the path of the function if found.
+ * @return true if the function was found.
+ */
+bool LuaProfiler::findGlobalName(lua_State *L, int funcIndex, int tableIndex,
+		std::string prefix, int depth, std::string &name){
+
+	lua_pushnil(L);
+	while(lua_next(L, tableIndex) != 0){
+		if(lua_type(L, -2) == LUA_TSTRING){
+			std::string key = lua_tostring(L, -2);
+
+			if(lua_rawequal(L, -1, funcIndex)){
+				name = prefix + key;
+				lua_pop(L, 2);
+				return true;
+			}
+			if(lua_istable(L, -1) && depth < 2 && key != "_G" && key != "package"){
+				if(findGlobalName(L, funcIndex, lua_gettop(L), prefix + key + ".",
+							depth + 1, name)){
+					lua_pop(L, 2);
+					return true;
+				}
+			}
+		}
+		lua_pop(L, 1);
+	}
+	return false;
+}
+
+void LuaProfiler::addStat(stat &s, unsigned long long totalNs, unsigned long long selfNs){
+	s.calls++;
+	s.totalNs += totalNs;
+	s.selfNs += selfNs;
+	if(totalNs > s.maxNs)
+		s.maxNs = totalNs;
+}
+
+namespace {
+	template <class K, class S>
+	bool byTotal(const std::pair<K,S> &a, const std::pair<K,S> &b){
+		return a.second.totalNs > b.second.totalNs;
+	}
+	template <class K, class S>
+	bool bySelf(const std::pair<K,S> &a, const std::pair<K,S> &b){
+		return a.second.selfNs > b.second.selfNs;
+	}
+}
+
+/**
+ * Print the profiling report.
+ * Prints the callbacks, the script functions sorted by self time and the
+ * most expensive autons, then writes the folded stack file if enabled.
+ * All collected data is cleared afterwards.
+ */
+void LuaProfiler::report(){
+	if(!enabled)
+		return;
+
+	Output::Inst()->kprintf("\n---- Lua profile: callbacks ----\n");
+	Output::Inst()->kprintf("%-22s %10s %12s %10s %10s\n",
+			"callback", "calls", "total[ms]", "mean[us]", "max[us]");
+
+	std::vector< std::pair<std::string, stat> > callbacks(callbackStats.begin(), callbackStats.end());
+	std::sort(callbacks.begin(), callbacks.end(), byTotal<std::string, stat>);
+	for(unsigned int i = 0; i < callbacks.size(); i++){
+		stat &s = callbacks[i].second;
+		Output::Inst()->kprintf("%-22s %10llu %12.2f %10.2f %10.2f\n",
+				callbacks[i].first.c_str(), s.calls, s.totalNs/1e6,
+				s.totalNs/1e3/s.calls, s.maxNs/1e3);
+	}
+
+	Output::Inst()->kprintf("---- Lua profile: functions (self time) ----\n");
+	Output::Inst()->kprintf("%-30s %10s %12s %12s\n",
+			"function", "calls", "self[ms]", "total[ms]");
+
+	std::vector< std::pair<std::string, stat> > functions(functionStats.begin(), functionStats.end());
+	std::sort(functions.begin(), functions.end(), bySelf<std::string, stat>);
+	for(unsigned int i = 0; i < functions.size() && i < 20; i++){
+		stat &s = functions[i].second;
+		Output::Inst()->kprintf("%-30s %10llu %12.2f %12.2f\n",
+				functions[i].first.c_str(), s.calls, s.selfNs/1e6, s.totalNs/1e6);
+	}
+
+	Output::Inst()->kprintf("---- Lua profile: autons ----\n");
+	Output::Inst()->kprintf("%-10s %10s %12s %10s\n",
+			"auton", "calls", "total[ms]", "max[us]");
+
+	std::vector< std::pair<int, stat> > autons(autonStats.begin(), autonStats.end());
+	std::sort(autons.begin(), autons.end(), byTotal<int, stat>);
+	for(unsigned int i = 0; i < autons.size() && i < 10; i++){
+		stat &s = autons[i].second;
+		Output::Inst()->kprintf("%-10i %10llu %12.2f %10.2f\n",
+				autons[i].first, s.calls, s.totalNs/1e6, s.maxNs/1e3);
+	}
+
+	if(!foldedFile.empty()){
+		std::ofstream file(foldedFile.c_str(), std::ofstream::trunc);
+		std::map<std::string, unsigned long long>::iterator it;
+		for(it = folded.begin(); it != folded.end(); ++it){
+			//flamegraph counts in microseconds:
+			if(it->second >= 1000)
+				file << it->first << " " << it->second/1000 << "\n";
+		}
+		Output::Inst()->kprintf("Folded Lua stacks written to: %s\n", foldedFile.c_str());
+	}
+	reset();
+}
+
+/**
+ * Clears all collected profiling data.
+ */
+void LuaProfiler::reset(){
+	stack.clear();
+	callbackStats.clear();
+	functionStats.clear();
+	autonStats.clear();
+	folded.clear();
+}
@@ -0,0 +1,101 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef LUAPROFILER_H
+#define LUAPROFILER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <chrono>
+
+#include "lua.hpp"
+
+/**
+ * Timing profiler for the Lua autons.
+ * Measures the time spent in every lua_pcall made by AutonLUA, grouped by
+ * callback and by auton, and uses a call/return hook to attribute time to
+ * the script functions called within them.
+ * A sorted report is printed when the simulation is done, and optionally
+ * a folded stack file, which can be rendered with flamegraph.pl.
+ *
+ * It is implemented as a singleton, like Output, and is disabled by
+ * default, in which case AutonLUA only pays for a single boolean test.
+ */
+class LuaProfiler
+{
+	public:
+		static LuaProfiler* Inst();
+
+		void enable(std::string foldedFile);
+		static bool isEnabled(){ return enabled; }
+
+		//installed by the LuaWatchdog, which owns the hook of the states:
+		static void hook(lua_State *L, lua_Debug *ar);
+		void beginCallback(int autonID, const char *callback);
+		void endCallback();
+
+		void report();
+		void reset();
+
+	private:
+		LuaProfiler();
+		LuaProfiler(LuaProfiler const&){};
+		static LuaProfiler* profiler;
+		static bool enabled;
+
+		typedef std::chrono::steady_clock clock;
+
+		struct stat{
+			unsigned long long calls;
+			unsigned long long totalNs;
+			unsigned long long selfNs;
+			unsigned long long maxNs;
+		};
+
+		struct frame{
+			std::string name;
+			clock::time_point start;
+			unsigned long long childNs;
+		};
+
+		void enterFunction(lua_State *L, lua_Debug *ar);
+		void leaveFunction();
+		std::string functionName(lua_State *L, lua_Debug *ar);
+		bool findGlobalName(lua_State *L, int funcIndex, int tableIndex,
+				std::string prefix, int depth, std::string &name);
+		void addStat(stat &s, unsigned long long totalNs, unsigned long long selfNs);
+
+		std::string foldedFile;
+		//the active callback, and its lua call stack:
+		std::vector<frame> stack;
+		int activeAuton;
+
+		std::map<std::string, stat> callbackStats;
+		std::map<std::string, stat> functionStats;
+		std::unordered_map<int, stat> autonStats;
+		std::map<std::string, unsigned long long> folded;
+		//qualified function names, keyed by source location:
+		std::unordered_map<std::string, std::string> nameCache;
+};
+
+#endif // LUAPROFILER_H
@@ -0,0 +1,102 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <string>
+
+#include "lauxlib.h"
+
+#include "luawatchdog.h"
+#include "luaprofiler.h"
+#include "output.h"
+
+int LuaWatchdog::budget = 0;
+thread_local bool LuaWatchdog::trip = false;
+std::atomic<unsigned long long> LuaWatchdog::disabledAmount(0);
+std::vector<int> LuaWatchdog::disabledIDs;
+
+int LuaWatchdog::mask(){
+	int events = 0;
+	if(LuaProfiler::isEnabled())
+		events |= LUA_MASKCALL | LUA_MASKRET;
+	if(budget > 0)
+		events |= LUA_MASKCOUNT;
+	return events;
+}
+
+/**
+ * Install the hook of a new Lua state, if there is a budget or the
+ * profiler is enabled.
+ */
+void LuaWatchdog::attach(lua_State *L){
+	int events = mask();
+	if(events != 0)
+		lua_sethook(L, hook, events, budget);
+}
+
+/**
+ * Lua hook function.
+ * Raises the budget error on a count event, other events are for the
+ * profiler.
+ */
+void LuaWatchdog::hook(lua_State *L, lua_Debug *ar){
+	if(ar->event != LUA_HOOKCOUNT){
+		LuaProfiler::hook(L, ar);
+		return;
+	}
+	trip = true;
+	lua_sethook(L, hook, mask(), 1);
+	luaL_error(L, "instruction budget of %d exceeded", budget);
+}
+
+/**
+ * Check if the last callback exceeded the budget, and clear it.
+ */
+bool LuaWatchdog::tripped(){
+	bool tripped = trip;
+	trip = false;
+	return tripped;
+}
+
+/**
+ * Count an auton disabled by the watchdog.
+ * Called from the simulation thread.
+ */
+void LuaWatchdog::disabled(int autonID){
+	disabledAmount.fetch_add(1, std::memory_order_relaxed);
+	if(disabledIDs.size() < LISTED_IDS)
+		disabledIDs.push_back(autonID);
+}
+
+/**
+ * Print the autons disabled so far, if any.
+ */
+void LuaWatchdog::report(){
+	unsigned long long amount = disabledAmount.load(std::memory_order_relaxed);
+	if(amount == 0)
+		return;
+	std::string ids;
+	for(size_t i = 0; i < disabledIDs.size(); i++)
+		ids += " " + std::to_string(disabledIDs[i]);
+	if(amount > disabledIDs.size())
+		ids += " ...";
+	Output::Inst()->kprintf("Instruction budget of %i exceeded, %llu autons disabled:%s\n",
+			budget, amount, ids.c_str());
+}
@@ -0,0 +1,79 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef LUAWATCHDOG_H
+#define LUAWATCHDOG_H
+
+#include <vector>
+#include <atomic>
+#include <climits>
+
+#include "lua.hpp"
+
+/**
+ * Instruction budget of the Lua callbacks.
+ * A count hook raises an error in a callback which runs more than the
+ * budget of Lua instructions, so an endless loop in a script can not hang
+ * the simulation. AutonLUA then disables the auton, like an auton without
+ * a script, and the autons disabled so far are reported when a run is
+ * done.
+ * Once tripped the hook raises an error on every instruction, so a script
+ * can not catch it with pcall and carry on.
+ *
+ * A Lua state has a single hook, so the watchdog installs it and passes
+ * the call and return events on to the LuaProfiler. Without a budget and
+ * without profiling no hook is installed at all.
+ */
+class LuaWatchdog
+{
+	public:
+		//the count of a Lua hook is an int:
+		static void setBudget(long long instructions){
+			budget = instructions > INT_MAX ? INT_MAX : (instructions < 0 ? 0 : instructions);
+		}
+		static bool isEnabled(){ return budget > 0; }
+
+		static void attach(lua_State *L);
+		//restart the count before a callback:
+		static void arm(lua_State *L){
+			if(budget > 0)
+				lua_sethook(L, hook, mask(), budget);
+		}
+		static bool tripped();
+		static void disabled(int autonID);
+		static unsigned long long disabledAutons(){
+			return disabledAmount.load(std::memory_order_relaxed);
+		}
+		static void report();
+
+	private:
+		static int mask();
+		static void hook(lua_State *L, lua_Debug *ar);
+
+		static int budget;
+		static thread_local bool trip;
+		static std::atomic<unsigned long long> disabledAmount;
+		//the first disabled autons, for the report:
+		static std::vector<int> disabledIDs;
+		static const size_t LISTED_IDS = 10;
+};
+
+#endif // LUAWATCHDOG_H
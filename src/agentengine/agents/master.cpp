@@ -27,18 +27,27 @@
 #include <stdlib.h>
 #include <time.h>
 #include <algorithm>
+#include <math.h>
 
 #include "utility.h"
 #include "master.h"
 #include "phys.h"
 
 #include "output.h"
+#include "luaprofiler.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "memaccount.h"
+#include "luamemory.h"
+#include "luawatchdog.h"
+#include "positionsnapshot.h"
 
 	Master::Master()
-:eEventInitAmount(0), responseAmount(0), externalDistroAmount(0), tmu(0)
+:eEventInitAmount(0), responseAmount(0), externalDistroAmount(0), tmu(0),
+	eEventAmount(0), iEventAmount(0), iEventActAmount(0)
 {
 	//Output::Inst()->kprintf("Initiating master\n");
-	eventQueue = new EventQueue;
+	eventQueue = new EventQueue(&context);
 	srand (time(NULL));
 }
 
@@ -61,6 +70,9 @@ void Master::generateMap(double width, double height, int resolution, double tim
 	this->macroResolution = macroResolution;
 	areaX = width;
 	areaY = height;
+	//the models are set by the scripts of the new autons:
+	propagation.clear();
+	propagation.setMaxDistance(sqrt(width*width + height*height));
 
 	if(!nestenes.empty()){
 		//memoryleak here! not clearing out all autons!
@@ -91,23 +103,27 @@ void Master::generateMap(double width, double height, int resolution, double tim
 }
 
 /**
- * Get the X and Y positions of all actors within the masters domain
- * Retrieves the information from all actors, writes the information to the lists given.
- * @param sylist y positions of all Screamer autons
- * @param sxlist x positions of all Screamer autons
- * @param lylist y positions of all Listener autons
- * @param lxlist x positions of all Listener autons
- * @param aylist y positions of all Lua autons
- * @param axlist x positions of all Lua autons
+ * Publish the X and Y positions of all actors within the masters domain
+ * Writes the positions to a free frame of the position snapshot and
+ * publishes it, nothing is published if readers hold every free frame.
+ * Must only be called between steps.
+ * @param tmu the current time step.
+ * @param width width of the map.
+ * @param height height of the map.
+ * @see PositionSnapshot
  */
-void Master::retrievePopPos(std::list<double> &sylist, std::list<double> &sxlist,
-		std::list<double> &lylist, std::list<double> &lxlist,
-		std::list<double> &aylist, std::list<double> &axlist){
-
+void Master::publishPositions(unsigned long long tmu, double width, double height){
+	PositionSnapshot::Frame *frame = context.positions.beginWrite();
+	if(frame == NULL)
+		return;
+
+	frame->width = width;
+	frame->height = height;
+	frame->tmu = tmu;
 	for(itNest = nestenes.begin(); itNest !=nestenes.end(); itNest++){
-		itNest->retrievePopPos(sylist,sxlist,lylist,lxlist,aylist,axlist);		
+		itNest->retrievePositions(*frame);		
 	}	
-
+	context.positions.publish();
 }
 
 /**
@@ -118,9 +134,12 @@ void Master::retrievePopPos(std::list<double> &sylist, std::list<double> &sxlist
  * @param screamerSize number of screamers total.
  * @param LUASize number of LUAs total.
  * @param filename the lua file of the LUA autons definition.
+ * @param nativeSize number of native autons total.
+ * @param pluginFilename the shared object implementing the native autons.
  */
 void Master::populateSystem(int listenerSize,
-		int screamerSize, int LUASize, std::string filename){
+		int screamerSize, int LUASize, std::string filename,
+		int nativeSize, std::string pluginFilename){
 
 	std::vector<int> listenerVector;
 	std::vector<int>::iterator itListerner;
@@ -131,10 +150,13 @@ void Master::populateSystem(int listenerSize,
 	std::vector<int> LUAVector;
 	std::vector<int>::iterator itLUA;
 
+	std::vector<int> nativeVector;
+
 	for(int i = 0; i < nestenes.size(); i++){
 		listenerVector.push_back(0);
 		ScreamerVector.push_back(0);
 		LUAVector.push_back(0);
+		nativeVector.push_back(0);
 	}
 
 
@@ -183,14 +205,30 @@ void Master::populateSystem(int listenerSize,
 		}
 	}
 
-	autonAmount = LUASize;
+	tmpSize = 0;
+	tmpSize2 = 0;
+	nSize = 0;
+	while(tmpSize<nativeSize){
+		for(int i=0; i<nativeVector.size(); i++){
+			nSize = rand()%2;
+			tmpSize += nSize;
+			if(tmpSize > nativeSize){
+				nSize = nativeSize - tmpSize2;
+			}
+			tmpSize2 += nSize;
+			nativeVector.at(i) += nSize;
+		}
+	}
+
+	autonAmount = LUASize + nativeSize;
 	luaFilename = filename;
 
 	//Output::Inst()->kprintf("lua size from master is : %d \n", LUASize);
 	for(int i= 0; i<listenerVector.size(); i++){
 		//std::cout<< listenerVector.at(i) << std::endl;
 		Nestene *nest = &nestenes.at(i);
-		nest->populate(listenerVector.at(i), ScreamerVector.at(i),LUAVector.at(i), filename);
+		nest->populate(listenerVector.at(i), ScreamerVector.at(i),LUAVector.at(i), filename,
+				nativeVector.at(i), pluginFilename);
 	}
 }
 
@@ -232,17 +270,20 @@ void Master::populateSquareListenerSystem(int listenerSize){
 
 
 void Master::receiveEEventPtr(EventQueue::eEvent *eEvent){
+	eEventAmount++;
 	eventQueue->insertEEvent(eEvent);
 }
 
 void Master::receiveInitEEventPtr(EventQueue::eEvent *eEvent){
 	//increase the initiated events counter:
 	eEventInitAmount++;
+	eEventAmount++;
 	//insert the event into the eventQueue:
 	eventQueue->insertEEvent(eEvent);
 }
 
 void Master::receiveIEventPtr(EventQueue::iEvent *ievent){
+	iEventAmount++;
 	eventQueue->insertIEvent(ievent);
 }
 
@@ -256,36 +297,62 @@ void Master::receiveIEventPtr(EventQueue::iEvent *ievent){
  * @see Nestene::endPhase()
  */
 void Master::microStep(unsigned long long tmu){
+	Tracer::Scope span("microStep", "tmu", tmu);
 
 	//Output::Inst()->kprintf("Taking microstep at %d \n", tmu);
-	if(eventQueue->eEventsAtTime(tmu)){
-		std::list<EventQueue::eEvent*> list = eventQueue->getEEventList(tmu);
-		std::list<EventQueue::eEvent*>::iterator itlist = list.begin();
-
-		for(; itlist != list.end(); ++itlist){
-			for(itNest = nestenes.begin(); itNest != nestenes.end(); itNest++){
-				externalDistroAmount++;
-				//EventQueue::eEvent* event = *itlist;
-				itNest->distroPhase(*itlist);
-			}
+	std::list<EventQueue::eEvent*> eList;
+	{
+		PhaseTimer::Scope timer(phaseTimer, PhaseTimer::QUEUE);
+		if(eventQueue->eEventsAtTime(tmu))
+			eList = eventQueue->getEEventList(tmu);
+	}
+	if(!eList.empty()){
+		PhaseTimer::Scope timer(phaseTimer, PhaseTimer::DISTRO);
+		for(itNest = nestenes.begin(); itNest != nestenes.end(); itNest++){
+			externalDistroAmount += eList.size();
+			Tracer::Scope span("distroPhase", "nestene", itNest->getID());
+			itNest->distroPhase(eList);
 		}
 	}
 
-	if(eventQueue->iEventsAtTime(tmu)){
-		std::list<EventQueue::iEvent*> list = eventQueue->getIEventList(tmu);		
+	//the distroPhase can add internal events at this tmu:
+	std::list<EventQueue::iEvent*> list;
+	{
+		PhaseTimer::Scope timer(phaseTimer, PhaseTimer::QUEUE);
+		if(eventQueue->iEventsAtTime(tmu))
+			list = eventQueue->getIEventList(tmu);
+	}
+	if(!list.empty()){
+		PhaseTimer::Scope timer(phaseTimer, PhaseTimer::ACT);
+		iEventActAmount += list.size();
 		std::list<EventQueue::iEvent*>::iterator itlist = list.begin();
 
+		//handle the internal events in homogeneous batches pr. auton type:
 		for(; itlist != list.end(); ++itlist){
 			EventQueue::iEvent* event = *itlist;
-			event->origin->actOnEvent(*itlist);
+			typedEvents[event->origin->getType()].push_back(event);
+		}
+		for(int type = 0; type < Auton::TYPE_AMOUNT; type++){
+			if(!typedEvents[type].empty()){
+				Auton::actOnEvents(typedEvents[type], (Auton::AutonType)type);
+				typedEvents[type].clear();
+			}
 		}
 	}
 
 	//then run the endPhase on the nestenes, this will handle the responses of the Autons:
-	for(itNest =nestenes.begin(); itNest !=nestenes.end(); ++itNest){
-		itNest->endPhase();
+	{
+		PhaseTimer::Scope timer(phaseTimer, PhaseTimer::END);
+		for(itNest =nestenes.begin(); itNest !=nestenes.end(); ++itNest){
+			Tracer::Scope span("endPhase", "nestene", itNest->getID());
+			itNest->endPhase();
+		}
 	}
-
+	{
+		PhaseTimer::Scope timer(phaseTimer, PhaseTimer::EXPORT);
+		eventQueue->streamEvents(tmu);
+	}
+	PhaseTimer::Scope timer(phaseTimer, PhaseTimer::QUEUE);
 	eventQueue->legacyFront();
 }
 
@@ -294,6 +361,7 @@ void Master::microStep(unsigned long long tmu){
  * @see EventQueue::getNextTmu()
  */
 unsigned long long Master::getNextMicroTmu(){
+	PhaseTimer::Scope timer(phaseTimer, PhaseTimer::QUEUE);
 	//eventQueue->printATmus();
 	return eventQueue->getNextTmu();
 }
@@ -304,25 +372,67 @@ unsigned long long Master::getNextMicroTmu(){
  * @see Nestene::initPhase();
  */
 void Master::macroStep(unsigned long long tmu){
+	PhaseTimer::Scope timer(phaseTimer, PhaseTimer::INIT);
+	if(Tracer::isEnabled())
+		Tracer::Inst()->beginMacroStep();
+	Tracer::Scope span("macroStep", "tmu", tmu);
 	//Handle the initiation of events:
 	for(itNest=nestenes.begin() ; itNest !=nestenes.end(); ++itNest){
+		Tracer::Scope span("initPhase", "nestene", itNest->getID());
 		itNest->initPhase(macroResolution, tmu+1);
 	}
 }
 
 
+/**
+ * Start the Doctor on a new run.
+ * @param timeResolution seconds pr. tmu.
+ * @see Doctor::beginRun()
+ */
+void Master::beginHealthCheck(double timeResolution){
+	context.doctor.beginRun(timeResolution, eEventAmount + iEventAmount,
+			eventQueue->getISize() + eventQueue->getESize());
+}
+
+/**
+ * Let the Doctor check the health of the run, after a macro step.
+ * @param tmu the current tmu.
+ * @return false if the run should be aborted.
+ * @see Doctor::macroStep()
+ */
+bool Master::checkHealth(unsigned long long tmu){
+	return context.doctor.macroStep(tmu, eEventAmount + iEventAmount,
+			eventQueue->getISize() + eventQueue->getESize());
+}
+
 /**
  * Update Status Fields
- * Updates the status output field, on the running mode panel 
+ * Updates the status output field, the phase timing and the allocation
+ * rates, on the running mode panel 
  * @see Output::updateStatus()
+ * @see PhaseTimer::sample()
+ * @see MemAccount::sample()
  */
 void Master::printStatus(){
-	Output::Inst()->updateStatus(Phys::getCTime(),eEventInitAmount,
+	Output::Inst()->updateStatus(context.phys.getCTime(),eEventInitAmount,
 			eventQueue->getISize(), eventQueue->getESize());
+	phaseTimer.sample(eEventAmount + iEventAmount);
+	MemAccount::sample();
 	//Output::Inst()->kprintf("%d\n", eventQueue->getISize());
 	//	eventQueue->printATmus();
 }
 
+/**
+ * Publish the live metrics.
+ * Copies the event counters, the rates are computed by the publishing thread.
+ * @see Metrics::update()
+ */
+void Master::publishMetrics(){
+	Metrics::Inst()->update(context.phys.getCTime(), eEventInitAmount,
+			externalDistroAmount, iEventActAmount, eEventAmount - eEventInitAmount,
+			eventQueue->getISize(), eventQueue->getESize());
+}
+
 /**
  * Save eEvent data to disk
  * @see EventQueue::saveEEventData
@@ -331,8 +441,65 @@ void Master::saveExternalEvents(std::string filename){
 	eventQueue->saveEEventData(filename, luaFilename,autonAmount,areaY,areaX);
 }
 
+/**
+ * Stream eEvent data to disk during the run
+ * @see EventQueue::startStream
+ */
+void Master::streamExternalEvents(std::string filename){
+	eventQueue->startStream(filename, luaFilename,autonAmount,areaY,areaX);
+}
+
+/**
+ * Set the .kas version of saved and streamed event data
+ * @see EventQueue::setKasVersion
+ */
+void Master::setKasVersion(int version){
+	eventQueue->setKasVersion(version);
+}
+
+/**
+ * Set the filter of saved and streamed event data
+ * @see EventQueue::setExportFilter
+ */
+void Master::setExportFilter(const ExportFilter &filter){
+	eventQueue->setExportFilter(filter);
+}
+
+/**
+ * Get the propagation models.
+ * @see Propagation
+ */
+Propagation* Master::getPropagation(){
+	return &propagation;
+}
+
+/**
+ * Simulation done.
+ * Lets all autons know the run is over, closes the event stream, prints
+ * the phase breakdown, the memory pr. subsystem and the Lua profile if
+ * profiling is enabled, and
+ * writes the trace if tracing is enabled.
+ * @see PhaseTimer::report()
+ * @see MemAccount::report()
+ * @see LuaMemory::report()
+ * @see LuaWatchdog::report()
+ * @see Doctor::report()
+ * @see LuaProfiler::report()
+ * @see Tracer::write()
+ */
 void Master::simDone(){
 	for(itNest=nestenes.begin() ; itNest !=nestenes.end(); ++itNest){
 		itNest->simDone();
 	}
+	{
+		PhaseTimer::Scope timer(phaseTimer, PhaseTimer::EXPORT);
+		eventQueue->finishStream();
+	}
+	phaseTimer.report(eEventAmount + iEventAmount);
+	MemAccount::report();
+	LuaMemory::report();
+	LuaWatchdog::report();
+	context.doctor.report();
+	LuaProfiler::Inst()->report();
+	Tracer::Inst()->write();
 }
@@ -27,6 +27,11 @@
 #include <string>
 
 #include"nestene.h"
+#include"propagation.h"
+#include"simcontext.h"
+#include"exportfilter.h"
+#include"phasetimer.h"
+#include"doctor.h"
 
 class Nestene;
 class Master
@@ -50,7 +55,8 @@ class Master
 		   Populate the system with a give population size
 		   */
 		void populateSystem(int listenerSize, int screamerSize, 
-				int LUASize, std::string filename);
+				int LUASize, std::string filename,
+				int nativeSize, std::string pluginFilename);
 
 		void populateSquareSystem(int LUASize, std::string filename);
 		void populateSquareListenerSystem(int listenerSize);
@@ -75,14 +81,26 @@ class Master
 		void addExternalEventPtr(EventQueue::eEvent *eEvent);
 
 		void printStatus();
-		void retrievePopPos(std::list<double> &sylist, std::list<double> &sxlist,
-				std::list<double> &lylist, std::list<double> &lxlist,
-				std::list<double> &aylist, std::list<double> &axlist);
+		void publishMetrics();
+		void publishPositions(unsigned long long tmu, double width, double height);
 		void saveExternalEvents(std::string filename);
+		void streamExternalEvents(std::string filename);
+		void setKasVersion(int version);
+		void setExportFilter(const ExportFilter &filter);
 
 		void simDone();
+		Propagation* getPropagation();
+		unsigned long long getEEventInitAmount(){ return eEventInitAmount; }
+		unsigned long long getEEventAmount(){ return eEventAmount; }
+		unsigned long long getIEventAmount(){ return iEventAmount; }
+		SimContext* getContext(){ return &context; }
+		PhaseTimer* getPhaseTimer(){ return &phaseTimer; }
+		void beginHealthCheck(double timeResolution);
+		bool checkHealth(unsigned long long tmu);
 
 	private:
+		//time, random generator and ID counters of this simulation:
+		SimContext context;
 		unsigned long long tmu;
 
 		std::vector<Nestene> nestenes;
@@ -108,9 +126,20 @@ class Master
 		double areaY;
 
 		EventQueue *eventQueue;
+		//propagation models pr. event type:
+		Propagation propagation;
+		//internal events of the current microstep, sorted by auton type:
+		std::vector<EventQueue::iEvent*> typedEvents[Auton::TYPE_AMOUNT];
 
 		unsigned long long eEventInitAmount;
 		unsigned long long externalDistroAmount;
 		unsigned long long responseAmount;
+		//all events received during the runs:
+		unsigned long long eEventAmount;
+		unsigned long long iEventAmount;
+		//internal events acted on:
+		unsigned long long iEventActAmount;
+		//wall time spent in the phases of the runs:
+		PhaseTimer phaseTimer;
 };
 #endif // MASTER_H
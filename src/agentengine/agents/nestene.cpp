@@ -21,19 +21,22 @@
 //--end_license--
 #include <map>
 #include <iostream>
+#include <limits>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include "nestene.h"
-#include "ID.h"
+#include "simcontext.h"
 #include "master.h"
 #include "output.h"
+#include "luamemory.h"
 
 	Nestene::Nestene(double posX, double posY, double width, double height, Master* master)
-:posX(posX), posY(posY),width(width),height(height),master(master), initAmount(0)
+:initAmount(0), master(master), ctx(master->getContext()), posX(posX), posY(posY), width(width), height(height)
 {	
+	nesteneID = ctx->id.generateNesteneID();
 	//Output::Inst()->kprintf("Nestene position %f , %f\n", posX , posY);
 	//initialize the internal Events list:
 	//iEvents = new std::list<EventQueue::iEvent*>;
@@ -43,20 +46,31 @@ Nestene::~Nestene(){
 }
 
 
+/**
+ * Generate an event ID for an event issued by one of the local autons.
+ * @see ID::generateEventID(int)
+ */
+unsigned long long Nestene::generateEventID(){
+	return ctx->id.generateEventID(nesteneID);
+}
+
 void Nestene::generateAuton(){
 	//insertAuton(new Auton(generateAutonID(),0,0,0));
 }
 
-void Nestene::populate(int listenerSize, int screamerSize, int LUASize,std::string filename){
+void Nestene::populate(int listenerSize, int screamerSize, int LUASize,std::string filename,
+		int nativeSize, std::string pluginFilename){
 	//Output::Inst()->kprintf("Populating Nestenes\n");
+	//events point to their origin auton, so the vectors must not reallocate later:
+	listeners.reserve(listeners.size() + listenerSize);
+	screamers.reserve(screamers.size() + screamerSize);
+
 	//first insert the listener autons:
 	for(int i=0; i<listenerSize; i++){
 		double xtmp = (double)rand()/ RAND_MAX * width + posX;
 		double ytmp = (double)rand()/ RAND_MAX * height + posY;
 
-		AutonListener auton = AutonListener(ID::generateAutonID(),xtmp,ytmp,1,this);
-		itListeners = listeners.begin();
-		listeners.insert(std::pair<int,AutonListener>(auton.getID(),auton));	
+		addListener(ctx->id.generateAutonID(),xtmp,ytmp);
 	}
 
 	//the screamer autons:
@@ -64,9 +78,7 @@ void Nestene::populate(int listenerSize, int screamerSize, int LUASize,std::stri
 		double xtmp = (double)rand()/ RAND_MAX * width + posX;
 		double ytmp = (double)rand()/ RAND_MAX * height + posY;
 
-		AutonScreamer auton = AutonScreamer(ID::generateAutonID(),xtmp,ytmp,1,this);
-		itScreamers = screamers.begin();
-		screamers.insert(std::pair<int,AutonScreamer>(auton.getID(),auton));
+		screamers.push_back(AutonScreamer(ctx->id.generateAutonID(),xtmp,ytmp,1,this));
 	}
 
 	//the LUA autons:	
@@ -74,10 +86,19 @@ void Nestene::populate(int listenerSize, int screamerSize, int LUASize,std::stri
 		double xtmp = (double)rand()/ RAND_MAX * width + posX;
 		double ytmp = (double)rand()/ RAND_MAX * height + posY;
 
-		AutonLUA auton = AutonLUA(ID::generateAutonID(),xtmp,ytmp,1,this,filename);
+		AutonLUA auton = AutonLUA(ctx->id.generateAutonID(),xtmp,ytmp,1,this,filename);
 		itLUAs = LUAs.begin();
 		LUAs.insert(std::pair<int,AutonLUA>(auton.getID(),auton));
 	}
+
+	//the native autons:
+	for(int i=0; i<nativeSize; i++){
+		double xtmp = (double)rand()/ RAND_MAX * width + posX;
+		double ytmp = (double)rand()/ RAND_MAX * height + posY;
+
+		natives.addAuton(ctx->id.generateAutonID(),xtmp,ytmp,this);
+	}
+	natives.init(pluginFilename);
 }
 
 /*
@@ -91,7 +112,7 @@ void Nestene::populateSquared(int LUASize,std::string filename){
 
 		for(int i=0; i<LUASize; i++){
 			for(int j = 0; j < LUASize; j++){
-				AutonLUA auton(ID::generateAutonID(), (chunkX*j)+posX+chunkX/2, (chunkY*i)+posY+chunkY/2,1,this,filename);
+				AutonLUA auton(ctx->id.generateAutonID(), (chunkX*j)+posX+chunkX/2, (chunkY*i)+posY+chunkY/2,1,this,filename);
 				itLUAs = LUAs.begin();
 				LUAs.insert(std::pair<int,AutonLUA>(auton.getID(),auton));
 			}
@@ -107,42 +128,54 @@ void Nestene::populateSquaredListener(int listenerSize){
 		double chunkX = width/(double)listenerSize;
 		double chunkY = height/(double)listenerSize;
 
+		listeners.reserve(listeners.size() + listenerSize*listenerSize);
+
 		for(int i=0; i<listenerSize; i++){
 			for(int j = 0; j < listenerSize; j++){
-				AutonListener auton(ID::generateAutonID(), (chunkX*j)+posX+chunkX/2, (chunkY*i)+posY+chunkY/2,1,this);
-				itListeners = listeners.begin();
-				listeners.insert(std::pair<int,AutonListener>(auton.getID(),auton));
+				addListener(ctx->id.generateAutonID(), (chunkX*j)+posX+chunkX/2, (chunkY*i)+posY+chunkY/2);
 			}
 		}
 	}
 }
 
 /**
- * Get the X and Y positions of all actors
- * Retrieves the information from all actors, writes the information to the lists given.
- * @param sylist y positions of all Screamer autons
- * @param sxlist x positions of all Screamer autons
- * @param lylist y positions of all Listener autons
- * @param lxlist x positions of all Listener autons
- * @param aylist y positions of all Lua autons
- * @param axlist x positions of all Lua autons
+ * Add a listener auton.
+ * Listeners never move, so their positions are also stored in 
+ * contiguous arrays used when distributing events.
  */
-void Nestene::retrievePopPos(std::list<double> &sylist, std::list<double> &sxlist,
-		std::list<double> &lylist, std::list<double> &lxlist,
-		std::list<double> &aylist, std::list<double> &axlist){	
+void Nestene::addListener(int ID, double posX, double posY){
+	listeners.push_back(AutonListener(ID,posX,posY,1,this));
+	listenerPosX.push_back(posX);
+	listenerPosY.push_back(posY);
+	listenerTimes.push_back(0);
+}
 
+/**
+ * Get the X and Y positions of all actors
+ * Appends the positions of all actors to the arrays of their type in the
+ * frame, native autons are counted with the Lua autons.
+ * @param frame position snapshot frame being written.
+ */
+void Nestene::retrievePositions(PositionSnapshot::Frame &frame){
+	std::vector<double> &sx = frame.x[PositionSnapshot::SCREAMER];
+	std::vector<double> &sy = frame.y[PositionSnapshot::SCREAMER];
 	for(itScreamers = screamers.begin(); itScreamers !=screamers.end(); itScreamers++){
-		sylist.push_back(itScreamers->second.getPosY());
-		sxlist.push_back(itScreamers->second.getPosX());
+		sx.push_back(itScreamers->getPosX());
+		sy.push_back(itScreamers->getPosY());
 	}	
+	std::vector<double> &lx = frame.x[PositionSnapshot::LISTENER];
+	std::vector<double> &ly = frame.y[PositionSnapshot::LISTENER];
 	for(itListeners = listeners.begin(); itListeners !=listeners.end(); itListeners++){
-		lylist.push_back(itListeners->second.getPosY());
-		lxlist.push_back(itListeners->second.getPosX());
+		lx.push_back(itListeners->getPosX());
+		ly.push_back(itListeners->getPosY());
 	}	
+	std::vector<double> &ax = frame.x[PositionSnapshot::LUA];
+	std::vector<double> &ay = frame.y[PositionSnapshot::LUA];
 	for(itLUAs = LUAs.begin(); itLUAs !=LUAs.end(); itLUAs++){
-		aylist.push_back(itLUAs->second.getPosY());
-		axlist.push_back(itLUAs->second.getPosX());
+		ax.push_back(itLUAs->second.getPosX());
+		ay.push_back(itLUAs->second.getPosY());
 	}
+	natives.retrievePositions(ax, ay);
 }
 
 
@@ -155,13 +188,13 @@ void Nestene::retrievePopPos(std::list<double> &sylist, std::list<double> &sxlis
 void Nestene::initPhase(double macroResolution, unsigned long long tmu){
 	//query it's population on whether there is going to be an event or not:
 	for(itListeners = listeners.begin(); itListeners !=listeners.end(); itListeners++){
-		EventQueue::eEvent* eevent = itListeners->second.initEvent(macroResolution,tmu);
+		EventQueue::eEvent* eevent = itListeners->initEvent(macroResolution,tmu);
 		if(eevent != NULL){
 			master->receiveInitEEventPtr(eevent);
 		}
 	}
 	for(itScreamers = screamers.begin(); itScreamers !=screamers.end(); itScreamers++){
-		EventQueue::eEvent* eevent = itScreamers->second.initEvent(macroResolution,tmu);
+		EventQueue::eEvent* eevent = itScreamers->initEvent(macroResolution,tmu);
 		if(eevent != NULL){
 			master->receiveInitEEventPtr(eevent);
 		}
@@ -172,26 +205,110 @@ void Nestene::initPhase(double macroResolution, unsigned long long tmu){
 			master->receiveInitEEventPtr(eevent);
 		}
 	}
+	//with the collector stopped, the garbage is collected between macro steps:
+	if(LuaMemory::collectsBetweenSteps()){
+		for(itLUAs = LUAs.begin(); itLUAs !=LUAs.end(); itLUAs++)
+			itLUAs->second.collectGarbage();
+	}
+	if(!natives.empty()){
+		std::list<EventQueue::eEvent*> initiated;
+		std::list<EventQueue::eEvent*>::iterator itInitiated;
+		natives.initEvents(initiated);
+		for(itInitiated = initiated.begin(); itInitiated != initiated.end(); ++itInitiated){
+			master->receiveInitEEventPtr(*itInitiated);
+		}
+	}
 }
 
 /**
  * Event distribution phase.
- * Recieves an eventlist from the Master to distribute among local autons
- * @param event EventQueue ptr holding external events.
+ * Recieves the external events active at the current tmu from the Master and 
+ * distributes them among local autons. Lua autons that define 
+ * 'handleExternalEvents' receive every event of the tmu in a single call.
+ * If the event type has a propagation model, Lua autons get the received
+ * level with the event, and don't get events received below the models
+ * threshold at all.
+ * @param events list of external event ptrs active at this tmu.
+ * @see AutonLUA::handleEvents()
  */
-void Nestene::distroPhase(EventQueue::eEvent* event){
-	for(itListeners = listeners.begin(); itListeners != listeners.end(); ++itListeners){
-		if(event->origin->getID() != itListeners->second.getID()){
-			EventQueue::iEvent *ievent = itListeners->second.handleEvent(event);
-			if(ievent != NULL)
-				master->receiveIEventPtr(ievent);			
+void Nestene::distroPhase(std::list<EventQueue::eEvent*> &events){
+	std::list<EventQueue::eEvent*>::iterator itEvents;
+
+	int listenerAmount = listeners.size();
+
+	for(itEvents = events.begin(); itEvents != events.end() && listenerAmount > 0; ++itEvents){
+		EventQueue::eEvent *event = *itEvents;
+		int originID = event->origin->getID();
+
+		ctx->phys.speedOfSound(event->origin->getPosX(), event->origin->getPosY(),
+				&listenerPosX[0], &listenerPosY[0], &listenerTimes[0], listenerAmount);
+
+		for(int i = 0; i < listenerAmount; i++){
+			if(originID != listeners[i].getID()){
+				master->receiveIEventPtr(listeners[i].handleEvent(event, listenerTimes[i]));
+			}
+		}
+	}
+
+	std::vector<EventQueue::eEvent*> batch;
+	std::vector<double> levels;
+	std::list<EventQueue::iEvent*> responses;
+	std::list<EventQueue::iEvent*>::iterator itResponses;
+
+	if(!natives.empty()){
+		for(itEvents = events.begin(); itEvents != events.end(); ++itEvents){
+			natives.handleEvent(*itEvents, responses);
+		}
+		for(itResponses = responses.begin(); itResponses != responses.end(); ++itResponses){
+			master->receiveIEventPtr(*itResponses);
 		}
 	}
+
+	if(LUAs.empty())
+		return;
+
+	//look up the propagation model of each event once:
+	std::vector<EventQueue::eEvent*> eventVector(events.begin(), events.end());
+	std::vector<const Propagation::Model*> models(eventVector.size());
+	for(unsigned int i = 0; i < eventVector.size(); i++){
+		models[i] = master->getPropagation()->getModel(eventVector[i]->desc);
+	}
+
 	for(itLUAs = LUAs.begin(); itLUAs != LUAs.end(); ++itLUAs){
-		if(event->origin->getID() != itLUAs->second.getID()){
-			EventQueue::iEvent *ievent = itLUAs->second.handleEvent(event);
-			if(ievent != NULL)
-				master->receiveIEventPtr(ievent);
+		AutonLUA *auton = &itLUAs->second;
+		batch.clear();
+		levels.clear();
+		responses.clear();
+
+		for(unsigned int i = 0; i < eventVector.size(); i++){
+			EventQueue::eEvent *event = eventVector[i];
+			if(event->origin->getID() == auton->getID())
+				continue;
+
+			//NaN marks events without a propagation model:
+			double level = std::numeric_limits<double>::quiet_NaN();
+			if(models[i] != NULL){
+				level = models[i]->level(Phys::calcDistance(event->origin->getPosX(),
+							event->origin->getPosY(), auton->getPosX(), auton->getPosY()));
+				if(level < models[i]->threshold)
+					continue;
+			}
+
+			if(auton->batchHandler){
+				batch.push_back(event);
+				levels.push_back(level);
+			} else{
+				EventQueue::iEvent *ievent = auton->handleEvent(event, level);
+				if(ievent != NULL)
+					master->receiveIEventPtr(ievent);
+			}
+		}
+
+		if(!batch.empty()){
+			auton->handleEvents(batch, levels, responses);
+			for(itResponses = responses.begin(); itResponses != responses.end(); ++itResponses){
+				master->receiveIEventPtr(*itResponses);
+			}
 		}
 	}
 }
@@ -200,6 +317,8 @@ void Nestene::distroPhase(EventQueue::eEvent* event){
  * Check local eventQueue 'outbox' if any external events need to distributed.
  */
 void Nestene::endPhase(){
+	//let the native autons act on this microsteps internal events:
+	natives.actOnEvents(eEventsOutbox);
 	//distribute all Eevents that's in the Eevent outbox:
 	if(!eEventsOutbox.empty()){
 		for(iteEventsOutbox = eEventsOutbox.begin(); iteEventsOutbox != eEventsOutbox.end(); iteEventsOutbox++){
@@ -214,14 +333,15 @@ void Nestene::endPhase(){
 void Nestene::simDone(){
 	//query it's population on whether there is going to be an event or not:
 	for(itListeners = listeners.begin(); itListeners !=listeners.end(); itListeners++){
-		itListeners->second.simDone();
+		itListeners->simDone();
 	}
 	for(itScreamers = screamers.begin(); itScreamers !=screamers.end(); itScreamers++){
-		itScreamers->second.simDone();
+		itScreamers->simDone();
 	}
 	for(itLUAs = LUAs.begin(); itLUAs !=LUAs.end(); itLUAs++){
 		itLUAs->second.simDone();
 	}
+	natives.simDone();
 }
 
 void Nestene::queryPopulation(){
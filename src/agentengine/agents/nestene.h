@@ -25,16 +25,21 @@
 
 #include <map>
 #include <list>
+#include <vector>
 #include <string>
 
 
 #include "eventqueue.h"
+#include "memaccount.h"
+#include "positionsnapshot.h"
 #include "autonlistener.h"
 #include "autonscreamer.h"
 #include "autonLUA.h"
+#include "autonplugin.h"
 #include "master.h"
 
 class Master;
+class SimContext;
 class AutonListener;
 class AutonScreamer;
 class AutonLUA;
@@ -45,19 +50,21 @@ class Nestene
 		~Nestene();
 
 		void generateAuton();
-		void populate(int listenerSize, int screamerSize, int LUASize, std::string filename);
+		void populate(int listenerSize, int screamerSize, int LUASize, std::string filename,
+				int nativeSize, std::string pluginFilename);
 		void populateSquared(int LUASize,std::string filename);
 		void populateSquaredListener(int listenerSize);
 
 		void initPhase(double macroResolution, unsigned long long tmu);
 		//function to receive events the master, and distribute them on all local nestenes
-		void distroPhase(EventQueue::eEvent* event);
+		void distroPhase(std::list<EventQueue::eEvent*> &events);
 		std::list<EventQueue::iEvent> responsePhase();
 		void endPhase();
+		SimContext* getContext(){ return ctx; }
+		int getID(){ return nesteneID; }
+		unsigned long long generateEventID();
 
-		void retrievePopPos(std::list<double> &sylist, std::list<double> &sxlist,
-				std::list<double> &lylist, std::list<double> &lxlist,
-				std::list<double> &aylist, std::list<double> &axlist);
+		void retrievePositions(PositionSnapshot::Frame &frame);
 		int initAmount;
 
 		void simDone();
@@ -80,20 +87,39 @@ class Nestene
 
 		void registerIEvent(EventQueue::iEvent *event);
 		void registerEEvent(EventQueue::eEvent *event);
+		void addListener(int ID, double posX, double posY);
 		//EventQueue *ievents;
 		//EventQueue *eevents;
 
 		Master *master;
-
-		//map of local autons with ID, and auton.
-		std::map<int,AutonListener> listeners;
-		std::map<int,AutonListener>::iterator itListeners;
-
-		std::map<int,AutonScreamer> screamers;
-		std::map<int,AutonScreamer>::iterator itScreamers;
-
-		std::map<int,AutonLUA> LUAs;
-		std::map<int,AutonLUA>::iterator itLUAs;
+		//the simulation this nestene belongs to:
+		SimContext *ctx;
+		int nesteneID;
+
+		//local built-in autons, kept contiguous pr. type and counted as
+		//Nestene memory:
+		std::vector<AutonListener,
+			TaggedAllocator<AutonListener, MemAccount::NESTENE> > listeners;
+		std::vector<AutonListener,
+			TaggedAllocator<AutonListener, MemAccount::NESTENE> >::iterator itListeners;
+		//listener positions and arrival times, for the distribution pass:
+		std::vector<double, TaggedAllocator<double, MemAccount::NESTENE> > listenerPosX;
+		std::vector<double, TaggedAllocator<double, MemAccount::NESTENE> > listenerPosY;
+		std::vector<unsigned long long,
+			TaggedAllocator<unsigned long long, MemAccount::NESTENE> > listenerTimes;
+
+		std::vector<AutonScreamer,
+			TaggedAllocator<AutonScreamer, MemAccount::NESTENE> > screamers;
+		std::vector<AutonScreamer,
+			TaggedAllocator<AutonScreamer, MemAccount::NESTENE> >::iterator itScreamers;
+
+		typedef std::map<int, AutonLUA, std::less<int>,
+			TaggedAllocator<std::pair<const int, AutonLUA>, MemAccount::NESTENE> > luaMap;
+		luaMap LUAs;
+		luaMap::iterator itLUAs;
+
+		//the native autons, handled by a plugin:
+		AutonPluginGroup natives;
 
 		//list of ievents to be send back to the master:
 		//std::list<EventQueue::iEvent*>* iEvents;
@@ -107,6 +133,7 @@ class Nestene
 		friend class AutonListener;
 		friend class AutonScreamer;
 		friend class AutonLUA;
+		friend class AutonPlugin;
 		double posX;
 		double posY;
 		double width;
@@ -0,0 +1,157 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perfcounters.h"
+#include "output.h"
+
+bool PerfCounters::requested = false;
+
+const char* PerfCounters::name(int counter){
+	static const char *names[COUNTER_AMOUNT] =
+		{"cycles", "instructions", "LLC misses", "branch misses"};
+	if(counter < 0 || counter >= COUNTER_AMOUNT)
+		return "unknown";
+	return names[counter];
+}
+
+	PerfCounters::PerfCounters()
+:leader(-1), slotAmount(0), wasMultiplexed(false)
+{
+	for(int i = 0; i < COUNTER_AMOUNT; i++){
+		fds[i] = -1;
+		slots[i] = -1;
+	}
+}
+
+PerfCounters::~PerfCounters(){
+	close();
+}
+
+#ifdef __linux__
+namespace {
+	int openCounter(unsigned int type, unsigned long long config, int group){
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = group < 0 ? 1 : 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP |
+			PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		//this thread, on any cpu:
+		return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+	}
+}
+#endif
+
+/**
+ * Open the counters for the calling thread and start them.
+ * @return false if the counters are not permitted or not supported.
+ */
+bool PerfCounters::open(){
+	close();
+#ifdef __linux__
+	static const unsigned long long configs[COUNTER_AMOUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+	for(int i = 0; i < COUNTER_AMOUNT; i++){
+		fds[i] = openCounter(PERF_TYPE_HARDWARE, configs[i], leader);
+		if(fds[i] < 0){
+			if(i == CYCLES){
+				if(errno == EACCES || errno == EPERM)
+					Output::Inst()->kprintf("Hardware counters not permitted, "
+							"see /proc/sys/kernel/perf_event_paranoid\n");
+				else
+					Output::Inst()->kprintf("Hardware counters unavailable: %s\n",
+							strerror(errno));
+				return false;
+			}
+			continue;
+		}
+		if(i == CYCLES)
+			leader = fds[i];
+		slots[i] = slotAmount++;
+	}
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+#else
+	Output::Inst()->kprintf("Hardware counters are only supported on Linux\n");
+	return false;
+#endif
+}
+
+void PerfCounters::close(){
+	for(int i = 0; i < COUNTER_AMOUNT; i++){
+#ifdef __linux__
+		if(fds[i] >= 0)
+			::close(fds[i]);
+#endif
+		fds[i] = -1;
+		slots[i] = -1;
+	}
+	leader = -1;
+	slotAmount = 0;
+	wasMultiplexed = false;
+}
+
+/**
+ * Read all counters.
+ * When the kernel had to multiplex the group, the values are scaled up to
+ * the time the counters were enabled.
+ * @param values array of COUNTER_AMOUNT values, unavailable counters are 0.
+ */
+void PerfCounters::read(unsigned long long *values){
+	for(int i = 0; i < COUNTER_AMOUNT; i++)
+		values[i] = 0;
+#ifdef __linux__
+	if(leader < 0)
+		return;
+	//number of counters, time enabled, time running, values:
+	unsigned long long buffer[3 + COUNTER_AMOUNT];
+	if(::read(leader, buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(unsigned long long)))
+		return;
+	double scale = 1;
+	if(buffer[2] > 0 && buffer[2] < buffer[1]){
+		scale = (double)buffer[1] / buffer[2];
+		wasMultiplexed = true;
+	}
+	for(int i = 0; i < COUNTER_AMOUNT; i++){
+		if(slots[i] >= 0 && slots[i] < (int)buffer[0])
+			values[i] = buffer[3 + slots[i]] * scale;
+	}
+#endif
+}
@@ -0,0 +1,75 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+/**
+ * Hardware performance counters of the calling thread.
+ * Cycles, instructions, last level cache misses and branch misses are
+ * counted as one group with perf_event_open, so they cover the same
+ * instructions and a single read() returns all of them. Only user space
+ * is counted.
+ *
+ * The counters may not be permitted (perf_event_paranoid, containers,
+ * virtual machines without a PMU), open() then prints why and returns
+ * false and the counters stay closed. A counter the CPU lacks is left out
+ * of the group and reads as zero.
+ */
+class PerfCounters
+{
+	public:
+		enum Counter{
+			CYCLES = 0,
+			INSTRUCTIONS,
+			LLC_MISSES,
+			BRANCH_MISSES,
+			COUNTER_AMOUNT
+		};
+
+		//request the counters for the following runs:
+		static void setEnabled(bool enabled){ requested = enabled; }
+		static bool isEnabled(){ return requested; }
+		static const char* name(int counter);
+
+		PerfCounters();
+		~PerfCounters();
+
+		bool open();
+		void close();
+		bool isOpen(){ return leader >= 0; }
+		bool available(int counter){ return slots[counter] >= 0; }
+		bool multiplexed(){ return wasMultiplexed; }
+		void read(unsigned long long *values);
+
+	private:
+		PerfCounters(PerfCounters const&){};
+		static bool requested;
+
+		int leader;
+		int fds[COUNTER_AMOUNT];
+		//position of each counter in the group, -1 if unavailable:
+		int slots[COUNTER_AMOUNT];
+		int slotAmount;
+		bool wasMultiplexed;
+};
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,189 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <stdio.h>
+
+#include "phasetimer.h"
+#include "output.h"
+
+using std::chrono::duration_cast;
+
+namespace {
+	double seconds(PhaseTimer::clock::duration time){
+		return duration_cast<std::chrono::duration<double>>(time).count();
+	}
+}
+
+	PhaseTimer::PhaseTimer()
+:runEvents(0), lastEvents(0)
+{
+	reset(0);
+}
+
+/**
+ * Name of a phase, PHASE_AMOUNT is the time outside the timed phases.
+ */
+const char* PhaseTimer::name(int phase){
+	static const char *names[PHASE_AMOUNT+1] = 
+		{"init", "distro", "act", "end", "export", "queue", "other"};
+	if(phase < 0 || phase > PHASE_AMOUNT)
+		return "unknown";
+	return names[phase];
+}
+
+/**
+ * Reset the timer at the start of a run.
+ * Opens the hardware counters if they are enabled, so it must be called
+ * from the simulation thread.
+ * @param events total number of events before the run.
+ */
+void PhaseTimer::beginRun(unsigned long long events){
+	reset(events);
+	counters.close();
+	if(PerfCounters::isEnabled())
+		counters.open();
+}
+
+void PhaseTimer::reset(unsigned long long events){
+	for(int i = 0; i < PHASE_AMOUNT; i++){
+		total[i] = clock::duration::zero();
+		lastTotal[i] = clock::duration::zero();
+		calls[i] = 0;
+		for(int j = 0; j < PerfCounters::COUNTER_AMOUNT; j++)
+			counts[i][j] = 0;
+	}
+	runStart = clock::now();
+	lastSample = runStart;
+	runEvents = events;
+	lastEvents = events;
+}
+
+/**
+ * Publish the phase shares and the event rate since the last sample.
+ * @param events total number of events.
+ * @see Output::updatePhases()
+ */
+void PhaseTimer::sample(unsigned long long events){
+	clock::time_point now = clock::now();
+	double interval = seconds(now - lastSample);
+	if(interval <= 0)
+		return;
+
+	const char *names[PHASE_AMOUNT+1];
+	double shares[PHASE_AMOUNT+1];
+	double timed = 0;
+	for(int i = 0; i < PHASE_AMOUNT; i++){
+		names[i] = name(i);
+		shares[i] = seconds(total[i] - lastTotal[i]) / interval;
+		timed += shares[i];
+		lastTotal[i] = total[i];
+	}
+	names[PHASE_AMOUNT] = name(PHASE_AMOUNT);
+	shares[PHASE_AMOUNT] = timed < 1 ? 1 - timed : 0;
+
+	double rate = (events - lastEvents) / interval;
+	lastEvents = events;
+	lastSample = now;
+	Output::Inst()->updatePhases(names, shares, PHASE_AMOUNT+1, rate);
+}
+
+/**
+ * Print the time spent in each phase during the run.
+ * @param events total number of events.
+ */
+void PhaseTimer::report(unsigned long long events){
+	double wall = seconds(clock::now() - runStart);
+	unsigned long long runAmount = events - runEvents;
+	if(wall <= 0)
+		return;
+
+	Output::Inst()->kprintf("\n---- Phase breakdown ----\n");
+	Output::Inst()->kprintf("%-8s %10s %7s %12s %12s\n",
+			"phase", "time[s]", "share", "calls", "ns/event");
+	double timed = 0;
+	for(int i = 0; i <= PHASE_AMOUNT; i++){
+		double time;
+		unsigned long long amount = 0;
+		if(i < PHASE_AMOUNT){
+			time = seconds(total[i]);
+			amount = calls[i];
+			timed += time;
+		}else
+			time = wall > timed ? wall - timed : 0;
+		Output::Inst()->kprintf("%-8s %10.3f %6.1f%% %12llu %12.1f\n",
+				name(i), time, time / wall * 100, amount,
+				runAmount > 0 ? time * 1e9 / runAmount : 0.0);
+	}
+	Output::Inst()->kprintf("%llu events in %.3f[s], %.0f events/s\n",
+			runAmount, wall, runAmount / wall);
+
+	if(counters.isOpen()){
+		reportCounters(runAmount);
+		counters.close();
+	}
+}
+
+/**
+ * Add the hardware counts since the start of a Scope to a phase.
+ */
+void PhaseTimer::addCounts(Phase phase, const unsigned long long *startCounts){
+	unsigned long long now[PerfCounters::COUNTER_AMOUNT];
+	counters.read(now);
+	for(int i = 0; i < PerfCounters::COUNTER_AMOUNT; i++){
+		if(now[i] > startCounts[i])
+			counts[phase][i] += now[i] - startCounts[i];
+	}
+}
+
+/**
+ * Print the hardware counters of each phase.
+ * @param events number of events during the run.
+ */
+void PhaseTimer::reportCounters(unsigned long long events){
+	Output::Inst()->kprintf("\n---- Hardware counters ----\n");
+	Output::Inst()->kprintf("%-8s %14s %14s %6s %12s %12s\n",
+			"phase", "cycles", "instructions", "IPC", "LLC/event", "branch/event");
+
+	unsigned long long sum[PerfCounters::COUNTER_AMOUNT] = {0};
+	for(int i = 0; i <= PHASE_AMOUNT; i++){
+		const unsigned long long *count = i < PHASE_AMOUNT ? counts[i] : sum;
+		if(i < PHASE_AMOUNT){
+			for(int j = 0; j < PerfCounters::COUNTER_AMOUNT; j++)
+				sum[j] += count[j];
+		}
+		char ipc[16] = "n/a", llc[16] = "n/a", branch[16] = "n/a";
+		if(count[PerfCounters::CYCLES] > 0 && counters.available(PerfCounters::INSTRUCTIONS))
+			snprintf(ipc, sizeof(ipc), "%.2f",
+					(double)count[PerfCounters::INSTRUCTIONS] / count[PerfCounters::CYCLES]);
+		if(events > 0 && counters.available(PerfCounters::LLC_MISSES))
+			snprintf(llc, sizeof(llc), "%.2f",
+					(double)count[PerfCounters::LLC_MISSES] / events);
+		if(events > 0 && counters.available(PerfCounters::BRANCH_MISSES))
+			snprintf(branch, sizeof(branch), "%.2f",
+					(double)count[PerfCounters::BRANCH_MISSES] / events);
+		Output::Inst()->kprintf("%-8s %14llu %14llu %6s %12s %12s\n",
+				i < PHASE_AMOUNT ? name(i) : "total",
+				count[PerfCounters::CYCLES], count[PerfCounters::INSTRUCTIONS],
+				ipc, llc, branch);
+	}
+	if(counters.multiplexed())
+		Output::Inst()->kprintf("The counters were multiplexed, the values are estimates\n");
+}
@@ -0,0 +1,115 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef PHASETIMER_H
+#define PHASETIMER_H
+
+#include <chrono>
+
+#include "perfcounters.h"
+
+/**
+ * Wall time spent in each phase of the simulation.
+ * The phases are timed with a Scope around them, which costs two reads of
+ * the steady clock. The Master samples the timer with the status update,
+ * the share of each phase since the last sample and the event rate are
+ * shown in the running panel, and a breakdown is printed when the run is
+ * done.
+ *
+ * When PerfCounters are enabled the Scope also reads the hardware counters
+ * of the simulation thread, and the breakdown includes the IPC and the
+ * cache and branch misses pr. event of each phase. A read is a system
+ * call, so this is only for profiling.
+ *
+ * Only used from the simulation thread.
+ */
+class PhaseTimer
+{
+	public:
+		enum Phase{
+			INIT = 0,	//macroStep, autons initiating events
+			DISTRO,		//distroPhase, external events to the Nestenes
+			ACT,		//actOnEvents, internal events
+			END,		//endPhase, responses of the autons
+			EXPORT,		//streaming the events to disk
+			QUEUE,		//event queue lookups and maintenance
+			PHASE_AMOUNT
+		};
+
+		typedef std::chrono::steady_clock clock;
+
+		/**
+		 * Times the phase from construction until it goes out of scope.
+		 */
+		class Scope{
+			public:
+				Scope(PhaseTimer &timer, Phase phase)
+					:timer(timer), phase(phase), counting(timer.counters.isOpen()),
+					start(clock::now()){
+					if(counting)
+						timer.counters.read(startCounts);
+				}
+				~Scope(){
+					if(counting)
+						timer.addCounts(phase, startCounts);
+					timer.add(phase, clock::now() - start);
+				}
+			private:
+				PhaseTimer &timer;
+				Phase phase;
+				bool counting;
+				clock::time_point start;
+				unsigned long long startCounts[PerfCounters::COUNTER_AMOUNT];
+		};
+
+		PhaseTimer();
+
+		static const char* name(int phase);
+
+		void beginRun(unsigned long long events);
+		void sample(unsigned long long events);
+		void report(unsigned long long events);
+
+	private:
+		void add(Phase phase, clock::duration time){
+			total[phase] += time;
+			calls[phase]++;
+		}
+		void reset(unsigned long long events);
+		void addCounts(Phase phase, const unsigned long long *startCounts);
+		void reportCounters(unsigned long long events);
+
+		clock::duration total[PHASE_AMOUNT];
+		unsigned long long calls[PHASE_AMOUNT];
+
+		PerfCounters counters;
+		unsigned long long counts[PHASE_AMOUNT][PerfCounters::COUNTER_AMOUNT];
+
+		clock::time_point runStart;
+		unsigned long long runEvents;
+
+		//state at the last sample:
+		clock::time_point lastSample;
+		clock::duration lastTotal[PHASE_AMOUNT];
+		unsigned long long lastEvents;
+};
+
+#endif // PHASETIMER_H
@@ -0,0 +1,154 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef RANAPLUGIN_H
+#define RANAPLUGIN_H
+
+/**
+ * @file ranaplugin.h
+ * Native auton plugin interface.
+ *
+ * A plugin is a shared object exporting the function 'rana_plugin_entry',
+ * which returns a table of behaviour functions. The functions mirror the
+ * Lua auton interface, but operate on all autons of one Nestene at a time,
+ * so a compiled species model can loop over a contiguous array of autons.
+ *
+ * This header is plain C, so plugins can be written in either C or C++,
+ * and it is the only file a plugin needs. Structures are only ever
+ * extended by raising RANA_PLUGIN_ABI_VERSION, plugins built against
+ * another version are refused when loaded.
+ *
+ * All functions return 0 or the number of responses written, and a
+ * negative value on error, which disables the plugin autons.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RANA_PLUGIN_ABI_VERSION 1
+#define RANA_PLUGIN_ENTRY "rana_plugin_entry"
+
+#define RANA_DESC_SIZE 150
+#define RANA_TABLE_SIZE 500
+
+/**
+ * A native auton, owned by the simulator.
+ * The plugin may move the auton by changing posX and posY, and may keep
+ * its own state behind the data pointer.
+ */
+typedef struct rana_auton {
+	int id;
+	double posX;
+	double posY;
+	void *data;
+} rana_auton;
+
+/**
+ * An external event, as received by the autons.
+ * The strings are only valid for the duration of the call.
+ */
+typedef struct rana_event {
+	unsigned long long id;
+	int originID;
+	double originX;
+	double originY;
+	double propagationSpeed;
+	double duration;
+	unsigned long long activationTime;
+	const char *desc;
+	const char *table;
+} rana_event;
+
+/**
+ * An internal event, and the external event that caused it.
+ */
+typedef struct rana_ievent {
+	int auton; /* index of the auton in the batch */
+	unsigned long long id;
+	unsigned long long activationTime;
+	const char *desc;
+	rana_event cause;
+} rana_ievent;
+
+/**
+ * A response written by the plugin.
+ * From handleExternal it describes an internal event (id, activationTime
+ * and desc are used), from initiate and handleInternal an external event.
+ * Activation times follow the same rules as for the Lua autons.
+ */
+typedef struct rana_response {
+	int auton; /* index of the responding auton in the batch */
+	unsigned long long id;
+	unsigned long long activationTime;
+	double duration;
+	double propagationSpeed;
+	char desc[RANA_DESC_SIZE];
+	char table[RANA_TABLE_SIZE];
+} rana_response;
+
+/**
+ * Simulator services available to the plugin.
+ * Every function takes the ctx member as its first argument.
+ */
+typedef struct rana_host {
+	void *ctx;
+	unsigned long long (*currentTime)(void *ctx);
+	unsigned long long (*generateEventID)(void *ctx);
+	double (*getTimeResolution)(void *ctx);
+	int (*getMacroFactor)(void *ctx);
+	double (*getMersenneFloat)(void *ctx, double low, double high);
+	unsigned long long (*speedOfSound)(void *ctx, double x, double y,
+			double originX, double originY, double propagationSpeed);
+	void (*debug)(void *ctx, const char *msg);
+} rana_host;
+
+/**
+ * The plugin function table.
+ * 'out' always has room for 'count' responses (handleInternal: 'n').
+ */
+typedef struct rana_plugin {
+	int abiVersion;
+	const char *name;
+
+	/* called once pr. Nestene when the environment is generated: */
+	int (*init)(const rana_host *host, rana_auton *autons, int count);
+	/* called each macrostep, responses are initiated external events: */
+	int (*initiate)(const rana_host *host, rana_auton *autons, int count,
+			rana_response *out);
+	/* called for each external event, the origin auton is part of the
+	 * batch but responses from it are ignored: */
+	int (*handleExternal)(const rana_host *host, rana_auton *autons, int count,
+			const rana_event *event, rana_response *out);
+	/* called once pr. microstep with the internal events that are due: */
+	int (*handleInternal)(const rana_host *host, rana_auton *autons, int count,
+			const rana_ievent *events, int n, rana_response *out);
+	/* called when the simulation is done: */
+	void (*done)(const rana_host *host, rana_auton *autons, int count);
+} rana_plugin;
+
+typedef const rana_plugin* (*rana_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RANAPLUGIN_H
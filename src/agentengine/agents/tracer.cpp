@@ -0,0 +1,202 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tracer.h"
+#include "output.h"
+
+Tracer* Tracer::tracer;
+bool Tracer::enabled = false;
+std::atomic<bool> Tracer::active(false);
+
+/**
+ * Singleton accessor.
+ * Like Output::Inst() it is not threadsafe, it must be called from the
+ * main thread first.
+ */
+Tracer* Tracer::Inst(){
+	if(!tracer)
+		tracer = new Tracer();
+	return tracer;
+}
+
+	Tracer::Tracer()
+:runs(0), every(1), luaEvery(1), maxSpans(500000), macroSteps(0), spanAmount(0), truncated(false),
+	origin(clock::now())
+{
+}
+
+/**
+ * Enable the tracer.
+ * @param spec the trace file, optionally followed by sampling terms.
+ * @see Tracer for the format.
+ * @return false if the specification has an error, the tracer is then
+ * left disabled.
+ */
+bool Tracer::enable(std::string spec){
+	std::stringstream stream(spec);
+	std::string term;
+	std::getline(stream, filename, ';');
+	if(filename.empty())
+		return false;
+
+	while(std::getline(stream, term, ';')){
+		if(term.empty())
+			continue;
+		size_t eq = term.find('=');
+		if(eq == std::string::npos)
+			return false;
+		std::string key = term.substr(0, eq);
+		unsigned long long value = strtoull(term.substr(eq+1).c_str(), NULL, 10);
+		if(key.compare("every") == 0 && value > 0)
+			every = value;
+		else if(key.compare("lua") == 0)
+			luaEvery = value;
+		else if(key.compare("max") == 0 && value > 0)
+			maxSpans = value;
+		else
+			return false;
+	}
+	origin = clock::now();
+	enabled = true;
+	return true;
+}
+
+unsigned long long Tracer::now(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			clock::now() - Inst()->origin).count();
+}
+
+/**
+ * A macro step starts.
+ * Decides if it, and the microsteps until the next macro step, are traced.
+ */
+void Tracer::beginMacroStep(){
+	bool traced = macroSteps++ % every == 0 && !truncated.load(std::memory_order_relaxed);
+	active.store(traced, std::memory_order_relaxed);
+}
+
+/**
+ * Decide if a Lua callback is recorded.
+ * @return true for one in 'lua' callbacks of a traced step.
+ */
+bool Tracer::sampleLua(){
+	static thread_local unsigned long long callbacks = 0;
+	if(!isActive() || Inst()->luaEvery == 0)
+		return false;
+	return callbacks++ % Inst()->luaEvery == 0;
+}
+
+Tracer::Buffer* Tracer::threadBuffer(){
+	static thread_local Buffer *buffer = NULL;
+	if(buffer == NULL){
+		std::lock_guard<std::mutex> lock(bufferMutex);
+		buffer = new Buffer();
+		buffer->tid = buffers.size() + 1;
+		buffers.push_back(buffer);
+	}
+	return buffer;
+}
+
+void Tracer::record(const char *name, const char *argName, long long arg,
+		unsigned long long start, unsigned long long end){
+	if(spanAmount.fetch_add(1, std::memory_order_relaxed) >= maxSpans){
+		truncated.store(true, std::memory_order_relaxed);
+		active.store(false, std::memory_order_relaxed);
+		return;
+	}
+	Span span = {name, argName, arg, start, end};
+	threadBuffer()->spans.push_back(span);
+}
+
+/**
+ * Name of the trace file of the next run, the runs after the first get
+ * their number before the extension.
+ */
+std::string Tracer::runFilename(){
+	runs++;
+	if(runs == 1)
+		return filename;
+
+	std::stringstream number;
+	number << "." << runs;
+	size_t dot = filename.rfind('.');
+	size_t slash = filename.rfind('/');
+	if(dot == std::string::npos || dot == 0 || (slash != std::string::npos && dot < slash))
+		return filename + number.str();
+	return filename.substr(0, dot) + number.str() + filename.substr(dot);
+}
+
+/**
+ * Write the trace of the run.
+ * Called when the run is done, no thread may record spans meanwhile.
+ * The buffers are emptied, so the next run is written on its own.
+ */
+void Tracer::write(){
+	if(!enabled)
+		return;
+	active.store(false, std::memory_order_relaxed);
+
+	std::string name = runFilename();
+	FILE *file = fopen(name.c_str(), "w");
+	if(file == NULL){
+		Output::Inst()->kprintf("Unable to write trace file '%s'\n", name.c_str());
+		return;
+	}
+	std::lock_guard<std::mutex> lock(bufferMutex);
+
+	unsigned long long written = 0;
+	unsigned long long last = 0;
+	fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+	fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+			"\"args\": {\"name\": \"RANA\"}}");
+	for(size_t i = 0; i < buffers.size(); i++){
+		Buffer *buffer = buffers[i];
+		if(buffer->spans.empty())
+			continue;
+		fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %i, "
+				"\"args\": {\"name\": \"thread %i\"}}", buffer->tid, buffer->tid);
+		for(size_t j = 0; j < buffer->spans.size(); j++){
+			const Span &span = buffer->spans[j];
+			fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %i, "
+					"\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"%s\": %lld}}",
+					span.name, buffer->tid, span.start / 1e3, (span.end - span.start) / 1e3,
+					span.argName, span.arg);
+			if(span.end > last)
+				last = span.end;
+		}
+		written += buffer->spans.size();
+		buffer->spans.clear();
+	}
+	if(truncated.load(std::memory_order_relaxed))
+		fprintf(file, ",\n{\"name\": \"trace truncated, max spans reached\", \"ph\": \"i\", "
+				"\"s\": \"g\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f}", last / 1e3);
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	Output::Inst()->kprintf("Trace of %llu spans written to: %s\n", written, name.c_str());
+	spanAmount.store(0, std::memory_order_relaxed);
+	truncated.store(false, std::memory_order_relaxed);
+	macroSteps = 0;
+}
@@ -0,0 +1,126 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+/**
+ * Timeline of the simulation in the Chrome trace-event format.
+ * Records spans for the macro steps, microsteps, the phases of every
+ * Nestene and the Lua callbacks, which can be loaded into chrome://tracing
+ * or Perfetto. Every thread records to its own buffer, the trace is
+ * written when the run is done. The first run is written to the file, the
+ * following runs of the session to the file with the run number before
+ * the extension, as trace.2.json.
+ *
+ * Enabled with a specification of the form "file;every=N;lua=N;max=N":
+ * every	trace one in N macro steps, with the microsteps following it.
+ * lua		record one in N Lua callbacks of a traced step, 0 for none.
+ * max		stop recording after N spans, bounding the size of the file.
+ *
+ * Like LuaProfiler it is a singleton, and disabled by default, in which
+ * case a Scope only tests a boolean.
+ */
+class Tracer
+{
+	public:
+		static Tracer* Inst();
+		static bool isEnabled(){ return enabled; }
+		static bool isActive(){ return active.load(std::memory_order_relaxed); }
+
+		bool enable(std::string spec);
+		void beginMacroStep();
+		static bool sampleLua();
+		void write();
+
+		/**
+		 * Records a span from construction until it goes out of scope,
+		 * if the current step is traced. A NULL name records nothing.
+		 */
+		class Scope{
+			public:
+				Scope(const char *name, const char *argName, long long arg)
+					:name(name != NULL && isActive() ? name : NULL), argName(argName), arg(arg){
+					if(this->name != NULL)
+						start = Tracer::now();
+				}
+				~Scope(){
+					if(name != NULL)
+						Tracer::Inst()->record(name, argName, arg, start, Tracer::now());
+				}
+			private:
+				const char *name;
+				const char *argName;
+				long long arg;
+				unsigned long long start;
+		};
+
+	private:
+		Tracer();
+		Tracer(Tracer const&){};
+		static Tracer* tracer;
+		static bool enabled;
+		static std::atomic<bool> active;
+
+		typedef std::chrono::steady_clock clock;
+
+		//names are string literals, so only the pointers are kept:
+		struct Span{
+			const char *name;
+			const char *argName;
+			long long arg;
+			unsigned long long start;
+			unsigned long long end;
+		};
+		struct Buffer{
+			int tid;
+			std::vector<Span> spans;
+		};
+
+		static unsigned long long now();
+		void record(const char *name, const char *argName, long long arg,
+				unsigned long long start, unsigned long long end);
+		Buffer* threadBuffer();
+		std::string runFilename();
+
+		std::string filename;
+		//runs written so far:
+		unsigned int runs;
+		unsigned long long every;
+		unsigned long long luaEvery;
+		unsigned long long maxSpans;
+
+		unsigned long long macroSteps;
+		std::atomic<unsigned long long> spanAmount;
+		std::atomic<bool> truncated;
+
+		std::mutex bufferMutex;
+		std::vector<Buffer*> buffers;
+		clock::time_point origin;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,373 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <stdlib.h>
+
+#include "debuglog.h"
+
+DebugLog* DebugLog::debugLog;
+std::atomic<bool> DebugLog::enabled(false);
+const char DebugLog::MAGIC[8] = {'R','A','N','A','L','O','G','1'};
+const int DebugLog::FLUSH_INTERVAL;
+
+namespace {
+	void putU32(std::string &data, unsigned int value){
+		for(int i = 0; i < 4; i++)
+			data.push_back((char)((value >> (8*i)) & 0xFF));
+	}
+
+	void putU64(std::string &data, unsigned long long value){
+		for(int i = 0; i < 8; i++)
+			data.push_back((char)((value >> (8*i)) & 0xFF));
+	}
+}
+
+/**
+ * Singleton accessor.
+ * Like Output::Inst() it is not threadsafe, so it must be called from
+ * the main thread before any other thread uses the log.
+ */
+DebugLog* DebugLog::Inst(){
+	if(!debugLog)
+		debugLog = new DebugLog();
+	return debugLog;
+}
+
+	DebugLog::DebugLog()
+:start(clock::now()), stopping(false), writtenFormats(0), autonRate(0), rateLimited(0)
+{
+	for(int i = 0; i < LEVEL_AMOUNT; i++){
+		levelRates[i] = 0;
+		levelWindows[i] = 0;
+		levelCounts[i] = 0;
+	}
+}
+
+const char* DebugLog::levelName(int level){
+	static const char *names[LEVEL_AMOUNT] = {"error", "warn", "info", "debug"};
+	if(level < 0 || level >= LEVEL_AMOUNT)
+		return "unknown";
+	return names[level];
+}
+
+/**
+ * Open the log file and start the flush thread.
+ * @return false if the file can't be opened.
+ */
+bool DebugLog::enable(std::string filename){
+	if(isEnabled())
+		return true;
+	file.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!file.is_open())
+		return false;
+	file.write(MAGIC, sizeof(MAGIC));
+
+	start = clock::now();
+	stopping = false;
+	flushThread = std::thread(&DebugLog::flushLoop, this);
+	enabled.store(true);
+	return true;
+}
+
+/**
+ * Flush what is left in the rings and close the file.
+ * No thread may log while the log is closed, so it must be called after
+ * the simulation thread is joined.
+ */
+void DebugLog::close(){
+	if(!isEnabled())
+		return;
+	enabled.store(false);
+	{
+		std::lock_guard<std::mutex> lock(flushMutex);
+		stopping = true;
+	}
+	flushCondition.notify_one();
+	flushThread.join();
+	flush();
+	file.close();
+}
+
+/**
+ * Parse the rate limits, terms separated by ';':
+ * auton=N, error=N, warn=N, info=N, debug=N, in messages pr. second, 0 is
+ * unlimited.
+ * @return false if the specification has an error, no limits are set then.
+ */
+bool DebugLog::setRates(std::string spec){
+	unsigned int rates[LEVEL_AMOUNT] = {0, 0, 0, 0};
+	unsigned int auton = 0;
+
+	std::stringstream stream(spec);
+	std::string term;
+	while(std::getline(stream, term, ';')){
+		if(term.empty())
+			continue;
+		size_t eq = term.find('=');
+		if(eq == std::string::npos)
+			return false;
+		std::string key = term.substr(0, eq);
+		unsigned int rate = strtoul(term.substr(eq+1).c_str(), NULL, 10);
+
+		if(key.compare("auton") == 0){
+			auton = rate;
+			continue;
+		}
+		int level = 0;
+		while(level < LEVEL_AMOUNT && key.compare(levelName(level)) != 0)
+			level++;
+		if(level == LEVEL_AMOUNT)
+			return false;
+		rates[level] = rate;
+	}
+	for(int i = 0; i < LEVEL_AMOUNT; i++)
+		levelRates[i] = rates[i];
+	autonRate = auton;
+	return true;
+}
+
+unsigned long long DebugLog::currentWindow(){
+	return std::chrono::duration_cast<std::chrono::seconds>(clock::now() - start).count() + 1;
+}
+
+/**
+ * Rate limit a message.
+ * Counts the message against the limit of its level and of the auton
+ * sending it, in windows of one second.
+ * @param budget the rate limit state of the auton.
+ * @return true if the message may be logged.
+ */
+bool DebugLog::allow(Level level, Budget &budget){
+	if(levelRates[level] == 0 && autonRate == 0)
+		return true;
+
+	unsigned long long window = currentWindow();
+	if(autonRate > 0){
+		if(budget.window != window){
+			budget.window = window;
+			budget.count = 0;
+		}
+		if(budget.count >= autonRate){
+			rateLimited.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		budget.count++;
+	}
+	if(levelRates[level] > 0){
+		unsigned long long current = levelWindows[level].load(std::memory_order_relaxed);
+		//the first thread to see a new window resets the count:
+		if(current != window && levelWindows[level].compare_exchange_strong(current, window))
+			levelCounts[level].store(0, std::memory_order_relaxed);
+		if(levelCounts[level].fetch_add(1, std::memory_order_relaxed) >= levelRates[level]){
+			rateLimited.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Get the ID of a format string, registering it the first time.
+ * Every thread caches the IDs it has seen, so only new formats take the lock.
+ */
+int DebugLog::format(const std::string &fmt){
+	static thread_local std::unordered_map<std::string, int> cache;
+	std::unordered_map<std::string, int>::iterator it = cache.find(fmt);
+	if(it != cache.end())
+		return it->second;
+
+	std::lock_guard<std::mutex> lock(formatMutex);
+	int id;
+	it = formatIDs.find(fmt);
+	if(it == formatIDs.end()){
+		id = formats.size();
+		formats.push_back(fmt);
+		formatIDs[fmt] = id;
+	}else
+		id = it->second;
+	cache[fmt] = id;
+	return id;
+}
+
+std::string& DebugLog::scratch(){
+	static thread_local std::string data;
+	return data;
+}
+
+	DebugLog::Record::Record(Level level, int format, int auton, unsigned long long tmu)
+:data(DebugLog::scratch()), argc(0)
+{
+	unsigned long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			clock::now() - DebugLog::Inst()->start).count();
+	data.clear();
+	data.push_back(RECORD_MESSAGE);
+	putU32(data, format);
+	data.push_back((char)level);
+	data.push_back(0); //the argument count, set on commit
+	putU32(data, (unsigned int)auton);
+	putU64(data, tmu);
+	putU64(data, ns);
+}
+
+void DebugLog::Record::add(long long value){
+	data.push_back(ARG_INT);
+	putU64(data, (unsigned long long)value);
+	argc++;
+}
+
+void DebugLog::Record::add(double value){
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	data.push_back(ARG_DOUBLE);
+	putU64(data, bits);
+	argc++;
+}
+
+void DebugLog::Record::add(const char *value, size_t length){
+	if(length > MAX_STRING)
+		length = MAX_STRING;
+	data.push_back(ARG_STRING);
+	putU32(data, length);
+	data.append(value, length);
+	argc++;
+}
+
+void DebugLog::Record::add(const char *value){
+	add(value, strlen(value));
+}
+
+void DebugLog::Record::add(const std::string &value){
+	add(value.data(), value.size());
+}
+
+	DebugLog::Ring::Ring()
+:buffer(RING_SIZE), head(0), tail(0), owned(true), dropped(0)
+{
+}
+
+DebugLog::RingHandle::~RingHandle(){
+	if(ring != NULL)
+		ring->owned.store(false, std::memory_order_release);
+}
+
+/**
+ * The ring of the calling thread.
+ * Rings of threads that have exited are reused.
+ */
+DebugLog::Ring* DebugLog::threadRing(){
+	static thread_local RingHandle handle;
+	if(handle.ring != NULL)
+		return handle.ring;
+
+	std::lock_guard<std::mutex> lock(ringMutex);
+	for(size_t i = 0; i < rings.size(); i++){
+		bool owned = false;
+		if(rings[i]->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)){
+			handle.ring = rings[i];
+			return handle.ring;
+		}
+	}
+	handle.ring = new Ring();
+	rings.push_back(handle.ring);
+	return handle.ring;
+}
+
+/**
+ * Copy a message to the ring of the calling thread.
+ * The message is dropped if the ring is full.
+ */
+void DebugLog::commit(Record &record){
+	std::string &data = record.data;
+	data[6] = (char)record.argc;
+
+	Ring *ring = threadRing();
+	size_t head = ring->head.load(std::memory_order_relaxed);
+	size_t tail = ring->tail.load(std::memory_order_acquire);
+	if(data.size() > RING_SIZE - (head - tail)){
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	size_t offset = head & (RING_SIZE - 1);
+	size_t first = std::min(data.size(), RING_SIZE - offset);
+	memcpy(&ring->buffer[offset], data.data(), first);
+	memcpy(&ring->buffer[0], data.data() + first, data.size() - first);
+	ring->head.store(head + data.size(), std::memory_order_release);
+}
+
+void DebugLog::flushLoop(){
+	std::unique_lock<std::mutex> lock(flushMutex);
+	while(!stopping){
+		flushCondition.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL));
+		flush();
+	}
+}
+
+/**
+ * Move the content of all rings to the file.
+ * The rings are emptied before the formats are written, so every format
+ * used by a message is in the file ahead of it.
+ */
+void DebugLog::flush(){
+	std::string messages;
+	unsigned long long dropped = 0;
+	{
+		std::lock_guard<std::mutex> lock(ringMutex);
+		for(size_t i = 0; i < rings.size(); i++){
+			Ring *ring = rings[i];
+			size_t tail = ring->tail.load(std::memory_order_relaxed);
+			size_t head = ring->head.load(std::memory_order_acquire);
+			for(size_t pos = tail; pos != head;){
+				size_t offset = pos & (RING_SIZE - 1);
+				size_t length = std::min(head - pos, RING_SIZE - offset);
+				messages.append(&ring->buffer[offset], length);
+				pos += length;
+			}
+			ring->tail.store(head, std::memory_order_release);
+			dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+		}
+	}
+
+	std::string records;
+	{
+		std::lock_guard<std::mutex> lock(formatMutex);
+		for(; writtenFormats < formats.size(); writtenFormats++){
+			records.push_back(RECORD_FORMAT);
+			putU32(records, writtenFormats);
+			putU32(records, formats[writtenFormats].size());
+			records.append(formats[writtenFormats]);
+		}
+	}
+	records.append(messages);
+
+	unsigned long long limited = rateLimited.exchange(0, std::memory_order_relaxed);
+	if(limited > 0 || dropped > 0){
+		records.push_back(RECORD_DROPPED);
+		putU64(records, limited);
+		putU64(records, dropped);
+	}
+	if(!records.empty()){
+		file.write(records.data(), records.size());
+		file.flush();
+	}
+}
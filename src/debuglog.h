@@ -0,0 +1,194 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef DEBUGLOG_H
+#define DEBUGLOG_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <chrono>
+
+/**
+ * Binary debug log.
+ * Debug messages are stored as a format ID and the arguments instead of
+ * formatted text. Every thread writes to its own ring buffer, a background
+ * thread moves the rings to the log file, the producing threads never wait
+ * on the file. A full ring drops the message and counts it.
+ * The file is decoded offline with ranalog (src/ranalog/ranalog.cpp).
+ *
+ * Messages are rate limited pr. level and pr. auton, in messages pr.
+ * second, so debug output can be left on in long runs. The limits also
+ * apply when the log is disabled and messages go to the output window.
+ *
+ * The file starts with MAGIC, followed by records starting with a type byte,
+ * numbers are little endian:
+ * RECORD_FORMAT	u32 format ID, u32 length, the format string.
+ * RECORD_MESSAGE	u32 format ID, u8 level, u8 argument count, i32 auton ID,
+ * 			u64 tmu, u64 nanoseconds since the log was enabled,
+ * 			then the arguments as a tag and a value:
+ * 			ARG_INT i64, ARG_DOUBLE f64, ARG_STRING u32 length and bytes.
+ * RECORD_DROPPED	u64 messages rate limited, u64 messages lost to full rings.
+ *
+ * Like Output and LuaProfiler it is a singleton, Inst() must be called
+ * from the main thread first.
+ */
+class DebugLog
+{
+	public:
+		enum Level{
+			LEVEL_ERROR = 0,
+			LEVEL_WARN,
+			LEVEL_INFO,
+			LEVEL_DEBUG,
+			LEVEL_AMOUNT
+		};
+
+		static const char MAGIC[8];
+		static const unsigned char RECORD_FORMAT = 1;
+		static const unsigned char RECORD_MESSAGE = 2;
+		static const unsigned char RECORD_DROPPED = 3;
+		static const unsigned char ARG_INT = 'i';
+		static const unsigned char ARG_DOUBLE = 'd';
+		static const unsigned char ARG_STRING = 's';
+		//longer string arguments are cut:
+		static const size_t MAX_STRING = 1024;
+		static const size_t RING_SIZE = 1 << 20;
+		static const int FLUSH_INTERVAL = 100; //[ms]
+
+		static const char* levelName(int level);
+
+		/**
+		 * Rate limit state of a single auton.
+		 */
+		struct Budget{
+			unsigned long long window = 0;
+			unsigned int count = 0;
+		};
+
+		/**
+		 * A message being built, it is copied to the ring of the 
+		 * calling thread when committed.
+		 */
+		class Record{
+			public:
+				Record(Level level, int format, int auton, unsigned long long tmu);
+				void add(long long value);
+				void add(double value);
+				void add(const char *value, size_t length);
+				void add(const char *value);
+				void add(const std::string &value);
+				void add(int value){ add((long long)value); }
+				void add(long value){ add((long long)value); }
+				void add(unsigned int value){ add((long long)value); }
+				void add(unsigned long value){ add((long long)value); }
+				void add(unsigned long long value){ add((long long)value); }
+			private:
+				friend class DebugLog;
+				std::string &data;
+				unsigned char argc;
+		};
+
+		static DebugLog* Inst();
+		static bool isEnabled(){ return enabled.load(std::memory_order_relaxed); }
+
+		bool enable(std::string filename);
+		void close();
+		bool setRates(std::string spec);
+
+		bool allow(Level level, Budget &budget);
+		int format(const std::string &fmt);
+		void commit(Record &record);
+
+		/**
+		 * Log a message with the given arguments.
+		 * @param format ID from format().
+		 */
+		template<typename... Args>
+		void log(Level level, int format, int auton, unsigned long long tmu,
+				const Args&... args){
+			Record record(level, format, auton, tmu);
+			int unpack[] = {0, (record.add(args), 0)...};
+			(void)unpack;
+			commit(record);
+		}
+
+	private:
+		DebugLog();
+		DebugLog(DebugLog const&){};
+		static DebugLog* debugLog;
+		static std::atomic<bool> enabled;
+
+		typedef std::chrono::steady_clock clock;
+
+		//single producer, single consumer byte ring:
+		struct Ring{
+			Ring();
+			std::vector<char> buffer;
+			std::atomic<size_t> head;
+			//keeps head and tail on separate cache lines:
+			char padding[64];
+			std::atomic<size_t> tail;
+			std::atomic<bool> owned;
+			std::atomic<unsigned long long> dropped;
+		};
+		//gives the ring back when its thread exits:
+		struct RingHandle{
+			Ring *ring = NULL;
+			~RingHandle();
+		};
+
+		Ring* threadRing();
+		void flushLoop();
+		void flush();
+		unsigned long long currentWindow();
+		friend class Record;
+		static std::string& scratch();
+
+		std::ofstream file;
+		clock::time_point start;
+		std::thread flushThread;
+		std::mutex flushMutex;
+		std::condition_variable flushCondition;
+		bool stopping;
+
+		std::mutex ringMutex;
+		std::vector<Ring*> rings;
+
+		std::mutex formatMutex;
+		std::unordered_map<std::string, int> formatIDs;
+		std::vector<std::string> formats;
+		size_t writtenFormats;
+
+		//messages pr. second, 0 is unlimited:
+		unsigned int levelRates[LEVEL_AMOUNT];
+		unsigned int autonRate;
+		std::atomic<unsigned long long> levelWindows[LEVEL_AMOUNT];
+		std::atomic<unsigned int> levelCounts[LEVEL_AMOUNT];
+		std::atomic<unsigned long long> rateLimited;
+};
+
+#endif // DEBUGLOG_H
@@ -0,0 +1,176 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <thread>
+#include <algorithm>
+#include <math.h>
+
+#include "densitygrid.h"
+
+	DensityGrid::DensityGrid()
+:rows(0), cols(0), viewX(0), viewY(0), viewWidth(1), viewHeight(1), inside(0)
+{
+}
+
+/**
+ * Set the size of the grid, the counts are cleared.
+ * @param rows amount of rows, screen lines.
+ * @param cols amount of columns, screen columns.
+ */
+void DensityGrid::resize(int rows, int cols){
+	this->rows = std::max(rows, 0);
+	this->cols = std::max(cols, 0);
+	cells.assign((size_t)this->rows * this->cols, 0);
+	inside = 0;
+}
+
+/**
+ * Set the region of the map covered by the grid.
+ * @param x left edge of the view [m].
+ * @param y top edge of the view [m].
+ * @param width width of the view [m].
+ * @param height height of the view [m].
+ */
+void DensityGrid::setView(double x, double y, double width, double height){
+	viewX = x;
+	viewY = y;
+	viewWidth = width > 0 ? width : 1;
+	viewHeight = height > 0 ? height : 1;
+}
+
+/**
+ * Clear the counts, the size and view are kept.
+ */
+void DensityGrid::clear(){
+	std::fill(cells.begin(), cells.end(), 0);
+	inside = 0;
+}
+
+/**
+ * Count the positions within the view.
+ * Above PARALLEL_CHUNK positions the arrays are split between threads.
+ * @param xs x positions.
+ * @param ys y positions, same length as xs.
+ */
+void DensityGrid::add(const std::vector<double> &xs, const std::vector<double> &ys){
+	size_t amount = std::min(xs.size(), ys.size());
+	if(cells.empty() || amount == 0)
+		return;
+
+	size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+	threads = std::min(threads, (amount + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK);
+	if(threads <= 1){
+		inside += addRange(xs, ys, 0, amount, &cells[0]);
+		return;
+	}
+
+	//the calling thread takes the first share, into the grid itself:
+	size_t share = (amount + threads - 1) / threads;
+	partials.resize(threads - 1);
+	std::vector<unsigned long long> counted(threads - 1, 0);
+	std::vector<std::thread> helpers;
+	for(size_t i = 1; i < threads; i++){
+		std::vector<unsigned int> &partial = partials[i-1];
+		partial.assign(cells.size(), 0);
+		size_t begin = std::min(i * share, amount);
+		size_t end = std::min(begin + share, amount);
+		unsigned long long *count = &counted[i-1];
+		helpers.push_back(std::thread([this, &xs, &ys, &partial, begin, end, count](){
+					*count = addRange(xs, ys, begin, end, &partial[0]);
+					}));
+	}
+	inside += addRange(xs, ys, 0, std::min(share, amount), &cells[0]);
+
+	for(size_t i = 0; i < helpers.size(); i++){
+		helpers[i].join();
+		const std::vector<unsigned int> &partial = partials[i];
+		for(size_t j = 0; j < cells.size(); j++)
+			cells[j] += partial[j];
+		inside += counted[i];
+	}
+}
+
+/**
+ * Add the counts of another grid of the same size and view.
+ */
+void DensityGrid::add(const DensityGrid &grid){
+	if(grid.cells.size() != cells.size())
+		return;
+	for(size_t i = 0; i < cells.size(); i++)
+		cells[i] += grid.cells[i];
+	inside += grid.inside;
+}
+
+/**
+ * Count a range of the positions into a grid.
+ * @return amount of positions within the view.
+ */
+unsigned long long DensityGrid::addRange(const std::vector<double> &xs,
+		const std::vector<double> &ys, size_t begin, size_t end,
+		unsigned int *counts) const{
+	const double scaleX = cols / viewWidth;
+	const double scaleY = rows / viewHeight;
+	const double right = viewX + viewWidth;
+	const double bottom = viewY + viewHeight;
+	unsigned long long counted = 0;
+
+	for(size_t i = begin; i < end; i++){
+		double x = xs[i];
+		double y = ys[i];
+		if(x < viewX || x > right || y < viewY || y > bottom)
+			continue;
+		//positions on the far edges land in the last cell:
+		int col = std::min((int)((x - viewX) * scaleX), cols - 1);
+		int row = std::min((int)((y - viewY) * scaleY), rows - 1);
+		counts[row*cols + col]++;
+		counted++;
+	}
+	return counted;
+}
+
+/**
+ * Get the highest count of a cell.
+ */
+unsigned int DensityGrid::getMax() const{
+	unsigned int max = 0;
+	for(size_t i = 0; i < cells.size(); i++)
+		max = std::max(max, cells[i]);
+	return max;
+}
+
+/**
+ * Map a count to a level of a logarithmic ramp.
+ * Level 0 is an empty cell, the other counts are spread over the levels
+ * 1 to levels-1 by log(1+count)/log(1+max), so a few crowded cells do not
+ * hide the sparse ones.
+ * @param count count of the cell.
+ * @param max highest count of the grid, see getMax().
+ * @param levels amount of levels in the ramp, at least 2.
+ * @return the level, 0 to levels-1.
+ */
+int DensityGrid::level(unsigned int count, unsigned int max, int levels){
+	if(count == 0 || levels < 2)
+		return 0;
+	if(max <= 1)
+		return levels - 1;
+	double share = log1p((double)count) / log1p((double)max);
+	return std::min(1 + (int)(share * (levels - 1)), levels - 1);
+}
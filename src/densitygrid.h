@@ -0,0 +1,74 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef DENSITYGRID_H
+#define DENSITYGRID_H
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * Density grid of auton positions.
+ * Counts the positions falling in each cell of a grid laid over a
+ * rectangular view of the map, the grid has the size of the screen, so
+ * drawing it does not depend on the population. Large populations are
+ * counted in parallel, each thread into a grid of its own which are summed
+ * afterwards.
+ */
+class DensityGrid
+{
+	public:
+		DensityGrid();
+
+		void resize(int rows, int cols);
+		void setView(double x, double y, double width, double height);
+		void clear();
+		void add(const std::vector<double> &xs, const std::vector<double> &ys);
+		void add(const DensityGrid &grid);
+
+		int getRows() const { return rows; }
+		int getCols() const { return cols; }
+		unsigned int at(int row, int col) const { return cells[row*cols + col]; }
+		unsigned int getMax() const;
+		unsigned long long getInside() const { return inside; }
+		static int level(unsigned int count, unsigned int max, int levels);
+
+		//positions counted by each thread, below this it is done serially:
+		static const size_t PARALLEL_CHUNK = 65536;
+
+	private:
+		unsigned long long addRange(const std::vector<double> &xs,
+				const std::vector<double> &ys, size_t begin, size_t end,
+				unsigned int *counts) const;
+
+		int rows;
+		int cols;
+		double viewX;
+		double viewY;
+		double viewWidth;
+		double viewHeight;
+		std::vector<unsigned int> cells;
+		//grids of the helper threads, kept between calls:
+		std::vector< std::vector<unsigned int> > partials;
+		unsigned long long inside;
+};
+
+#endif // DENSITYGRID_H
@@ -26,18 +26,24 @@
 #include<string.h>
 #include<stdio.h>
 #include<chrono>
+#include<algorithm>
+#include<thread>
 
 #include"output.h"
 
 #include"auton.h"
-#include"ID.h"
-#include"phys.h"
-
-	EventQueue::EventQueue()
-:eSize(0), iSize(0)
+#include"simcontext.h"
+#include"kaswriter.h"
+#include"kasformat.h"
+#include"exportfilter.h"
+
+	EventQueue::EventQueue(SimContext *ctx)
+:ctx(ctx), writer(NULL), kasVersion(KasFormat::VERSION), streamedAmount(0),
+	eSize(0), iSize(0)
 {
-	iMap = new std::unordered_map<unsigned long long, iEvents>();
-	eMap = new std::unordered_map<unsigned long long, eEvents>();
+	filter = new ExportFilter();
+	iMap = new iEventMap();
+	eMap = new eEventMap();
 }
 
 /**
@@ -47,19 +53,23 @@
  */
 EventQueue::~EventQueue(){
 
+	finishStream();
+
 	for(iMapIt = iMap->begin(); iMapIt != iMap->end(); ++iMapIt){
-		std::list<iEvent *> tmplist = iMapIt->second;
+		iEvents &tmplist = iMapIt->second;
 		if(!tmplist.empty()){
-			std::list<iEvent *>::iterator tmplistItr;
+			iEvents::iterator tmplistItr;
 			for(tmplistItr = tmplist.begin();tmplistItr != tmplist.end();++tmplistItr){
+				//causes that have been streamed are only deleted here:
+				releaseCause(*tmplistItr);
 				delete *tmplistItr;
 			}
 		}
 	}
 	for(eMapIt = eMap->begin(); eMapIt != eMap->end(); ++eMapIt){
-		std::list<eEvent *> tmplist = eMapIt->second;
+		eEvents &tmplist = eMapIt->second;
 		if(!tmplist.empty()){
-			std::list<eEvent *>::iterator tmplistItr;
+			eEvents::iterator tmplistItr;
 			for(tmplistItr = tmplist.begin();tmplistItr != tmplist.end();++tmplistItr){
 				delete *tmplistItr;
 			}
@@ -67,6 +77,7 @@ EventQueue::~EventQueue(){
 	}
 	delete iMap;
 	delete eMap;
+	delete filter;
 
 	Output::Inst()->kprintf("EventQueue Cleared\n");
 }
@@ -84,6 +95,12 @@ EventQueue::~EventQueue(){
  */
 void EventQueue::insertEEvent(eEvent *event){
 	eSize++;
+	if(event->payloadBytes == 0){
+		event->payloadBytes = MemAccount::stringBytes(event->table)
+			+ MemAccount::stringBytes(event->desc);
+		if(event->payloadBytes > 0)
+			MemAccount::allocated(MemAccount::STRINGS, event->payloadBytes);
+	}
 	unsigned long long tmu = event->activationTime;
 	//Output::Inst()->kprintf("eTMU inserted %lld \n", tmu);
 	//if the tmu position is empty:
@@ -102,7 +119,7 @@ void EventQueue::insertEEvent(eEvent *event){
 			activeTmu.push_front(tmu);
 		}else{	//do insertion sort:
 			bool inserted = false;	
-			std::list<unsigned long long>::iterator activeIt;
+			tmuList::iterator activeIt;
 
 			for(activeIt = activeTmu.begin(); activeIt!=activeTmu.end(); activeIt++){
 				if(*activeIt > tmu){
@@ -125,7 +142,8 @@ void EventQueue::insertEEvent(eEvent *event){
  * @returns event list at current tmu index in the hashmap, or NULL if there isn't an eventlist 
  */
 std::list<EventQueue::eEvent*> EventQueue::getEEventList(unsigned long long tmu){
-	std::list<eEvent*> eeList = eMap->find(tmu)->second;
+	eEvents &bucket = eMap->find(tmu)->second;
+	std::list<eEvent*> eeList(bucket.begin(), bucket.end());
 	return eeList;
 }
 
@@ -160,6 +178,13 @@ bool EventQueue::eEventsAtTime(unsigned long long tmu){
 void EventQueue::insertIEvent(iEvent *event){
 	//put event in hashmap.
 	iSize++;
+	if(event->payloadBytes == 0){
+		event->payloadBytes = MemAccount::stringBytes(event->desc);
+		if(event->payloadBytes > 0)
+			MemAccount::allocated(MemAccount::STRINGS, event->payloadBytes);
+	}
+	if(event->event != NULL)
+		event->event->pendingIEvents++;
 	unsigned long long tmu = event->activationTime;
 
 	if(iMap->find(tmu) == iMap->end()){
@@ -175,7 +200,7 @@ void EventQueue::insertIEvent(iEvent *event){
 		if(activeTmu.empty()){
 			activeTmu.push_front(tmu);
 		}else{
-			std::list<unsigned long long>::iterator activeIt;
+			tmuList::iterator activeIt;
 			bool inserted = false;			
 			//do insertion sort:
 			for(activeIt = activeTmu.begin(); activeIt!=activeTmu.end(); activeIt++){
@@ -202,7 +227,8 @@ void EventQueue::insertIEvent(iEvent *event){
  * @returns event list at current tmu index in the hashmap, or NULL if there isn't an eventlist 
  */
 std::list<EventQueue::iEvent*> EventQueue::getIEventList(unsigned long long tmu){
-	std::list<iEvent*> ieList = iMap->find(tmu)->second;
+	iEvents &bucket = iMap->find(tmu)->second;
+	std::list<iEvent*> ieList(bucket.begin(), bucket.end());
 	return ieList;
 }
 
@@ -265,7 +291,8 @@ unsigned long long EventQueue::getISize(){
  * events which contains their LUA distribution function this files
  * data will be visualized in the data tool.
  * It also saves an information struct with relevant information
- * on the simulation itself.
+ * on the simulation itself. The events are written ordered by 
+ * activation time, ties broken by id.
  * @see EventQueue::simInfo.
  * @param filename filename of the saved file '<filename>.kas',
  * @param luaFileName the filename of the lua auton.
@@ -278,56 +305,294 @@ void EventQueue::saveEEventData(std::string name, std::string luaFileName,
 	std::string ext = ".kas";
 	std::string filename = name + ext;
 
+	if(!streamFile.empty()){
+		Output::Inst()->kprintf("Event data has been streamed to: %s\n", streamFile.c_str());
+		return;
+	}
+
 	//Open the file and set the options:
 	std::ofstream file (filename.c_str(), std::ofstream::binary | std::ofstream::trunc);
-	int bufferLimit = 100000;
 
-	Output::Inst()->kprintf("Saving event data to file:  %s\n" , filename.c_str());
+	Output::Inst()->kprintf("Saving event data to file:  %s (kas version %d)\n",
+			filename.c_str(), kasVersion);
+
+	this->luaFileName = luaFileName;
+	this->autonAmount = autonAmount;
+	this->areaY = areaY;
+	this->areaX = areaX;
+	simInfo dataInfo = makeSimInfo();
+
+	//collect the records of the exported events, in time order:
+	std::vector<dataEvent> events;
+	filter->restart();
+	collectDataEvents(events);
+	dataInfo.eventAmount = events.size();
+	if(filter->isActive())
+		Output::Inst()->kprintf("Export filter selected %llu of %llu events\n",
+				(unsigned long long)events.size(), eSize);
+
+	if(kasVersion == 1){
+		KasFormat::writeV1(file, dataInfo, events);
+	} else{
+		KasFormat::writeHeader(file, dataInfo);
+		for(size_t i = 0; i < events.size(); i += KasFormat::BLOCK_EVENTS){
+			size_t amount = std::min<size_t>(KasFormat::BLOCK_EVENTS, events.size() - i);
+			KasFormat::writeBlock(file, &events[i], amount);
+		}
+	}
+	Output::Inst()->kprintf("Saving data done\n");
 
-	std::string buffer;
+}
 
-	//first save the dataEvent to the file:
+/**
+ * Make the simInfo header of a .kas file.
+ */
+EventQueue::simInfo EventQueue::makeSimInfo(){
 	simInfo dataInfo;
 	strncpy(dataInfo.luaFileName, luaFileName.c_str(),250);
 	dataInfo.eventAmount = eSize;
 	dataInfo.numberOfAutons = autonAmount;
-	dataInfo.timeResolution = 1/Phys::getTimeRes();
-	dataInfo.macroFactor = Phys::getMacroFactor();
-	dataInfo.tmuAmount = Phys::getCTime();
+	dataInfo.timeResolution = 1/ctx->phys.getTimeRes();
+	dataInfo.macroFactor = ctx->phys.getMacroFactor();
+	dataInfo.tmuAmount = ctx->phys.getCTime();
 	dataInfo.areaY = areaY;
 	dataInfo.areaX = areaX;
+	return dataInfo;
+}
 
-	Output::Inst()->kprintf("\nsize stuff %d \n", dataInfo.areaX);
+/**
+ * Copy an external event to its .kas record.
+ */
+void EventQueue::makeDataEvent(eEvent *event, dataEvent &devent){
+	devent.id = event->id;
+	devent.activationTime = event->activationTime;
+	devent.duration = event->duration;
+	devent.originX = event->posX;
+	devent.originY = event->posY;
+	devent.originID = event->origin->getID();
+	devent.propagationSpeed = event->propagationSpeed;
+	strncpy(devent.desc,event->desc.c_str(),150);
+	strncpy(devent.table,event->table.c_str(),500);
+}
 
-	file.write(reinterpret_cast<char*>(&dataInfo),sizeof(dataInfo));
+/**
+ * Export order of the external events, by activation time and then id.
+ */
+bool EventQueue::eventBefore(const eEvent *a, const eEvent *b){
+	if(a->activationTime != b->activationTime)
+		return a->activationTime < b->activationTime;
+	return a->id < b->id;
+}
+
+/**
+ * Run a function over ranges of [0, size) in parallel.
+ * The ranges are split at the given offsets, so each holds about the
+ * same number of elements.
+ * @param offsets ascending element offsets of the size+1 range borders.
+ * @param function called with (first, last) for each range.
+ */
+template <class F>
+static void parallelRanges(const std::vector<size_t> &offsets, F function){
+	size_t size = offsets.size() - 1;
+	size_t total = offsets.back();
+
+	//no more threads than there are chunks of ~10000 elements:
+	size_t threadAmount = std::max(1u, std::thread::hardware_concurrency());
+	threadAmount = std::min(threadAmount, total / 10000 + 1);
+
+	std::vector<std::thread> threads;
+	size_t first = 0;
+	for(size_t t = 1; t < threadAmount; t++){
+		size_t last = std::upper_bound(offsets.begin(), offsets.end(),
+				total * t / threadAmount) - offsets.begin() - 1;
+		if(last > first){
+			threads.push_back(std::thread(function, first, last));
+			first = last;
+		}
+	}
+	function(first, size);
+
+	for(size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+}
 
-	//then save all the external events:
+/**
+ * Make the records of the exported external events in the queue.
+ * The records are ordered by activation time, ties broken by id. The
+ * tmu buckets are sorted by their key, then split into contiguous 
+ * ranges of about the same number of events. Each range is sorted and
+ * filtered in parallel, the every-Nth sampling is applied in order, and
+ * the remaining events are converted in parallel, each thread writing 
+ * its own part of the vector.
+ * @param events set to the records.
+ */
+void EventQueue::collectDataEvents(std::vector<dataEvent> &events){
+	std::vector< std::pair<unsigned long long, eEvents*> > buckets;
+	buckets.reserve(eMap->size());
 	for(eMapIt = eMap->begin(); eMapIt != eMap->end(); ++eMapIt){
-		std::list<eEvent *> tmplist = eMapIt->second;
-		if(!tmplist.empty()){
-			std::list<eEvent *>::iterator tmplistItr;
-			for(tmplistItr = tmplist.begin();tmplistItr != tmplist.end();++tmplistItr){
-				eEvent* tmp = *tmplistItr;
+		if(!eMapIt->second.empty())
+			buckets.push_back(std::make_pair(eMapIt->first, &eMapIt->second));
+	}
+	std::sort(buckets.begin(), buckets.end());
+
+	std::vector<size_t> offsets(buckets.size() + 1, 0);
+	for(size_t b = 0; b < buckets.size(); b++)
+		offsets[b+1] = offsets[b] + buckets[b].second->size();
+
+	//sort and filter the buckets:
+	std::vector<eEvent*> sorted(offsets.back());
+	std::vector<char> matched(offsets.back());
+	parallelRanges(offsets, [&](size_t first, size_t last){
+		for(size_t b = first; b < last; b++){
+			std::vector<eEvent*>::iterator begin = sorted.begin() + offsets[b];
+			std::copy(buckets[b].second->begin(), buckets[b].second->end(), begin);
+			std::sort(begin, sorted.begin() + offsets[b+1], eventBefore);
+			for(size_t i = offsets[b]; i < offsets[b+1]; i++)
+				matched[i] = filter->match(sorted[i]);
+		}
+	});
+
+	std::vector<eEvent*> selected;
+	selected.reserve(sorted.size());
+	for(size_t i = 0; i < sorted.size(); i++){
+		if(matched[i] && filter->sample())
+			selected.push_back(sorted[i]);
+	}
+
+	//convert the selected events:
+	events.resize(selected.size());
+	std::vector<size_t> chunks;
+	for(size_t i = 0; i < selected.size(); i += 1024)
+		chunks.push_back(i);
+	chunks.push_back(selected.size());
+	parallelRanges(chunks, [&](size_t first, size_t last){
+		for(size_t i = chunks[first]; i < chunks[last]; i++)
+			makeDataEvent(selected[i], events[i]);
+	});
+}
+
+/**
+ * Start streaming the external events to a .kas file.
+ * From now on the events are written by a KasWriter as their microstep
+ * is completed, and removed from the queue, instead of being kept until 
+ * saveEEventData is called.
+ * @see EventQueue::saveEEventData for the parameters.
+ */
+void EventQueue::startStream(std::string name, std::string luaFileName,
+		int autonAmount, double areaY, double areaX){
+	finishStream();
+
+	this->luaFileName = luaFileName;
+	this->autonAmount = autonAmount;
+	this->areaY = areaY;
+	this->areaX = areaX;
+
+	streamFile = name + ".kas";
+	streamedAmount = 0;
+	filter->restart();
+	writer = new KasWriter();
+	if(!writer->open(streamFile, makeSimInfo(), kasVersion)){
+		delete writer;
+		writer = NULL;
+		streamFile.clear();
+		return;
+	}
+	Output::Inst()->kprintf("Streaming event data to file:  %s\n", streamFile.c_str());
+}
+
+/**
+ * Stream the events of a completed microstep.
+ * The external events are handed to the writer and deleted, unless an 
+ * internal event caused by them is still pending, and the handled 
+ * internal events are deleted.
+ * @param tmu the completed microstep.
+ */
+void EventQueue::streamEvents(unsigned long long tmu){
+	if(writer == NULL)
+		return;
+
+	eMapIt = eMap->find(tmu);
+	if(eMapIt != eMap->end()){
+		std::vector<eEvent *> bucket(eMapIt->second.begin(), eMapIt->second.end());
+		std::sort(bucket.begin(), bucket.end(), eventBefore);
+
+		for(size_t i = 0; i < bucket.size(); i++){
+			if(filter->match(bucket[i]) && filter->sample()){
 				dataEvent devent;
-				devent.id = tmp->id;
-				devent.activationTime = tmp->activationTime;
-				devent.duration = tmp->duration;
-				devent.originX = tmp->posX;
-				devent.originY = tmp->posY;
-				devent.originID = tmp->origin->getID();
-				devent.propagationSpeed = tmp->propagationSpeed;
-				strncpy(devent.desc,tmp->desc.c_str(),150);
-				strncpy(devent.table,tmp->table.c_str(),500);
-
-				//Output::Inst()->kprintf("Propagation %f\n", devent.propagationSpeed);				
-
-				file.write(reinterpret_cast<char*>(&devent),sizeof(devent));
-			}	
-		} else{
+				makeDataEvent(bucket[i], devent);
+				writer->write(devent);
+				streamedAmount++;
+			}
+
+			bucket[i]->retired = true;
+			if(bucket[i]->pendingIEvents == 0)
+				delete bucket[i];
 		}
+		eMap->erase(eMapIt);
 	}
-	Output::Inst()->kprintf("Saving data done\n");
 
+	iMapIt = iMap->find(tmu);
+	if(iMapIt != iMap->end()){
+		iEvents::iterator it;
+		for(it = iMapIt->second.begin(); it != iMapIt->second.end(); ++it){
+			releaseCause(*it);
+			delete *it;
+		}
+		iMap->erase(iMapIt);
+	}
+}
+
+/**
+ * Write the events left in the queue, and close the stream.
+ * The header is written last, with the final number of events.
+ */
+void EventQueue::finishStream(){
+	if(writer == NULL)
+		return;
+
+	std::vector<dataEvent> events;
+	collectDataEvents(events);
+	for(size_t i = 0; i < events.size(); i++)
+		writer->write(events[i]);
+
+	simInfo dataInfo = makeSimInfo();
+	dataInfo.eventAmount = streamedAmount + events.size();
+	writer->close(dataInfo);
+	delete writer;
+	writer = NULL;
+	Output::Inst()->kprintf("Streaming data done\n");
+}
+
+/**
+ * Set the .kas version written by saveEEventData and startStream.
+ * @param version 1 for the fixed size records, or 2, the default.
+ * @see KasFormat
+ */
+void EventQueue::setKasVersion(int version){
+	kasVersion = version == 1 ? 1 : KasFormat::VERSION;
+}
+
+/**
+ * Set the filter of saved and streamed event data.
+ * @see ExportFilter
+ */
+void EventQueue::setExportFilter(const ExportFilter &filter){
+	*this->filter = filter;
+}
+
+/**
+ * Release the external event that caused an internal event.
+ * The cause is deleted if it has been streamed, and this was the last
+ * internal event referring to it.
+ */
+void EventQueue::releaseCause(iEvent *event){
+	eEvent *cause = event->event;
+	if(cause == NULL)
+		return;
+
+	cause->pendingIEvents--;
+	if(cause->retired && cause->pendingIEvents == 0)
+		delete cause;
 }
 
 /**
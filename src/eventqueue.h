@@ -29,11 +29,16 @@
 #include <string>
 #include <unordered_set>
 
+#include "memaccount.h"
+
 class Auton;
+class SimContext;
+class KasWriter;
+class ExportFilter;
 class EventQueue
 {
 	public:
-		EventQueue(); 
+		EventQueue(SimContext *ctx); 
 		~EventQueue();
 
 		struct simInfo{
@@ -59,6 +64,25 @@ class EventQueue
 			std::string desc;
 			unsigned long long activationTime;
 			//double funcArray[11];
+			//internal events caused by this event, that are not handled yet:
+			unsigned int pendingIEvents = 0;
+			//set when the event has been streamed and left the queue:
+			bool retired = false;
+			//heap memory of table and desc, counted while queued:
+			size_t payloadBytes = 0;
+
+			~eEvent(){
+				if(payloadBytes > 0)
+					MemAccount::freed(MemAccount::STRINGS, payloadBytes);
+			}
+			static void* operator new(size_t size){
+				MemAccount::allocated(MemAccount::EVENTS, size);
+				return ::operator new(size);
+			}
+			static void operator delete(void *ptr, size_t size){
+				MemAccount::freed(MemAccount::EVENTS, size);
+				::operator delete(ptr);
+			}
 		};
 
 		//define the internal Event:
@@ -68,6 +92,21 @@ class EventQueue
 			unsigned long long activationTime;
 			unsigned long long id;
 			std::string desc;
+			//heap memory of desc, counted while queued:
+			size_t payloadBytes = 0;
+
+			~iEvent(){
+				if(payloadBytes > 0)
+					MemAccount::freed(MemAccount::STRINGS, payloadBytes);
+			}
+			static void* operator new(size_t size){
+				MemAccount::allocated(MemAccount::EVENTS, size);
+				return ::operator new(size);
+			}
+			static void operator delete(void *ptr, size_t size){
+				MemAccount::freed(MemAccount::EVENTS, size);
+				::operator delete(ptr);
+			}
 		};
 
 		//define the data event, precisely the same as events:
@@ -111,29 +150,65 @@ class EventQueue
 		void saveEEventData(std::string filename, std::string luaFileName, 
 				int autonAmount, double areaY, double areaX);
 
+		//streaming events to a binary file during the run:
+		void startStream(std::string filename, std::string luaFileName,
+				int autonAmount, double areaY, double areaX);
+		void streamEvents(unsigned long long tmu);
+		void finishStream();
+		//.kas version to write, 1 or 2:
+		void setKasVersion(int version);
+		void setExportFilter(const ExportFilter &filter);
+
 		//check the size of the eventQueue:
 		unsigned long long getESize();
 		unsigned long long getISize();
 
 	private:
 		void printTest();
-		//the eventmaps, (event):
-		typedef std::list<eEvent *> eEvents;
-		typedef std::list<iEvent *> iEvents;
+		simInfo makeSimInfo();
+		static void makeDataEvent(eEvent *event, dataEvent &devent);
+		static bool eventBefore(const eEvent *a, const eEvent *b);
+		void collectDataEvents(std::vector<dataEvent> &events);
+		void releaseCause(iEvent *event);
+		SimContext *ctx;
+
+		//the stream writer, and the simInfo fields for its header:
+		KasWriter *writer;
+		std::string streamFile;
+		std::string luaFileName;
+		int autonAmount;
+		double areaY;
+		double areaX;
+		int kasVersion;
+		ExportFilter *filter;
+		unsigned long long streamedAmount;
+		//the eventmaps, (event), counted as queue memory:
+		typedef std::list<eEvent *, TaggedAllocator<eEvent *, MemAccount::QUEUE> > eEvents;
+		typedef std::list<iEvent *, TaggedAllocator<iEvent *, MemAccount::QUEUE> > iEvents;
+		typedef std::unordered_map<unsigned long long, iEvents,
+			std::hash<unsigned long long>, std::equal_to<unsigned long long>,
+			TaggedAllocator<std::pair<const unsigned long long, iEvents>, MemAccount::QUEUE> > iEventMap;
+		typedef std::unordered_map<unsigned long long, eEvents,
+			std::hash<unsigned long long>, std::equal_to<unsigned long long>,
+			TaggedAllocator<std::pair<const unsigned long long, eEvents>, MemAccount::QUEUE> > eEventMap;
+		typedef std::list<unsigned long long,
+			TaggedAllocator<unsigned long long, MemAccount::QUEUE> > tmuList;
 		//the eventqueues, (tmu, eventmap):
-		std::unordered_map<unsigned long long,iEvents> *iMap;
-		std::unordered_map<unsigned long long,eEvents> *eMap;
+		iEventMap *iMap;
+		eEventMap *eMap;
 		//iterators:
-		std::unordered_map<unsigned long long,iEvents>::iterator iMapIt;
-		std::unordered_map<unsigned long long,eEvents>::iterator eMapIt;
+		iEventMap::iterator iMapIt;
+		eEventMap::iterator eMapIt;
 		//time keeper lists:
-		std::list<unsigned long long> activeTmu;
-		std::list<unsigned long long> legacyTmu;
-		std::list<unsigned long long>::iterator legacyIt;
-		std::list<unsigned long long>::iterator activeIt;
+		tmuList activeTmu;
+		tmuList legacyTmu;
+		tmuList::iterator legacyIt;
+		tmuList::iterator activeIt;
 
 		//time keeper hash:
-		std::unordered_set<unsigned long long> tmuSet;
+		std::unordered_set<unsigned long long,
+			std::hash<unsigned long long>, std::equal_to<unsigned long long>,
+			TaggedAllocator<unsigned long long, MemAccount::QUEUE> > tmuSet;
 
 		//size of the eventqueue:
 		unsigned long long eSize;
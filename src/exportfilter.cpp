@@ -0,0 +1,162 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <sstream>
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <math.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "exportfilter.h"
+#include "auton.h"
+#include "output.h"
+
+namespace {
+	//splitmix64 finalizer, spreads sequential ids over the full range:
+	unsigned long long hashID(unsigned long long id){
+		id += 0x9e3779b97f4a7c15ULL;
+		id = (id ^ (id >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		id = (id ^ (id >> 27)) * 0x94d049bb133111ebULL;
+		return id ^ (id >> 31);
+	}
+
+	std::set<std::string> split(std::string list){
+		std::set<std::string> items;
+		std::stringstream stream(list);
+		std::string item;
+		while(std::getline(stream, item, ','))
+			if(!item.empty())
+				items.insert(item);
+		return items;
+	}
+}
+
+	ExportFilter::ExportFilter()
+:active(false), useTmu(false), fromTmu(0), toTmu(0), useBox(false),
+	minX(0), minY(0), maxX(0), maxY(0), every(1), counter(0), sampleLimit(~0ULL)
+{
+}
+
+/**
+ * Parse a filter specification.
+ * @see ExportFilter for the format.
+ * @return false if the specification has an error, the filter is then
+ * left inactive.
+ */
+bool ExportFilter::parse(std::string spec){
+	*this = ExportFilter();
+
+	std::stringstream stream(spec);
+	std::string term;
+	while(std::getline(stream, term, ';')){
+		if(term.empty())
+			continue;
+		size_t eq = term.find('=');
+		if(eq == std::string::npos || !parseTerm(term.substr(0, eq), term.substr(eq+1))){
+			Output::Inst()->kprintf("Invalid export filter term '%s'\n", term.c_str());
+			*this = ExportFilter();
+			return false;
+		}
+		active = true;
+	}
+	return true;
+}
+
+bool ExportFilter::parseTerm(std::string key, std::string value){
+	if(key.compare("desc") == 0){
+		descs = split(value);
+		return !descs.empty();
+	}
+	if(key.compare("origin") == 0){
+		std::set<std::string> ids = split(value);
+		std::set<std::string>::iterator it;
+		for(it = ids.begin(); it != ids.end(); ++it){
+			char *end;
+			errno = 0;
+			long id = strtol(it->c_str(), &end, 10);
+			if(errno != 0 || *end != '\0' || id < 0 || id > INT_MAX)
+				return false;
+			originIDs.insert((int)id);
+		}
+		return !originIDs.empty();
+	}
+	if(key.compare("tmu") == 0){
+		size_t dash = value.find('-');
+		if(dash == std::string::npos)
+			return false;
+		fromTmu = strtoull(value.substr(0, dash).c_str(), NULL, 10);
+		toTmu = strtoull(value.substr(dash+1).c_str(), NULL, 10);
+		useTmu = true;
+		return fromTmu <= toTmu;
+	}
+	if(key.compare("box") == 0){
+		if(sscanf(value.c_str(), "%lf,%lf,%lf,%lf", &minX, &minY, &maxX, &maxY) != 4)
+			return false;
+		if(minX > maxX) std::swap(minX, maxX);
+		if(minY > maxY) std::swap(minY, maxY);
+		useBox = true;
+		return true;
+	}
+	if(key.compare("every") == 0){
+		every = strtoull(value.c_str(), NULL, 10);
+		return every > 0;
+	}
+	if(key.compare("sample") == 0){
+		double fraction = atof(value.c_str());
+		if(fraction <= 0 || fraction > 1)
+			return false;
+		sampleLimit = fraction >= 1 ? ~0ULL : (unsigned long long)ldexp(fraction, 64);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Test the predicates and the hash sampling of an event.
+ * It has no state, so events can be tested in parallel.
+ */
+bool ExportFilter::match(const EventQueue::eEvent *event) const{
+	if(!active)
+		return true;
+	if(useTmu && (event->activationTime < fromTmu || event->activationTime > toTmu))
+		return false;
+	if(useBox && (event->posX < minX || event->posX > maxX 
+				|| event->posY < minY || event->posY > maxY))
+		return false;
+	if(!originIDs.empty() && originIDs.find(event->origin->getID()) == originIDs.end())
+		return false;
+	if(!descs.empty() && descs.find(event->desc) == descs.end())
+		return false;
+	return sampleLimit == ~0ULL || hashID(event->id) < sampleLimit;
+}
+
+/**
+ * Every-Nth sampling.
+ * Must be called in export order for each event that matched.
+ * @return true if the event should be written.
+ */
+bool ExportFilter::sample(){
+	if(every <= 1)
+		return true;
+	return counter++ % every == 0;
+}
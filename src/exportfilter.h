@@ -0,0 +1,76 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef EXPORTFILTER_H
+#define EXPORTFILTER_H
+
+#include <string>
+#include <set>
+
+#include "eventqueue.h"
+
+/**
+ * Selection of the external events written to .kas files.
+ * The filter is given as a list of 'key=value' terms separated by ';',
+ * all terms must match for an event to be written:
+ *
+ *	desc=call,chirp		only events with one of the descs
+ *	origin=12,40,41		only events from one of the autons
+ *	tmu=1000-50000		activation time within the range, inclusive
+ *	box=x1,y1,x2,y2		origin position within the box, inclusive
+ *	every=100		every 100th of the events matching the terms above
+ *	sample=0.01		a fraction of the events, chosen by a hash of
+ *				their id
+ *
+ * Both samplings are deterministic, every-Nth counts the events in the
+ * export order, so saved and streamed files of a run hold the same events.
+ */
+class ExportFilter
+{
+	public:
+		ExportFilter();
+
+		bool parse(std::string spec);
+		bool isActive(){ return active; }
+
+		//start counting for every-Nth sampling from the beginning:
+		void restart(){ counter = 0; }
+
+		bool match(const EventQueue::eEvent *event) const;
+		bool sample();
+
+	private:
+		bool parseTerm(std::string key, std::string value);
+
+		bool active;
+		std::set<std::string> descs;
+		std::set<int> originIDs;
+		bool useTmu;
+		unsigned long long fromTmu, toTmu;
+		bool useBox;
+		double minX, minY, maxX, maxY;
+		unsigned long long every;
+		unsigned long long counter;
+		//events are kept if the hash of their id is below this:
+		unsigned long long sampleLimit;
+};
+
+#endif // EXPORTFILTER_H
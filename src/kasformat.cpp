@@ -0,0 +1,463 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <map>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "kasformat.h"
+
+const char KasFormat::MAGIC[8] = {'\x89', 'K', 'A', 'S', '\r', '\n', '\x1a', '\n'};
+
+/* **********************************************************************
+ * PRIMITIVES
+ * ******************************************************************** */
+
+void KasFormat::putVarint(std::string &out, unsigned long long value){
+	while(value >= 0x80){
+		out.push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+void KasFormat::putU32(std::string &out, unsigned int value){
+	for(int i = 0; i < 4; i++)
+		out.push_back((char)(value >> (8*i)));
+}
+
+void KasFormat::putDouble(std::string &out, double value){
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	for(int i = 0; i < 8; i++)
+		out.push_back((char)(bits >> (8*i)));
+}
+
+void KasFormat::putString(std::string &out, const std::string &value){
+	putVarint(out, value.size());
+	out.append(value);
+}
+
+bool KasFormat::getVarint(const unsigned char *&p, const unsigned char *end,
+		unsigned long long &value){
+	value = 0;
+	for(int shift = 0; shift < 64; shift += 7){
+		if(p >= end)
+			return false;
+		unsigned char byte = *p++;
+		value |= (unsigned long long)(byte & 0x7f) << shift;
+		if(!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool KasFormat::getU32(const unsigned char *&p, const unsigned char *end,
+		unsigned int &value){
+	if(end - p < 4)
+		return false;
+	value = 0;
+	for(int i = 0; i < 4; i++)
+		value |= (unsigned int)*p++ << (8*i);
+	return true;
+}
+
+bool KasFormat::getDouble(const unsigned char *&p, const unsigned char *end,
+		double &value){
+	if(end - p < 8)
+		return false;
+	unsigned long long bits = 0;
+	for(int i = 0; i < 8; i++)
+		bits |= (unsigned long long)*p++ << (8*i);
+	memcpy(&value, &bits, sizeof(value));
+	return true;
+}
+
+bool KasFormat::getString(const unsigned char *&p, const unsigned char *end,
+		std::string &value){
+	unsigned long long length;
+	if(!getVarint(p, end, length) || (unsigned long long)(end - p) < length)
+		return false;
+	value.assign((const char*)p, length);
+	p += length;
+	return true;
+}
+
+/* **********************************************************************
+ * WRITING
+ * ******************************************************************** */
+
+/**
+ * Write the version 2 header.
+ * The header of a given simInfo always has the same size, so it can be
+ * written again at the start of the file when the run is done.
+ */
+void KasFormat::writeHeader(std::ostream &out, const EventQueue::simInfo &info){
+	std::string fields;
+	putVarint(fields, 9);
+
+	putString(fields, "luaFileName");
+	fields.push_back(FIELD_STRING);
+	putString(fields, std::string(info.luaFileName, strnlen(info.luaFileName, 
+					sizeof(info.luaFileName))));
+
+	const char *uintNames[] = {"eventAmount", "numberOfAutons", "macroFactor", 
+		"tmuAmount", "blockEvents"};
+	unsigned long long uintValues[] = {info.eventAmount, 
+		(unsigned long long)info.numberOfAutons, (unsigned long long)info.macroFactor,
+		info.tmuAmount, BLOCK_EVENTS};
+	for(int i = 0; i < 5; i++){
+		putString(fields, uintNames[i]);
+		fields.push_back(FIELD_UINT);
+		for(int j = 0; j < 8; j++)
+			fields.push_back((char)(uintValues[i] >> (8*j)));
+	}
+
+	const char *doubleNames[] = {"timeResolution", "areaY", "areaX"};
+	double doubleValues[] = {info.timeResolution, info.areaY, info.areaX};
+	for(int i = 0; i < 3; i++){
+		putString(fields, doubleNames[i]);
+		fields.push_back(FIELD_DOUBLE);
+		putDouble(fields, doubleValues[i]);
+	}
+
+	std::string header(MAGIC, sizeof(MAGIC));
+	putU32(header, VERSION);
+	putU32(header, fields.size());
+	header.append(fields);
+	out.write(header.data(), header.size());
+}
+
+/**
+ * Encode and write a block of events.
+ * The block is compressed if zlib is available and it makes the block
+ * smaller.
+ * @param events the events of the block.
+ * @param amount number of events, at most BLOCK_EVENTS.
+ */
+void KasFormat::writeBlock(std::ostream &out, const EventQueue::dataEvent *events,
+		unsigned int amount){
+	if(amount == 0)
+		return;
+
+	//intern the strings of the block:
+	std::map<std::string, unsigned int> stringIndex;
+	std::vector<const std::string*> strings;
+	std::vector<unsigned int> refs(amount * 2);
+
+	for(unsigned int i = 0; i < amount; i++){
+		std::string values[2] = {
+			std::string(events[i].desc, strnlen(events[i].desc, sizeof(events[i].desc))),
+			std::string(events[i].table, strnlen(events[i].table, sizeof(events[i].table)))
+		};
+		for(int j = 0; j < 2; j++){
+			std::pair<std::map<std::string, unsigned int>::iterator, bool> it =
+				stringIndex.insert(std::make_pair(values[j], (unsigned int)strings.size()));
+			if(it.second)
+				strings.push_back(&it.first->first);
+			refs[i*2 + j] = it.first->second;
+		}
+	}
+
+	std::string payload;
+	putVarint(payload, strings.size());
+	for(unsigned int i = 0; i < strings.size(); i++)
+		putString(payload, *strings[i]);
+
+	unsigned long long prevTime = 0, prevID = 0;
+	for(unsigned int i = 0; i < amount; i++){
+		const EventQueue::dataEvent &e = events[i];
+		putVarint(payload, zigzag((long long)(e.activationTime - prevTime)));
+		putVarint(payload, zigzag((long long)(e.id - prevID)));
+		putVarint(payload, (unsigned int)e.originID);
+		putDouble(payload, e.duration);
+		putDouble(payload, e.propagationSpeed);
+		putDouble(payload, e.originX);
+		putDouble(payload, e.originY);
+		putVarint(payload, refs[i*2]);
+		putVarint(payload, refs[i*2 + 1]);
+		prevTime = e.activationTime;
+		prevID = e.id;
+	}
+
+	unsigned char codec = CODEC_RAW;
+	std::string stored;
+#ifdef HAVE_ZLIB
+	uLongf compressedSize = compressBound(payload.size());
+	stored.resize(compressedSize);
+	if(compress2((Bytef*)&stored[0], &compressedSize, (const Bytef*)payload.data(),
+				payload.size(), Z_DEFAULT_COMPRESSION) == Z_OK
+			&& compressedSize < payload.size()){
+		stored.resize(compressedSize);
+		codec = CODEC_ZLIB;
+	}
+#endif
+	if(codec == CODEC_RAW)
+		stored.swap(payload);
+
+	std::string header;
+	header.push_back(codec);
+	putVarint(header, amount);
+	putVarint(header, codec == CODEC_RAW ? stored.size() : payload.size());
+	putVarint(header, stored.size());
+	out.write(header.data(), header.size());
+	out.write(stored.data(), stored.size());
+}
+
+/**
+ * Write a version 1 file.
+ * For tools that do not read version 2 yet.
+ */
+void KasFormat::writeV1(std::ostream &out, const EventQueue::simInfo &info,
+		const std::vector<EventQueue::dataEvent> &events){
+	out.write(reinterpret_cast<const char*>(&info), sizeof(info));
+	if(!events.empty())
+		out.write(reinterpret_cast<const char*>(&events[0]), 
+				events.size() * sizeof(EventQueue::dataEvent));
+}
+
+/* **********************************************************************
+ * READING
+ * ******************************************************************** */
+
+/**
+ * Parse the version 2 header.
+ * @param data start of the file.
+ * @param headerEnd set to the offset of the first block.
+ * @return false if the data is not a version 2 header, or is truncated.
+ */
+bool KasFormat::parseHeader(const unsigned char *data, size_t size,
+		EventQueue::simInfo &info, size_t &headerEnd){
+	if(size < sizeof(MAGIC) || memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+		return false;
+
+	const unsigned char *p = data + sizeof(MAGIC);
+	const unsigned char *end = data + size;
+	unsigned int version, fieldsSize;
+	if(!getU32(p, end, version) || version > VERSION || version < 2)
+		return false;
+	if(!getU32(p, end, fieldsSize) || (size_t)(end - p) < fieldsSize)
+		return false;
+	end = p + fieldsSize;
+	headerEnd = end - data;
+
+	memset(&info, 0, sizeof(info));
+	unsigned long long count;
+	if(!getVarint(p, end, count))
+		return false;
+
+	for(unsigned long long i = 0; i < count; i++){
+		std::string name;
+		if(!getString(p, end, name) || p >= end)
+			return false;
+		unsigned char type = *p++;
+
+		if(type == FIELD_STRING){
+			std::string value;
+			if(!getString(p, end, value))
+				return false;
+			if(name == "luaFileName")
+				strncpy(info.luaFileName, value.c_str(), sizeof(info.luaFileName)-1);
+		} else if(type == FIELD_DOUBLE){
+			double value;
+			if(!getDouble(p, end, value))
+				return false;
+			if(name == "timeResolution") info.timeResolution = value;
+			else if(name == "areaY") info.areaY = value;
+			else if(name == "areaX") info.areaX = value;
+		} else if(type == FIELD_UINT){
+			if(end - p < 8)
+				return false;
+			unsigned long long value = 0;
+			for(int j = 0; j < 8; j++)
+				value |= (unsigned long long)*p++ << (8*j);
+			if(name == "eventAmount") info.eventAmount = value;
+			else if(name == "numberOfAutons") info.numberOfAutons = value;
+			else if(name == "macroFactor") info.macroFactor = value;
+			else if(name == "tmuAmount") info.tmuAmount = value;
+		} else
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Read the header of a block and check its sizes, before anything is
+ * allocated for it.
+ * @param p start of the block, set to the start of the stored payload.
+ * @return false if the block is truncated, or its sizes can not come 
+ * from writeBlock.
+ */
+bool KasFormat::getBlockHeader(const unsigned char *&p, const unsigned char *end,
+		unsigned long long &amount, unsigned long long &rawSize,
+		unsigned long long &storedSize){
+	if(p >= end)
+		return false;
+	unsigned char codec = *p++;
+	if(!getVarint(p, end, amount) || !getVarint(p, end, rawSize)
+			|| !getVarint(p, end, storedSize) || (unsigned long long)(end - p) < storedSize)
+		return false;
+
+	//the string count and the smallest encoding of each event:
+	if(amount > BLOCK_EVENTS || rawSize < 1 + amount * MIN_EVENT_BYTES)
+		return false;
+	if(codec == CODEC_RAW)
+		return rawSize == storedSize;
+	return rawSize / MAX_ZLIB_RATIO <= storedSize;
+}
+
+/**
+ * Get the size of a block without decoding it.
+ * @param data start of the block.
+ * @param size bytes available from data.
+ * @param amount set to the number of events in the block.
+ * @param blockEnd set to the offset of the next block, from data.
+ * @return false if the block is truncated or its sizes are invalid.
+ */
+bool KasFormat::blockSize(const unsigned char *data, size_t size,
+		unsigned int &amount, size_t &blockEnd){
+	const unsigned char *p = data;
+	unsigned long long events, rawSize, storedSize;
+	if(!getBlockHeader(p, data + size, events, rawSize, storedSize))
+		return false;
+
+	amount = events;
+	blockEnd = (p - data) + storedSize;
+	return true;
+}
+
+/**
+ * Decode a block.
+ * @param data start of the block.
+ * @param size bytes available from data.
+ * @param events the decoded events are appended to this vector.
+ * @return false if the block is corrupt, or compressed and zlib is
+ * not available.
+ */
+bool KasFormat::decodeBlock(const unsigned char *data, size_t size,
+		std::vector<EventQueue::dataEvent> &events){
+	const unsigned char *p = data;
+	const unsigned char *end = data + size;
+	unsigned long long amount, rawSize, storedSize;
+	if(!getBlockHeader(p, end, amount, rawSize, storedSize))
+		return false;
+
+	std::vector<unsigned char> raw;
+	if(data[0] == CODEC_ZLIB){
+#ifdef HAVE_ZLIB
+		raw.resize(rawSize);
+		uLongf rawLength = rawSize;
+		if(uncompress(&raw[0], &rawLength, p, storedSize) != Z_OK || rawLength != rawSize)
+			return false;
+		p = &raw[0];
+		end = p + rawSize;
+#else
+		return false;
+#endif
+	} else if(data[0] == CODEC_RAW){
+		end = p + storedSize;
+	} else
+		return false;
+
+	unsigned long long stringAmount;
+	if(!getVarint(p, end, stringAmount))
+		return false;
+	std::vector<std::string> strings(stringAmount);
+	for(unsigned long long i = 0; i < stringAmount; i++)
+		if(!getString(p, end, strings[i]))
+			return false;
+
+	unsigned long long time = 0, id = 0;
+	for(unsigned long long i = 0; i < amount; i++){
+		EventQueue::dataEvent e;
+		memset(&e, 0, sizeof(e));
+		unsigned long long dTime, dID, originID, desc, table;
+		if(!getVarint(p, end, dTime) || !getVarint(p, end, dID)
+				|| !getVarint(p, end, originID)
+				|| !getDouble(p, end, e.duration) || !getDouble(p, end, e.propagationSpeed)
+				|| !getDouble(p, end, e.originX) || !getDouble(p, end, e.originY)
+				|| !getVarint(p, end, desc) || !getVarint(p, end, table)
+				|| desc >= stringAmount || table >= stringAmount)
+			return false;
+
+		time += unzigzag(dTime);
+		id += unzigzag(dID);
+		e.activationTime = time;
+		e.id = id;
+		e.originID = originID;
+		strncpy(e.desc, strings[desc].c_str(), sizeof(e.desc)-1);
+		strncpy(e.table, strings[table].c_str(), sizeof(e.table)-1);
+		events.push_back(e);
+	}
+	return true;
+}
+
+/**
+ * Read a .kas file of either version.
+ * Files without the version 2 magic are read as version 1.
+ * @param info set to the header of the file.
+ * @param events the events of the file are appended to this vector.
+ * @param version set to the version of the file, if not NULL.
+ * @return false if the file could not be read.
+ */
+bool KasFormat::read(std::string filename, EventQueue::simInfo &info,
+		std::vector<EventQueue::dataEvent> &events, int *version){
+	std::ifstream file(filename.c_str(), std::ifstream::binary);
+	if(!file.is_open())
+		return false;
+
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)),
+			std::istreambuf_iterator<char>());
+	const unsigned char *start = data.empty() ? NULL : &data[0];
+
+	size_t offset;
+	if(parseHeader(start, data.size(), info, offset)){
+		if(version != NULL)
+			*version = 2;
+		while(offset < data.size()){
+			unsigned int amount;
+			size_t blockEnd;
+			if(!blockSize(start + offset, data.size() - offset, amount, blockEnd)
+					|| !decodeBlock(start + offset, data.size() - offset, events))
+				return false;
+			offset += blockEnd;
+		}
+		return true;
+	}
+
+	if(version != NULL)
+		*version = 1;
+	if(data.size() < sizeof(info))
+		return false;
+	memcpy(&info, start, sizeof(info));
+
+	size_t amount = (data.size() - sizeof(info)) / sizeof(EventQueue::dataEvent);
+	size_t first = events.size();
+	events.resize(first + amount);
+	if(amount > 0)
+		memcpy(&events[first], start + sizeof(info), amount * sizeof(EventQueue::dataEvent));
+	return true;
+}
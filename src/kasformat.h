@@ -0,0 +1,123 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef KASFORMAT_H
+#define KASFORMAT_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "eventqueue.h"
+
+/**
+ * Encoding and decoding of .kas event files.
+ *
+ * Version 1 is the raw EventQueue::simInfo struct followed by fixed size
+ * EventQueue::dataEvent records. Version 2 is laid out as:
+ *
+ *	magic		8 bytes, "\x89KAS\r\n\x1a\n"
+ *	version		u32
+ *	header size	u32, size of the field list
+ *	field list	varint count, then pr. field: name (string), type
+ *			(u8) and value. FIELD_UINT and FIELD_DOUBLE values
+ *			are 8 bytes, so a writer can rewrite the header in
+ *			place when the run is done.
+ *	blocks		until the end of the file
+ *
+ * Each block holds up to BLOCK_EVENTS events and can be decoded on its 
+ * own:
+ *
+ *	codec		u8, CODEC_RAW or CODEC_ZLIB
+ *	events		varint
+ *	raw size	varint, size of the decoded payload
+ *	stored size	varint, size of the payload in the file
+ *	payload		the string table, varint count and strings, followed
+ *			by the events
+ *
+ * Events store the activation time and ID as zigzag varint deltas to the
+ * previous event of the block, the origin ID as a varint, duration,
+ * propagation speed and origin position as 8 byte doubles, and desc and
+ * table as references into the string table of the block.
+ * Strings are a varint length followed by the bytes, all integers are 
+ * little endian.
+ *
+ * Readers skip header fields they do not know, so fields can be added 
+ * without raising the version.
+ */
+class KasFormat
+{
+	public:
+		static const char MAGIC[8];
+		static const unsigned int VERSION = 2;
+		static const unsigned int BLOCK_EVENTS = 4096;
+		//varint deltas, origin ID, desc and table, and the four doubles:
+		static const unsigned int MIN_EVENT_BYTES = 5 + 4*8;
+		//the largest expansion zlib can give:
+		static const unsigned int MAX_ZLIB_RATIO = 1032;
+
+		enum FieldType { FIELD_UINT = 0, FIELD_DOUBLE = 1, FIELD_STRING = 2 };
+		enum Codec { CODEC_RAW = 0, CODEC_ZLIB = 1 };
+
+		static void writeHeader(std::ostream &out, const EventQueue::simInfo &info);
+		static void writeBlock(std::ostream &out, const EventQueue::dataEvent *events,
+				unsigned int amount);
+		static void writeV1(std::ostream &out, const EventQueue::simInfo &info,
+				const std::vector<EventQueue::dataEvent> &events);
+
+		static bool read(std::string filename, EventQueue::simInfo &info,
+				std::vector<EventQueue::dataEvent> &events, int *version = NULL);
+
+		//decoding, for readers that do not load the whole file:
+		static bool parseHeader(const unsigned char *data, size_t size,
+				EventQueue::simInfo &info, size_t &headerEnd);
+		static bool blockSize(const unsigned char *data, size_t size,
+				unsigned int &amount, size_t &blockEnd);
+		static bool decodeBlock(const unsigned char *data, size_t size,
+				std::vector<EventQueue::dataEvent> &events);
+
+	private:
+		static void putVarint(std::string &out, unsigned long long value);
+		static void putDouble(std::string &out, double value);
+		static void putString(std::string &out, const std::string &value);
+		static void putU32(std::string &out, unsigned int value);
+
+		static bool getVarint(const unsigned char *&p, const unsigned char *end,
+				unsigned long long &value);
+		static bool getDouble(const unsigned char *&p, const unsigned char *end,
+				double &value);
+		static bool getString(const unsigned char *&p, const unsigned char *end,
+				std::string &value);
+		static bool getU32(const unsigned char *&p, const unsigned char *end,
+				unsigned int &value);
+		static bool getBlockHeader(const unsigned char *&p, const unsigned char *end,
+				unsigned long long &amount, unsigned long long &rawSize,
+				unsigned long long &storedSize);
+
+		static unsigned long long zigzag(long long value){
+			return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+		}
+		static long long unzigzag(unsigned long long value){
+			return (long long)(value >> 1) ^ -(long long)(value & 1);
+		}
+};
+
+#endif // KASFORMAT_H
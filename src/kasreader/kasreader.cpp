@@ -0,0 +1,445 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <math.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "kasreader.h"
+#include "kasformat.h"
+
+namespace {
+	const char INDEX_MAGIC[8] = {'K', 'A', 'S', 'I', 'D', 'X', '1', '\0'};
+
+	struct indexEntry{
+		unsigned long long bucket;
+		unsigned short tile;
+		unsigned long long ref;
+
+		bool operator<(const indexEntry &other) const{
+			if(bucket != other.bucket)
+				return bucket < other.bucket;
+			if(tile != other.tile)
+				return tile < other.tile;
+			return ref < other.ref;
+		}
+	};
+}
+
+	KasReader::KasReader()
+:data(NULL), size(0), modified(0), version(0), eventAmount(0), cachedBlock(-1), 
+	firstTmu(0), bucketWidth(1)
+{
+	memset(&info, 0, sizeof(info));
+}
+
+KasReader::~KasReader(){
+	close();
+}
+
+/**
+ * Open a .kas file.
+ * Maps the file, and loads its index or builds it if there is no 
+ * valid index file.
+ * @param filename the .kas file.
+ * @param saveIndex save a built index as '<filename>.idx'.
+ * @return false if the file could not be read.
+ */
+bool KasReader::open(std::string filename, bool saveIndex){
+	close();
+	if(!mapFile(filename))
+		return false;
+
+	size_t headerEnd;
+	if(KasFormat::parseHeader(data, size, info, headerEnd)){
+		version = 2;
+		blockOffsets.push_back(headerEnd);
+		if(!scanBlocks()){
+			close();
+			return false;
+		}
+	} else if(size >= sizeof(info)){
+		version = 1;
+		memcpy(&info, data, sizeof(info));
+		eventAmount = (size - sizeof(info)) / sizeof(EventQueue::dataEvent);
+	} else{
+		close();
+		return false;
+	}
+
+	std::string indexFile = filename + ".idx";
+	if(!loadIndex(indexFile)){
+		buildIndex();
+		if(saveIndex)
+			this->saveIndex(indexFile);
+	}
+	buildSummary();
+	return true;
+}
+
+void KasReader::close(){
+	if(data != NULL)
+		munmap((void*)data, size);
+	data = NULL;
+	size = 0;
+	version = 0;
+	eventAmount = 0;
+	blockOffsets.clear();
+	blockEvents.clear();
+	cachedBlock = -1;
+	bucketOffsets.clear();
+	refs.clear();
+	tiles.clear();
+	summary.clear();
+}
+
+bool KasReader::mapFile(std::string filename){
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0){
+		::close(fd);
+		return false;
+	}
+	size = st.st_size;
+	modified = st.st_mtime;
+
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(mapping == MAP_FAILED){
+		size = 0;
+		return false;
+	}
+	data = (const unsigned char*)mapping;
+	return true;
+}
+
+/**
+ * Find the offsets of the version 2 blocks.
+ * Only the block headers are read.
+ */
+bool KasReader::scanBlocks(){
+	size_t offset = blockOffsets.back();
+	blockOffsets.pop_back();
+
+	while(offset < size){
+		unsigned int amount;
+		size_t blockEnd;
+		if(!KasFormat::blockSize(data + offset, size - offset, amount, blockEnd))
+			return false;
+		blockOffsets.push_back(offset);
+		eventAmount += amount;
+		offset += blockEnd;
+	}
+	return true;
+}
+
+/**
+ * Read an event by its index reference.
+ */
+bool KasReader::readEvent(unsigned long long ref, EventQueue::dataEvent &event){
+	if(version == 1){
+		size_t offset = sizeof(info) + ref * sizeof(EventQueue::dataEvent);
+		if(offset + sizeof(event) > size)
+			return false;
+		memcpy(&event, data + offset, sizeof(event));
+		return true;
+	}
+
+	long long block = ref >> 32;
+	unsigned int index = ref & 0xffffffff;
+	if(block >= (long long)blockOffsets.size())
+		return false;
+	if(block != cachedBlock){
+		blockEvents.clear();
+		cachedBlock = -1;
+		size_t offset = blockOffsets[block];
+		if(!KasFormat::decodeBlock(data + offset, size - offset, blockEvents))
+			return false;
+		cachedBlock = block;
+	}
+	if(index >= blockEvents.size())
+		return false;
+	event = blockEvents[index];
+	return true;
+}
+
+unsigned int KasReader::tileOf(double x, double y){
+	double fx = info.areaX > 0 ? x / info.areaX * TILES : 0;
+	double fy = info.areaY > 0 ? y / info.areaY * TILES : 0;
+	//clamped before the conversion, the position may be infinite:
+	int tx = (int)std::max(0.0, std::min((double)TILES-1, fx));
+	int ty = (int)std::max(0.0, std::min((double)TILES-1, fy));
+	return ty * TILES + tx;
+}
+
+/**
+ * Build the index with a pass over all the events.
+ * Aims for 16 events pr. bucket, with at most 65536 buckets.
+ */
+void KasReader::buildIndex(){
+	std::vector<indexEntry> entries;
+	unsigned long long minTmu = std::numeric_limits<unsigned long long>::max();
+	unsigned long long maxTmu = 0;
+
+	if(version == 1){
+		entries.reserve(eventAmount);
+		for(unsigned long long r = 0; r < eventAmount; r++){
+			EventQueue::dataEvent event;
+			readEvent(r, event);
+			indexEntry entry = {event.activationTime, (unsigned short)tileOf(event.originX, event.originY), r};
+			entries.push_back(entry);
+		}
+	} else{
+		entries.reserve(eventAmount);
+		for(unsigned long long b = 0; b < blockOffsets.size(); b++){
+			std::vector<EventQueue::dataEvent> events;
+			if(!KasFormat::decodeBlock(data + blockOffsets[b], size - blockOffsets[b], events))
+				break;
+			for(unsigned long long i = 0; i < events.size(); i++){
+				indexEntry entry = {events[i].activationTime,
+					(unsigned short)tileOf(events[i].originX, events[i].originY), (b << 32) | i};
+				entries.push_back(entry);
+			}
+		}
+	}
+
+	for(size_t i = 0; i < entries.size(); i++){
+		minTmu = std::min(minTmu, entries[i].bucket);
+		maxTmu = std::max(maxTmu, entries[i].bucket);
+	}
+	if(entries.empty())
+		minTmu = maxTmu = 0;
+
+	unsigned long long bucketAmount = std::max<unsigned long long>(1,
+			std::min<unsigned long long>(entries.size() / 16, 65536));
+	firstTmu = minTmu;
+	bucketWidth = (maxTmu - minTmu) / bucketAmount + 1;
+	bucketAmount = (maxTmu - minTmu) / bucketWidth + 1;
+
+	for(size_t i = 0; i < entries.size(); i++)
+		entries[i].bucket = (entries[i].bucket - firstTmu) / bucketWidth;
+	std::sort(entries.begin(), entries.end());
+
+	bucketOffsets.assign(bucketAmount + 1, 0);
+	refs.resize(entries.size());
+	tiles.resize(entries.size());
+	for(size_t i = 0; i < entries.size(); i++){
+		bucketOffsets[entries[i].bucket + 1]++;
+		refs[i] = entries[i].ref;
+		tiles[i] = entries[i].tile;
+	}
+	for(size_t i = 1; i < bucketOffsets.size(); i++)
+		bucketOffsets[i] += bucketOffsets[i-1];
+}
+
+/**
+ * Save the index, it is only a cache so failures are ignored.
+ */
+void KasReader::saveIndex(std::string filename){
+	std::ofstream file(filename.c_str(), std::ofstream::binary | std::ofstream::trunc);
+	if(!file.is_open())
+		return;
+
+	unsigned long long fileSize = size;
+	unsigned long long amount = refs.size();
+	unsigned long long buckets = bucketOffsets.size() - 1;
+	unsigned int tileAmount = TILES;
+
+	file.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	file.write(reinterpret_cast<const char*>(&fileSize), sizeof(fileSize));
+	file.write(reinterpret_cast<const char*>(&modified), sizeof(modified));
+	file.write(reinterpret_cast<const char*>(&amount), sizeof(amount));
+	file.write(reinterpret_cast<const char*>(&firstTmu), sizeof(firstTmu));
+	file.write(reinterpret_cast<const char*>(&bucketWidth), sizeof(bucketWidth));
+	file.write(reinterpret_cast<const char*>(&buckets), sizeof(buckets));
+	file.write(reinterpret_cast<const char*>(&tileAmount), sizeof(tileAmount));
+	file.write(reinterpret_cast<const char*>(&bucketOffsets[0]), 
+			bucketOffsets.size() * sizeof(unsigned long long));
+	if(amount > 0){
+		file.write(reinterpret_cast<const char*>(&refs[0]), amount * sizeof(unsigned long long));
+		file.write(reinterpret_cast<const char*>(&tiles[0]), amount * sizeof(unsigned short));
+	}
+}
+
+/**
+ * Load the index.
+ * @return false if there is no index, it belongs to another version
+ * of the .kas file, or it references events outside the file.
+ */
+bool KasReader::loadIndex(std::string filename){
+	std::ifstream file(filename.c_str(), std::ifstream::binary);
+	if(!file.is_open())
+		return false;
+
+	char magic[8];
+	unsigned long long fileSize, amount, buckets;
+	long long fileModified;
+	unsigned int tileAmount;
+
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&fileSize), sizeof(fileSize));
+	file.read(reinterpret_cast<char*>(&fileModified), sizeof(fileModified));
+	file.read(reinterpret_cast<char*>(&amount), sizeof(amount));
+	file.read(reinterpret_cast<char*>(&firstTmu), sizeof(firstTmu));
+	file.read(reinterpret_cast<char*>(&bucketWidth), sizeof(bucketWidth));
+	file.read(reinterpret_cast<char*>(&buckets), sizeof(buckets));
+	file.read(reinterpret_cast<char*>(&tileAmount), sizeof(tileAmount));
+
+	if(!file.good() || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0
+			|| fileSize != size || fileModified != modified || tileAmount != TILES
+			|| bucketWidth == 0 || buckets == 0 || buckets > 65536
+			|| amount > eventAmount)
+		return false;
+
+	bucketOffsets.resize(buckets + 1);
+	refs.resize(amount);
+	tiles.resize(amount);
+	file.read(reinterpret_cast<char*>(&bucketOffsets[0]), 
+			bucketOffsets.size() * sizeof(unsigned long long));
+	if(amount > 0){
+		file.read(reinterpret_cast<char*>(&refs[0]), amount * sizeof(unsigned long long));
+		file.read(reinterpret_cast<char*>(&tiles[0]), amount * sizeof(unsigned short));
+	}
+	if(!file.good() || !validIndex()){
+		bucketOffsets.clear();
+		refs.clear();
+		tiles.clear();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Check a loaded index only references events and tiles of the file.
+ */
+bool KasReader::validIndex(){
+	if(bucketOffsets.front() != 0 || bucketOffsets.back() != refs.size())
+		return false;
+	for(size_t i = 1; i < bucketOffsets.size(); i++)
+		if(bucketOffsets[i] < bucketOffsets[i-1])
+			return false;
+
+	for(size_t i = 0; i < refs.size(); i++){
+		if(tiles[i] >= TILES * TILES)
+			return false;
+		if(version == 1){
+			if(refs[i] >= eventAmount)
+				return false;
+		} else if((refs[i] >> 32) >= blockOffsets.size())
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Build the multi-resolution event counts from the bucket offsets.
+ */
+void KasReader::buildSummary(){
+	summary.clear();
+	summary.push_back(std::vector<unsigned long long>());
+	for(size_t i = 0; i + 1 < bucketOffsets.size(); i++)
+		summary.back().push_back(bucketOffsets[i+1] - bucketOffsets[i]);
+
+	while(summary.back().size() > 1){
+		const std::vector<unsigned long long> &fine = summary.back();
+		std::vector<unsigned long long> coarse((fine.size() + 1) / 2, 0);
+		for(size_t i = 0; i < fine.size(); i++)
+			coarse[i/2] += fine[i];
+		summary.push_back(coarse);
+	}
+}
+
+/**
+ * Event counts at a resolution.
+ * Bucket i of a level covers getBucketWidth() << level tmus, starting 
+ * at getFirstTmu() + i * (getBucketWidth() << level).
+ * @param level 0 for the full resolution, up to getSummaryLevels()-1 
+ * where a single bucket holds all events.
+ */
+const std::vector<unsigned long long>& KasReader::getSummary(int level){
+	level = std::max(0, std::min((int)summary.size()-1, level));
+	return summary[level];
+}
+
+/**
+ * Get the events within a time window.
+ * @see query
+ */
+void KasReader::query(unsigned long long fromTmu, unsigned long long toTmu,
+		std::vector<EventQueue::dataEvent> &events){
+	query(fromTmu, toTmu, -HUGE_VAL, -HUGE_VAL, HUGE_VAL, HUGE_VAL, events);
+}
+
+/**
+ * Get the events within a time window and area.
+ * Only the events of the overlapping buckets and tiles are read, each
+ * version 2 block at most once pr. query.
+ * @param fromTmu first activation time, inclusive.
+ * @param toTmu last activation time, inclusive.
+ * @param minX,minY,maxX,maxY the area of the origin positions, inclusive.
+ * @param events the matching events are appended to this vector.
+ */
+void KasReader::query(unsigned long long fromTmu, unsigned long long toTmu,
+		double minX, double minY, double maxX, double maxY,
+		std::vector<EventQueue::dataEvent> &events){
+	if(refs.empty() || toTmu < firstTmu || fromTmu > toTmu)
+		return;
+
+	unsigned long long lastBucket = bucketOffsets.size() - 2;
+	unsigned long long b0 = fromTmu <= firstTmu ? 0 : (fromTmu - firstTmu) / bucketWidth;
+	unsigned long long b1 = std::min(lastBucket, (toTmu - firstTmu) / bucketWidth);
+	if(b0 > lastBucket)
+		return;
+
+	unsigned int low = tileOf(std::max(minX, 0.0), std::max(minY, 0.0));
+	unsigned int high = tileOf(maxX, maxY);
+	unsigned int tx0 = low % TILES, ty0 = low / TILES;
+	unsigned int tx1 = high % TILES, ty1 = high / TILES;
+
+	std::vector<unsigned long long> candidates;
+	for(unsigned long long b = b0; b <= b1; b++){
+		for(unsigned long long i = bucketOffsets[b]; i < bucketOffsets[b+1]; i++){
+			unsigned int tx = tiles[i] % TILES, ty = tiles[i] / TILES;
+			if(tx >= tx0 && tx <= tx1 && ty >= ty0 && ty <= ty1)
+				candidates.push_back(refs[i]);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	for(size_t i = 0; i < candidates.size(); i++){
+		EventQueue::dataEvent event;
+		if(!readEvent(candidates[i], event))
+			continue;
+		if(event.activationTime >= fromTmu && event.activationTime <= toTmu
+				&& event.originX >= minX && event.originX <= maxX
+				&& event.originY >= minY && event.originY <= maxY)
+			events.push_back(event);
+	}
+}
@@ -0,0 +1,126 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef KASREADER_H
+#define KASREADER_H
+
+#include <string>
+#include <vector>
+
+#include "eventqueue.h"
+
+/**
+ * Memory mapped reader for .kas files.
+ * Answers time and area queries on the events of a .kas file, of either
+ * version, without scanning the whole file.
+ *
+ * The events are indexed by tmu bucket, and within a bucket by spatial
+ * tile of their origin position. The index is saved next to the file as
+ * '<file>.idx' and loaded the next time, it is rebuilt if the .kas file
+ * has changed. Version 1 records are read directly from the mapping,
+ * version 2 blocks are only decoded if they hold a matching event.
+ *
+ * The event counts pr. bucket are also kept at multiple resolutions, 
+ * each level halving the number of buckets, so a zoomed out timeline can
+ * be drawn from the counts alone.
+ *
+ * Usage:
+ *	KasReader reader;
+ *	if(reader.open("savefile.kas")){
+ *		std::vector<EventQueue::dataEvent> events;
+ *		reader.query(0, 1000000, 0, 0, 100, 100, events);
+ *	}
+ */
+class KasReader
+{
+	public:
+		//number of tiles along each axis of the area:
+		static const unsigned int TILES = 16;
+
+		KasReader();
+		~KasReader();
+
+		bool open(std::string filename, bool saveIndex = true);
+		void close();
+
+		const EventQueue::simInfo& getInfo(){ return info; }
+		int getVersion(){ return version; }
+		unsigned long long getEventAmount(){ return refs.size(); }
+		unsigned long long getFirstTmu(){ return firstTmu; }
+		unsigned long long getBucketWidth(){ return bucketWidth; }
+
+		void query(unsigned long long fromTmu, unsigned long long toTmu,
+				std::vector<EventQueue::dataEvent> &events);
+		void query(unsigned long long fromTmu, unsigned long long toTmu,
+				double minX, double minY, double maxX, double maxY,
+				std::vector<EventQueue::dataEvent> &events);
+
+		int getSummaryLevels(){ return summary.size(); }
+		const std::vector<unsigned long long>& getSummary(int level);
+
+	private:
+		//owns the mapping, so it must not be copied:
+		KasReader(KasReader const&);
+		KasReader& operator=(KasReader const&);
+
+		bool mapFile(std::string filename);
+		bool scanBlocks();
+		bool loadIndex(std::string filename);
+		bool validIndex();
+		void buildIndex();
+		void saveIndex(std::string filename);
+		void buildSummary();
+
+		bool readEvent(unsigned long long ref, EventQueue::dataEvent &event);
+		unsigned int tileOf(double x, double y);
+
+		//the mapping:
+		const unsigned char *data;
+		size_t size;
+		long long modified;
+
+		EventQueue::simInfo info;
+		int version;
+		//events in the file, counted from the block headers for version 2:
+		unsigned long long eventAmount;
+
+		//version 2 blocks, and the last decoded block:
+		std::vector<size_t> blockOffsets;
+		long long cachedBlock;
+		std::vector<EventQueue::dataEvent> blockEvents;
+
+		/*
+		 * The index. References are record numbers for version 1, and
+		 * (block << 32 | event in block) for version 2. They are sorted
+		 * by bucket and then tile, bucket i holds the references 
+		 * bucketOffsets[i] to bucketOffsets[i+1].
+		 */
+		unsigned long long firstTmu;
+		unsigned long long bucketWidth;
+		std::vector<unsigned long long> bucketOffsets;
+		std::vector<unsigned long long> refs;
+		std::vector<unsigned short> tiles;
+
+		//event counts pr. bucket, level 0 is the full resolution:
+		std::vector< std::vector<unsigned long long> > summary;
+};
+
+#endif // KASREADER_H
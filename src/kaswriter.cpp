@@ -0,0 +1,141 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include "kaswriter.h"
+#include "output.h"
+
+	KasWriter::KasWriter()
+:closing(false), version(KasFormat::VERSION)
+{
+}
+
+/**
+ * Closes the writer if close() was not called, the header written by
+ * open() is kept then.
+ */
+KasWriter::~KasWriter(){
+	if(thread.joinable())
+		close(openInfo);
+}
+
+/**
+ * Open a .kas file and start the writer thread.
+ * The header is written with the information known at the start, the
+ * luaFileName must not change before the writer is closed.
+ * @param filename name of the file, including the extension.
+ * @param info the simInfo header.
+ * @param version the .kas version to write, 1 or 2.
+ * @return false if the file could not be opened.
+ */
+bool KasWriter::open(std::string filename, const EventQueue::simInfo &info, int version){
+	file.open(filename.c_str(), std::ofstream::binary | std::ofstream::trunc);
+	if(!file.is_open()){
+		Output::Inst()->kprintf("error opening %s for streaming\n", filename.c_str());
+		return false;
+	}
+	this->version = version;
+	openInfo = info;
+	writeHeader(info);
+
+	front.reserve(BUFFER_SIZE);
+	back.reserve(BUFFER_SIZE);
+	closing = false;
+	thread = std::thread(&KasWriter::run, this);
+	return true;
+}
+
+bool KasWriter::isOpen(){
+	return thread.joinable();
+}
+
+/**
+ * Queue an event for writing.
+ * Called from the simulation thread.
+ */
+void KasWriter::write(const EventQueue::dataEvent &event){
+	front.push_back(event);
+	if(front.size() >= BUFFER_SIZE)
+		flush();
+}
+
+/**
+ * Hand the filled buffer to the writer thread.
+ * Waits for the writer to finish the previous buffer first.
+ */
+void KasWriter::flush(){
+	std::unique_lock<std::mutex> lock(mutex);
+	cond.wait(lock, [this]{ return back.empty(); });
+	back.swap(front);
+	cond.notify_all();
+}
+
+/**
+ * Write the remaining events and the header, and close the file.
+ * @param info the simInfo header, written at the start of the file.
+ */
+void KasWriter::close(const EventQueue::simInfo &info){
+	if(!thread.joinable())
+		return;
+
+	if(!front.empty())
+		flush();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	cond.notify_all();
+	thread.join();
+
+	file.seekp(0);
+	writeHeader(info);
+	file.close();
+}
+
+void KasWriter::writeHeader(const EventQueue::simInfo &info){
+	if(version == 1)
+		file.write(reinterpret_cast<const char*>(&info), sizeof(info));
+	else
+		KasFormat::writeHeader(file, info);
+}
+
+/**
+ * The writer thread.
+ * Writes each buffer, then hands it back empty.
+ */
+void KasWriter::run(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		cond.wait(lock, [this]{ return !back.empty() || closing; });
+		if(back.empty())
+			break;
+
+		lock.unlock();
+		if(version == 1)
+			file.write(reinterpret_cast<const char*>(&back[0]),
+					back.size() * sizeof(EventQueue::dataEvent));
+		else
+			KasFormat::writeBlock(file, &back[0], back.size());
+		lock.lock();
+
+		back.clear();
+		cond.notify_all();
+	}
+}
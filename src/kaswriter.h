@@ -0,0 +1,81 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef KASWRITER_H
+#define KASWRITER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "eventqueue.h"
+#include "kasformat.h"
+
+/**
+ * Background writer for .kas files.
+ * Writes the external events to disk while the simulation runs. The 
+ * simulation thread fills one buffer while the writer thread writes the
+ * other, so the simulation only waits if the disk can not keep up with 
+ * it, and memory use is bounded by the two buffers.
+ *
+ * The file format is the same as EventQueue::saveEEventData writes. In
+ * version 2 each buffer is encoded and compressed as one block by the 
+ * writer thread. The header is written again when the writer is closed,
+ * as the number of events is not known before.
+ */
+class KasWriter
+{
+	public:
+		//number of events pr. buffer, one version 2 block:
+		static const unsigned int BUFFER_SIZE = KasFormat::BLOCK_EVENTS;
+
+		KasWriter();
+		~KasWriter();
+
+		bool open(std::string filename, const EventQueue::simInfo &info, int version);
+		void write(const EventQueue::dataEvent &event);
+		void close(const EventQueue::simInfo &info);
+		bool isOpen();
+
+	private:
+		void run();
+		void flush();
+		void writeHeader(const EventQueue::simInfo &info);
+
+		std::ofstream file;
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable cond;
+
+		//filled by the simulation thread:
+		std::vector<EventQueue::dataEvent> front;
+		//written by the writer thread, empty when it is ready for more:
+		std::vector<EventQueue::dataEvent> back;
+		bool closing;
+		int version;
+		//the header written by open():
+		EventQueue::simInfo openInfo;
+};
+
+#endif // KASWRITER_H
@@ -39,31 +39,59 @@
 #include <string>		
 #include <memory>
 #include <atomic>
+#include <cstdlib>
+#include <cstdio>
+#include <errno.h>
+#include <limits.h>
+#include <sys/resource.h>
 
 #include "../build/kasterborous.h"
 #include "agentdomain.h"
 #include "eventqueue.h"
 #include "nestene.h"
-#include "ID.h"
 #include "output.h"
+#include "luaprofiler.h"
+#include "debuglog.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "perfcounters.h"
+#include "luamemory.h"
+#include "luawatchdog.h"
+#include "doctor.h"
 #include "utility.h"
 
-//initialize the is values
-int ID::aID = 0;
-unsigned long long ID::eID = 0;
-unsigned long long ID::tmu = 0;
-unsigned long long ID::nID = 0;
-
 //Thread stuff:
 std::atomic_bool simDone;
 std::shared_ptr<AgentDomain> agentdomain;
 std::thread* runThread = NULL;
-//variables for getting auton placement data:
-std::list<double> sylist; std::list<double> sxlist;
-std::list<double> lylist; std::list<double> lxlist;
-std::list<double> aylist; std::list<double> axlist;
 double width, height;
 bool generated = false;
+//native plugin autons, only set from the command line:
+int nativeAmount = 0;
+std::string pluginFilename = "";
+//encode the issuing nestene in the event IDs:
+bool nesteneEventIDs = false;
+//stream the events to this .kas file during the run:
+std::string streamFilename = "";
+//.kas version of the saved event data:
+int kasVersion = 2;
+//selection of the exported events, see exportfilter.h:
+std::string exportFilter = "";
+//binary debug log and its rate limits, see debuglog.h:
+std::string debugLogFilename = "";
+std::string debugRates = "";
+//live metrics are published to this file, if set:
+std::string metricsFilename = "";
+//trace file and sampling of the Chrome trace, see tracer.h:
+std::string traceSpec = "";
+//memory cap and garbage collection of the Lua states, see luamemory.h:
+std::string luaMemorySpec = "";
+//limits and action of the health monitor, see doctor.h:
+std::string doctorSpec = "";
+//instruction budget of the Lua callbacks, see luawatchdog.h:
+std::string budgetSpec = "";
+//batch runs save the external events to this .kas file, if set:
+std::string saveFilename = "";
 
 
 /**
@@ -80,11 +108,18 @@ void startSimThread(int runTime, std::shared_ptr<AgentDomain> agentdomain){
 	generated = false;
 }
 
-void clearPlacementData();
+int runBatch(std::string command, std::string filename, int screamerAmount,
+		int listenerAmount, int luaAmount, double width, double height, int runtime,
+		double microStepRes, int macroStepFactor);
 
 
 int main(int argc, char *argv[])
 {
+	//batch mode runs without Ncurses, so it must be known before the 
+	//output singleton is instanciated:
+	for(int i = 1; i < argc; i++)
+		if(std::string(argv[i]).compare("-b") == 0)
+			Output::setHeadless(true);
 	//instanciate the output singleton:
 	Output::Inst();
 	//Handle input commands:
@@ -146,9 +181,148 @@ int main(int argc, char *argv[])
 				s_cmd = *argv++;
 				i++;
 			}
-		}
+		}else if(param.compare("-n") == 0){
+			if(*argv++ != NULL){
+				nativeAmount = atoi(*argv++);
+				i++;
+			}
+		}else if(param.compare("-N") == 0){
+			if(*argv++ != NULL){
+				pluginFilename = *argv++;
+				i++;
+			}
+		}else if(param.compare("-S") == 0){
+			if(*argv++ != NULL){
+				streamFilename = *argv++;
+				i++;
+			}
+		}else if(param.compare("-V") == 0){
+			if(*argv++ != NULL){
+				kasVersion = atoi(*argv++);
+				i++;
+			}
+		}else if(param.compare("-F") == 0){
+			if(*argv++ != NULL){
+				exportFilter = *argv++;
+				i++;
+			}
+		}else if(param.compare("-D") == 0){
+			if(*argv++ != NULL){
+				debugLogFilename = *argv++;
+				i++;
+			}
+		}else if(param.compare("-R") == 0){
+			if(*argv++ != NULL){
+				debugRates = *argv++;
+				i++;
+			}
+		}else if(param.compare("-M") == 0){
+			if(*argv++ != NULL){
+				metricsFilename = *argv++;
+				i++;
+			}
+		}else if(param.compare("-T") == 0){
+			if(*argv++ != NULL){
+				traceSpec = *argv++;
+				i++;
+			}
+		}else if(param.compare("-G") == 0){
+			if(*argv++ != NULL){
+				luaMemorySpec = *argv++;
+				i++;
+			}
+		}else if(param.compare("-B") == 0){
+			if(*argv++ != NULL){
+				budgetSpec = *argv++;
+				i++;
+			}
+		}else if(param.compare("-H") == 0){
+			if(*argv++ != NULL){
+				doctorSpec = *argv++;
+				i++;
+			}
+		}else if(param.compare("-o") == 0){
+			if(*argv++ != NULL){
+				saveFilename = *argv++;
+				i++;
+			}
+		}else if(param.compare("-b") == 0){
+			argv++;
+		}else if(param.compare("-e") == 0){
+			argv++;
+			nesteneEventIDs = true;
+		}else if(param.compare("-C") == 0){
+			argv++;
+			PerfCounters::setEnabled(true);
+		}else if(param.compare("-p") == 0){
+			argv++;
+			LuaProfiler::Inst()->enable("");
+		}else if(param.compare("-P") == 0){
+			if(*argv++ != NULL){
+				LuaProfiler::Inst()->enable(*argv++);
+				i++;
+			}
+		}else
+			argv++;
+	}
+
+	//a batch run is not started if any of these fail:
+	bool invalidArguments = false;
+	if(!debugLogFilename.empty() && !DebugLog::Inst()->enable(debugLogFilename)){
+		Output::Inst()->kprintf("Unable to open debug log '%s'\n", debugLogFilename.c_str());
+		invalidArguments = true;
+	}
+	if(!DebugLog::Inst()->setRates(debugRates)){
+		Output::Inst()->kprintf("Invalid debug rate limits '%s'\n", debugRates.c_str());
+		invalidArguments = true;
+	}
+
+	if(!metricsFilename.empty() && !Metrics::Inst()->enable(metricsFilename)){
+		Output::Inst()->kprintf("Unable to write metrics file '%s'\n", metricsFilename.c_str());
+		invalidArguments = true;
+	}
+	if(!LuaMemory::configure(luaMemorySpec)){
+		Output::Inst()->kprintf("Invalid Lua memory specification '%s'\n", luaMemorySpec.c_str());
+		invalidArguments = true;
+	}
+	if(!budgetSpec.empty()){
+		char *end;
+		errno = 0;
+		long long budget = strtoll(budgetSpec.c_str(), &end, 10);
+		if(budgetSpec[0] < '0' || budgetSpec[0] > '9' || errno != 0 || *end != '\0'
+				|| budget > INT_MAX){
+			Output::Inst()->kprintf("Invalid Lua instruction budget '%s'\n", budgetSpec.c_str());
+			invalidArguments = true;
+		} else
+			LuaWatchdog::setBudget(budget);
+	}
+	if(!doctorSpec.empty() && !Doctor::configure(doctorSpec)){
+		Output::Inst()->kprintf("Invalid health monitor specification '%s'\n", doctorSpec.c_str());
+		invalidArguments = true;
+	}
+	if(!ExportFilter().parse(exportFilter)){
+		Output::Inst()->kprintf("Invalid export filter '%s'\n", exportFilter.c_str());
+		invalidArguments = true;
+	}
+	if(!traceSpec.empty() && !Tracer::Inst()->enable(traceSpec)){
+		Output::Inst()->kprintf("Invalid trace specification '%s'\n", traceSpec.c_str());
+		invalidArguments = true;
 	}
 
+	//an unattended run must not go on with a monitor, cap or trace off:
+	if(Output::isHeadless() && invalidArguments){
+		Output::Inst()->kprintf("Invalid arguments, batch run not started\n");
+		Metrics::Inst()->close();
+		DebugLog::Inst()->close();
+		Output::Inst()->stopRender();
+		return 1;
+	}
+	if(Output::isHeadless())
+		return runBatch(s_cmd, s_filename, atoi(s_screamerAmount.c_str()),
+				atoi(s_listenerAmount.c_str()), atoi(s_luaAmount.c_str()),
+				atof(s_width.c_str()), atof(s_height.c_str()), atoi(s_time.c_str()),
+				atof(s_timeResolution.c_str()), atoi(s_macroFactor.c_str()));
+
 	Output::Inst()->setFields(s_filename, s_luaAmount, s_screamerAmount, s_listenerAmount, s_macroFactor, s_timeResolution, s_cmd, s_height, s_width, s_time);
 
 
@@ -162,6 +336,11 @@ int main(int argc, char *argv[])
 	keypad(stdscr,TRUE);
 
 	agentdomain.reset(new AgentDomain);
+	agentdomain->setNesteneEventIDs(nesteneEventIDs);
+	agentdomain->setStreamFile(streamFilename);
+	agentdomain->setKasVersion(kasVersion);
+	if(!agentdomain->setExportFilter(exportFilter))
+		Output::Inst()->kprintf("Invalid export filter '%s', exporting all events\n", exportFilter.c_str());
 
 	int ch;
 
@@ -178,7 +357,7 @@ int main(int argc, char *argv[])
 			case KEY_F(3):
 				//if(generated){
 					if(agentdomain->checkEnvPresence()){
-						Output::Inst()->generateMapPanels(sylist,sxlist,lylist,lxlist,aylist,axlist,height,width);
+						Output::Inst()->generateMapPanels(agentdomain->getPositionSnapshot());
 						Output::Inst()->keyHandler(MODE_MAP);
 					}else
 						Output::Inst()->kprintf("No environment to render, (hint:cmd 'gen')\n");
@@ -203,7 +382,14 @@ int main(int argc, char *argv[])
 					Output::Inst()->kprintf("Executing CMD:\t%s\n", command.c_str());
 
 					if(!generated){
+						Output::Inst()->releaseMap();
 						agentdomain.reset(new AgentDomain);
+						agentdomain->setNesteneEventIDs(nesteneEventIDs);
+						agentdomain->setStreamFile(streamFilename);
+						agentdomain->setKasVersion(kasVersion);
+						if(!agentdomain->setExportFilter(exportFilter))
+						Output::Inst()->kprintf("Invalid export filter '%s', exporting all events\n",
+								exportFilter.c_str());
 					}
 
 					if((runSim.compare(command)==0)){
@@ -212,11 +398,11 @@ int main(int argc, char *argv[])
 						if(!agentdomain->checkEnvPresence()){
 							generated = true;
 							Output::Inst()->kprintf("No environment found, generating a new one.\n");
-							clearPlacementData();
 							agentdomain->generateEnvironment(width,height,nestSquareAmount,
 									listenerAmount,screamerAmount,luaAmount,
-									microStepRes,macroStepFactor,filename);
-							agentdomain->retrievePopPos(sylist,sxlist,lylist,lxlist,aylist,axlist,width,height);
+									microStepRes,macroStepFactor,filename,
+									nativeAmount,pluginFilename);
+							agentdomain->publishPositions();
 							Output::Inst()->kprintf("Environment generated.\n");
 						}
 						//start the simulation thread:
@@ -226,21 +412,20 @@ int main(int argc, char *argv[])
 					}else if(generateEnv.compare(command)==0){
 						generated = true;
 						Output::Inst()->kprintf("Generating Environment.\n");
-						clearPlacementData();
 						agentdomain->generateEnvironment(width,height,nestSquareAmount,
 								listenerAmount,screamerAmount,luaAmount,
-								microStepRes,macroStepFactor,filename);
-						agentdomain->retrievePopPos(sylist,sxlist,lylist,lxlist,aylist,axlist,width,height);
+								microStepRes,macroStepFactor,filename,
+								nativeAmount,pluginFilename);
+						agentdomain->publishPositions();
 						Output::Inst()->kprintf("Environment generated, %d.\n", luaAmount);
 
 					}else if(generateEnvSquare.compare(command)==0){
 						generated = true;
 						simDone = false;
 						Output::Inst()->kprintf("Generating Square Environment.\n");
-						clearPlacementData();
 						agentdomain->generateSquaredEnvironment(width,height,nestSquareAmount,
 								luaAmount,microStepRes,macroStepFactor,filename);
-						agentdomain->retrievePopPos(sylist,sxlist,lylist,lxlist,aylist,axlist,width,height);
+						agentdomain->publishPositions();
 						Output::Inst()->kprintf("Squared LUA Environment generated, %d.\n", luaAmount);
 
 						runThread = new std::thread(startSimThread,runtime, agentdomain);
@@ -250,10 +435,9 @@ int main(int argc, char *argv[])
 						generated = true;
 						simDone = false;
 						Output::Inst()->kprintf("Generating Square Environment.\n");
-						clearPlacementData();
 						agentdomain->generateSquaredListenerEnvironment(width,height,nestSquareAmount,
 								listenerAmount,microStepRes,macroStepFactor);
-						agentdomain->retrievePopPos(sylist,sxlist,lylist,lxlist,aylist,axlist,width,height);
+						agentdomain->publishPositions();
 						Output::Inst()->kprintf("Squared Listener Environment generated, %d.\n", listenerAmount);
 
 						runThread = new std::thread(startSimThread,runtime, agentdomain);
@@ -285,21 +469,105 @@ int main(int argc, char *argv[])
 		runThread->join();
 	}
 	Output::Inst()->kprintf("Clearing eventqueue data");
+	Output::Inst()->releaseMap();
 	agentdomain.reset();
+	Metrics::Inst()->close();
+	DebugLog::Inst()->close();
+	Output::Inst()->stopRender();
 	endwin();	
 	delete runThread;
 	return 0;
 }
 
 /*
- * Clears the placement lists.
+ * Escape a string for a JSON document.
  */
-void clearPlacementData(){
-	sylist.clear();
-	sxlist.clear();
-	lylist.clear();
-	lxlist.clear();
-	aylist.clear();
-	axlist.clear();
+std::string jsonString(std::string value){
+	std::string escaped = "\"";
+	for(size_t i = 0; i < value.size(); i++){
+		if(value[i] == '"' || value[i] == '\\')
+			escaped.push_back('\\');
+		if((unsigned char)value[i] >= 0x20)
+			escaped.push_back(value[i]);
+	}
+	return escaped + "\"";
 }
 
+/**
+ * Runs a command without the user interface.
+ * Generates the environment, runs the simulation and saves the external
+ * events if a save file is given. The log lines go to stderr, and a summary
+ * of the run is printed as a JSON object on stdout.
+ * @param command 'run', 'gen', 'run-L' or 'run-l', as in the input panel.
+ * @return the exit code of the program.
+ */
+int runBatch(std::string command, std::string filename, int screamerAmount,
+		int listenerAmount, int luaAmount, double width, double height, int runtime,
+		double microStepRes, int macroStepFactor){
+	const int nestSquareAmount = 1;
+	bool run = true;
+	int status = 0;
+
+	agentdomain.reset(new AgentDomain);
+	agentdomain->setNesteneEventIDs(nesteneEventIDs);
+	agentdomain->setStreamFile(streamFilename);
+	agentdomain->setKasVersion(kasVersion);
+
+	Output::Inst()->kprintf("Executing CMD:\t%s\n", command.c_str());
+	if(!agentdomain->setExportFilter(exportFilter)){
+		Output::Inst()->kprintf("Invalid export filter '%s'\n", exportFilter.c_str());
+		run = false;
+		status = 1;
+	}else if(command.compare("run") == 0 || command.compare("gen") == 0){
+		agentdomain->generateEnvironment(width,height,nestSquareAmount,
+				listenerAmount,screamerAmount,luaAmount,
+				microStepRes,macroStepFactor,filename,
+				nativeAmount,pluginFilename);
+		run = command.compare("run") == 0;
+	}else if(command.compare("run-L") == 0){
+		agentdomain->generateSquaredEnvironment(width,height,nestSquareAmount,
+				luaAmount,microStepRes,macroStepFactor,filename);
+	}else if(command.compare("run-l") == 0){
+		agentdomain->generateSquaredListenerEnvironment(width,height,nestSquareAmount,
+				listenerAmount,microStepRes,macroStepFactor);
+	}else{
+		Output::Inst()->kprintf("Unknown command '%s'\n", command.c_str());
+		run = false;
+		status = 1;
+	}
+
+	if(run){
+		Output::Inst()->kprintf("Starting Simulation Run\n");
+		agentdomain->runSimulation(runtime);
+		Output::Inst()->kprintf("\n");
+		if(!saveFilename.empty())
+			agentdomain->saveExternalEvents(saveFilename);
+	}
+
+	double seconds = agentdomain->getRunSeconds();
+	unsigned long long eEvents = agentdomain->getEEventAmount();
+	unsigned long long iEvents = agentdomain->getIEventAmount();
+	unsigned long long initiated = agentdomain->getEEventInitAmount();
+	unsigned long long tmu = agentdomain->getSimulatedTmu();
+
+	Output::Inst()->kprintf("Clearing eventqueue data\n");
+	agentdomain.reset();
+	Metrics::Inst()->close();
+	DebugLog::Inst()->close();
+	Output::Inst()->stopRender();
+
+	//ru_maxrss is in kilobytes on Linux:
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("{\"command\": %s, \"status\": %i, \"autons\": "
+			"{\"screamer\": %i, \"listener\": %i, \"lua\": %i, \"native\": %i}, "
+			"\"simulated_tmu\": %llu, \"initiated_events\": %llu, "
+			"\"external_events\": %llu, \"internal_events\": %llu, \"events\": %llu, "
+			"\"wall_time_s\": %.3f, \"events_per_s\": %.1f, \"peak_rss_kb\": %ld}\n",
+			jsonString(command).c_str(), status, screamerAmount, listenerAmount,
+			luaAmount, nativeAmount, tmu, initiated, eEvents, iEvents, eEvents + iEvents,
+			seconds, seconds > 0 ? (eEvents + iEvents) / seconds : 0.0,
+			usage.ru_maxrss);
+	return status;
+}
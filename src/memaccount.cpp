@@ -0,0 +1,129 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <chrono>
+
+#include "memaccount.h"
+#include "output.h"
+
+MemAccount::Counter MemAccount::counters[TAG_AMOUNT];
+std::atomic<size_t> MemAccount::luaHeapPeak(0);
+
+namespace {
+	typedef std::chrono::steady_clock clock;
+	clock::time_point lastSample = clock::now();
+	clock::time_point runStart = clock::now();
+
+	double megabytes(size_t bytes){
+		return bytes / (1024.0 * 1024.0);
+	}
+}
+
+const char* MemAccount::name(int tag){
+	static const char *names[TAG_AMOUNT] =
+		{"queue", "events", "strings", "nestene", "lua"};
+	if(tag < 0 || tag >= TAG_AMOUNT)
+		return "unknown";
+	return names[tag];
+}
+
+/**
+ * Heap memory of a string, zero if it fits in the string itself.
+ */
+size_t MemAccount::stringBytes(const std::string &string){
+	const char *data = string.data();
+	const char *object = reinterpret_cast<const char*>(&string);
+	if(data >= object && data < object + sizeof(std::string))
+		return 0;
+	return string.capacity() + 1;
+}
+
+size_t MemAccount::liveTotal(){
+	size_t total = 0;
+	for(int i = 0; i < TAG_AMOUNT; i++)
+		total += live(i);
+	return total;
+}
+
+/**
+ * Start the accounting of a run, the peaks start at the current use.
+ * Called from the simulation thread.
+ */
+void MemAccount::beginRun(){
+	for(int i = 0; i < TAG_AMOUNT; i++){
+		Counter &counter = counters[i];
+		counter.peak.store(counter.live.load(std::memory_order_relaxed),
+				std::memory_order_relaxed);
+		counter.runAllocations = counter.allocations.load(std::memory_order_relaxed);
+		counter.lastAllocations = counter.runAllocations;
+		counter.rate.store(0, std::memory_order_relaxed);
+	}
+	luaHeapPeak.store(0, std::memory_order_relaxed);
+	runStart = clock::now();
+	lastSample = runStart;
+}
+
+/**
+ * Compute the allocation rates since the last sample.
+ * Called from the simulation thread with the status update.
+ */
+void MemAccount::sample(){
+	clock::time_point now = clock::now();
+	double interval = std::chrono::duration<double>(now - lastSample).count();
+	if(interval <= 0)
+		return;
+	for(int i = 0; i < TAG_AMOUNT; i++){
+		Counter &counter = counters[i];
+		unsigned long long allocations = counter.allocations.load(std::memory_order_relaxed);
+		counter.rate.store((allocations - counter.lastAllocations) / interval,
+				std::memory_order_relaxed);
+		counter.lastAllocations = allocations;
+	}
+	lastSample = now;
+}
+
+/**
+ * Print the memory use of each subsystem during the run.
+ */
+void MemAccount::report(){
+	double wall = std::chrono::duration<double>(clock::now() - runStart).count();
+	Output::Inst()->kprintf("\n---- Memory pr. subsystem ----\n");
+	Output::Inst()->kprintf("%-8s %10s %10s %14s %12s\n",
+			"", "live[MB]", "peak[MB]", "allocations", "allocs/s");
+	size_t live = 0, peak = 0;
+	unsigned long long allocations = 0;
+	for(int i = 0; i < TAG_AMOUNT; i++){
+		Counter &counter = counters[i];
+		unsigned long long amount = counter.allocations.load(std::memory_order_relaxed)
+			- counter.runAllocations;
+		Output::Inst()->kprintf("%-8s %10.2f %10.2f %14llu %12.0f\n",
+				name(i), megabytes(MemAccount::live(i)), megabytes(MemAccount::peak(i)),
+				amount, wall > 0 ? amount / wall : 0.0);
+		live += MemAccount::live(i);
+		peak += MemAccount::peak(i);
+		allocations += amount;
+	}
+	Output::Inst()->kprintf("%-8s %10.2f %10.2f %14llu %12.0f\n",
+			"total", megabytes(live), megabytes(peak), allocations,
+			wall > 0 ? allocations / wall : 0.0);
+	Output::Inst()->kprintf("Largest Lua state: %.2f[MB]\n",
+			megabytes(luaHeapPeak.load(std::memory_order_relaxed)));
+}
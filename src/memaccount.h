@@ -0,0 +1,143 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef MEMACCOUNT_H
+#define MEMACCOUNT_H
+
+#include <string>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+/**
+ * Memory accounting pr. subsystem.
+ * The engine containers use a TaggedAllocator, the events count
+ * themselves with a class operator new, their string payloads are counted
+ * when they enter the event queue, and the Lua states are counted by their
+ * allocator, LuaMemory::alloc(). Each subsystem has its live bytes, its peak and its number
+ * of allocations, kept in relaxed atomics so any thread may read them.
+ *
+ * The Master samples the allocation rates with the status update, the
+ * running panel and the metrics show them, and a report is printed when
+ * the run is done.
+ */
+class MemAccount
+{
+	public:
+		enum Tag{
+			QUEUE = 0,	//event queue buckets and time keeping
+			EVENTS,		//external and internal event structs
+			STRINGS,	//heap part of the event descriptions and tables
+			NESTENE,	//auton containers of the Nestenes
+			LUA,		//the Lua states
+			TAG_AMOUNT
+		};
+
+		static const char* name(int tag);
+
+		static void allocated(Tag tag, size_t bytes){
+			Counter &counter = counters[tag];
+			counter.allocations.fetch_add(1, std::memory_order_relaxed);
+			grow(counter, bytes);
+		}
+		static void freed(Tag tag, size_t bytes){
+			counters[tag].live.fetch_sub(bytes, std::memory_order_relaxed);
+		}
+		static void resized(Tag tag, size_t oldBytes, size_t newBytes){
+			if(newBytes > oldBytes)
+				grow(counters[tag], newBytes - oldBytes);
+			else
+				freed(tag, oldBytes - newBytes);
+		}
+		static size_t stringBytes(const std::string &string);
+		//the peak of a single Lua state, for the largest state of the run:
+		static void luaStatePeak(size_t bytes){
+			size_t peak = luaHeapPeak.load(std::memory_order_relaxed);
+			while(bytes > peak && !luaHeapPeak.compare_exchange_weak(peak, bytes,
+						std::memory_order_relaxed));
+		}
+
+		static size_t live(int tag){
+			return counters[tag].live.load(std::memory_order_relaxed);
+		}
+		static size_t peak(int tag){
+			return counters[tag].peak.load(std::memory_order_relaxed);
+		}
+		static double rate(int tag){
+			return counters[tag].rate.load(std::memory_order_relaxed);
+		}
+		static size_t liveTotal();
+
+		static void beginRun();
+		static void sample();
+		static void report();
+
+	private:
+		struct Counter{
+			std::atomic<size_t> live;
+			std::atomic<size_t> peak;
+			std::atomic<unsigned long long> allocations;
+			//allocations pr. second at the last sample:
+			std::atomic<double> rate;
+			//state at the last sample and the start of the run:
+			unsigned long long lastAllocations;
+			unsigned long long runAllocations;
+		};
+		static void grow(Counter &counter, size_t bytes){
+			size_t now = counter.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+			size_t peak = counter.peak.load(std::memory_order_relaxed);
+			while(now > peak && !counter.peak.compare_exchange_weak(peak, now,
+						std::memory_order_relaxed));
+		}
+
+		static Counter counters[TAG_AMOUNT];
+		static std::atomic<size_t> luaHeapPeak;
+};
+
+/**
+ * Standard allocator which counts its memory in a MemAccount subsystem.
+ */
+template<class T, MemAccount::Tag TAG>
+class TaggedAllocator
+{
+	public:
+		typedef T value_type;
+		template<class U> struct rebind{ typedef TaggedAllocator<U, TAG> other; };
+
+		TaggedAllocator(){}
+		template<class U> TaggedAllocator(const TaggedAllocator<U, TAG>&){}
+
+		T* allocate(size_t amount){
+			MemAccount::allocated(TAG, amount * sizeof(T));
+			return static_cast<T*>(::operator new(amount * sizeof(T)));
+		}
+		void deallocate(T *ptr, size_t amount){
+			MemAccount::freed(TAG, amount * sizeof(T));
+			::operator delete(ptr);
+		}
+};
+
+template<class T, class U, MemAccount::Tag TAG>
+bool operator==(const TaggedAllocator<T, TAG>&, const TaggedAllocator<U, TAG>&){ return true; }
+template<class T, class U, MemAccount::Tag TAG>
+bool operator!=(const TaggedAllocator<T, TAG>&, const TaggedAllocator<U, TAG>&){ return false; }
+
+#endif // MEMACCOUNT_H
@@ -0,0 +1,226 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "memaccount.h"
+
+Metrics* Metrics::metrics;
+std::atomic<bool> Metrics::enabled(false);
+std::atomic<unsigned long long> Metrics::luaCallbacks(0);
+const int Metrics::INTERVAL;
+
+/**
+ * Singleton accessor.
+ * Like Output::Inst() it is not threadsafe, it must be called from the
+ * main thread first.
+ */
+Metrics* Metrics::Inst(){
+	if(!metrics)
+		metrics = new Metrics();
+	return metrics;
+}
+
+	Metrics::Metrics()
+:stopping(false), running(false), iterations(0), timeResolution(0), runStart(0),
+	runSeconds(0),
+	lastPublish(clock::now())
+{
+	for(int i = 0; i < COUNTER_AMOUNT; i++){
+		counters[i] = 0;
+		lastCounters[i] = 0;
+	}
+}
+
+/**
+ * Start publishing the metrics to a file.
+ * @return false if the file can't be written.
+ */
+bool Metrics::enable(std::string filename){
+	if(isEnabled())
+		return true;
+	FILE *file = fopen(filename.c_str(), "w");
+	if(file == NULL)
+		return false;
+	fclose(file);
+
+	this->filename = filename;
+	stopping = false;
+	lastPublish = clock::now();
+	enabled.store(true);
+	publishThread = std::thread(&Metrics::publishLoop, this);
+	return true;
+}
+
+/**
+ * Stop the publishing thread, after a final publication.
+ */
+void Metrics::close(){
+	if(!isEnabled())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(publishMutex);
+		stopping = true;
+	}
+	publishCondition.notify_one();
+	publishThread.join();
+	enabled.store(false);
+}
+
+/**
+ * A simulation run starts.
+ * @param iterations number of tmu the run will take.
+ * @param timeResolution seconds pr. tmu.
+ */
+void Metrics::beginRun(unsigned long long iterations, double timeResolution){
+	this->iterations.store(iterations, std::memory_order_relaxed);
+	this->timeResolution.store(timeResolution, std::memory_order_relaxed);
+	runStart.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+	running.store(true, std::memory_order_release);
+}
+
+void Metrics::endRun(){
+	long long now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			clock::now().time_since_epoch()).count();
+	runSeconds.store((now - runStart.load(std::memory_order_relaxed)) / 1e9,
+			std::memory_order_relaxed);
+	running.store(false, std::memory_order_release);
+}
+
+/**
+ * Copy the counters of the simulation.
+ * The counters are totals, the rates are computed when they are published.
+ * @param tmu current tmu.
+ * @param initiated external events initiated by the autons.
+ * @param distributed external events distributed to the Nestenes.
+ * @param internal internal events acted on.
+ * @param responses external events sent in response to internal events.
+ * @param internalQueue internal events in the queue.
+ * @param externalQueue external events in the queue.
+ */
+void Metrics::update(unsigned long long tmu, unsigned long long initiated,
+		unsigned long long distributed, unsigned long long internal,
+		unsigned long long responses, unsigned long long internalQueue,
+		unsigned long long externalQueue){
+	counters[TMU].store(tmu, std::memory_order_relaxed);
+	counters[INITIATED].store(initiated, std::memory_order_relaxed);
+	counters[DISTRIBUTED].store(distributed, std::memory_order_relaxed);
+	counters[INTERNAL].store(internal, std::memory_order_relaxed);
+	counters[RESPONSES].store(responses, std::memory_order_relaxed);
+	counters[INTERNAL_QUEUE].store(internalQueue, std::memory_order_relaxed);
+	counters[EXTERNAL_QUEUE].store(externalQueue, std::memory_order_relaxed);
+}
+
+void Metrics::publishLoop(){
+	std::unique_lock<std::mutex> lock(publishMutex);
+	while(!stopping){
+		publishCondition.wait_for(lock, std::chrono::milliseconds(INTERVAL));
+		publish();
+	}
+}
+
+/**
+ * Resident memory of the process, from /proc/self/statm.
+ */
+unsigned long long Metrics::residentKB(){
+	unsigned long long size = 0, resident = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if(statm == NULL)
+		return 0;
+	if(fscanf(statm, "%llu %llu", &size, &resident) != 2)
+		resident = 0;
+	fclose(statm);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Write the metrics file.
+ * The document is written to <filename>.tmp and renamed over the file.
+ */
+void Metrics::publish(){
+	clock::time_point now = clock::now();
+	double interval = std::chrono::duration_cast<std::chrono::duration<double>>(now - lastPublish).count();
+	lastPublish = now;
+	if(interval <= 0)
+		interval = INTERVAL / 1000.0;
+
+	counters[LUA_CALLBACKS].store(luaCallbacks.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+	unsigned long long value[COUNTER_AMOUNT];
+	double rate[COUNTER_AMOUNT];
+	for(int i = 0; i < COUNTER_AMOUNT; i++){
+		value[i] = counters[i].load(std::memory_order_relaxed);
+		//the counters start over with a new environment:
+		unsigned long long delta = value[i] >= lastCounters[i] ? value[i] - lastCounters[i] : value[i];
+		rate[i] = delta / interval;
+		lastCounters[i] = value[i];
+	}
+
+	bool isRunning = running.load(std::memory_order_acquire);
+	double resolution = timeResolution.load(std::memory_order_relaxed);
+	unsigned long long total = iterations.load(std::memory_order_relaxed);
+	long long start = runStart.load(std::memory_order_relaxed);
+	double wallSeconds = runSeconds.load(std::memory_order_relaxed);
+	if(isRunning)
+		wallSeconds = (std::chrono::duration_cast<std::chrono::nanoseconds>(
+					now.time_since_epoch()).count() - start) / 1e9;
+	double simSeconds = value[TMU] * resolution;
+
+	std::string tmpName = filename + ".tmp";
+	FILE *file = fopen(tmpName.c_str(), "w");
+	if(file == NULL)
+		return;
+	fprintf(file, "{\n"
+			"\t\"time\": %lld,\n"
+			"\t\"running\": %s,\n"
+			"\t\"tmu\": %llu,\n"
+			"\t\"iterations\": %llu,\n"
+			"\t\"progress\": %.4f,\n"
+			"\t\"sim_seconds\": %.6f,\n"
+			"\t\"wall_seconds\": %.3f,\n"
+			"\t\"wall_clock_ratio\": %.6f,\n"
+			"\t\"current_wall_clock_ratio\": %.6f,\n"
+			"\t\"events_per_s\": {\"initiated\": %.1f, \"distributed\": %.1f, "
+			"\"internal\": %.1f, \"responses\": %.1f},\n"
+			"\t\"lua_callbacks_per_s\": %.1f,\n"
+			"\t\"queue\": {\"internal\": %llu, \"external\": %llu},\n"
+			"\t\"memory\": {",
+			(long long)time(NULL), isRunning ? "true" : "false",
+			value[TMU], total, total > 0 ? (double)value[TMU] / total : 0.0,
+			simSeconds, wallSeconds, wallSeconds > 0 ? simSeconds / wallSeconds : 0.0,
+			isRunning ? rate[TMU] * resolution : 0.0,
+			rate[INITIATED], rate[DISTRIBUTED], rate[INTERNAL], rate[RESPONSES],
+			rate[LUA_CALLBACKS], value[INTERNAL_QUEUE], value[EXTERNAL_QUEUE]);
+	for(int i = 0; i < MemAccount::TAG_AMOUNT; i++)
+		fprintf(file, "%s\n\t\t\"%s\": {\"live\": %llu, \"peak\": %llu, \"allocs_per_s\": %.1f}",
+				i > 0 ? "," : "", MemAccount::name(i),
+				(unsigned long long)MemAccount::live(i), (unsigned long long)MemAccount::peak(i),
+				MemAccount::rate(i));
+	fprintf(file, "\n\t},\n"
+			"\t\"rss_kb\": %llu\n"
+			"}\n", residentKB());
+	fclose(file);
+	rename(tmpName.c_str(), filename.c_str());
+}
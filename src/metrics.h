@@ -0,0 +1,111 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+/**
+ * Live metrics of the running simulation.
+ * A background thread writes the metrics as a JSON document every
+ * INTERVAL milliseconds, to a temporary file which is renamed over the
+ * metrics file, so readers always see a complete document.
+ *
+ * The simulation thread only copies its counters with update(), which is
+ * done together with the status update of the running panel, rates and
+ * the resident memory are computed by the publishing thread. The Lua
+ * callbacks are counted with a relaxed atomic increment.
+ *
+ * Like Output it is a singleton, and disabled by default.
+ */
+class Metrics
+{
+	public:
+		static const int INTERVAL = 1000; //[ms]
+
+		static Metrics* Inst();
+		static bool isEnabled(){ return enabled.load(std::memory_order_relaxed); }
+		static void countLuaCallback(){
+			if(isEnabled())
+				luaCallbacks.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		bool enable(std::string filename);
+		void close();
+
+		void beginRun(unsigned long long iterations, double timeResolution);
+		void endRun();
+		void update(unsigned long long tmu, unsigned long long initiated,
+				unsigned long long distributed, unsigned long long internal,
+				unsigned long long responses, unsigned long long internalQueue,
+				unsigned long long externalQueue);
+
+	private:
+		Metrics();
+		Metrics(Metrics const&){};
+		static Metrics* metrics;
+		static std::atomic<bool> enabled;
+		static std::atomic<unsigned long long> luaCallbacks;
+
+		typedef std::chrono::steady_clock clock;
+
+		//counters copied from the simulation:
+		enum Counter{
+			TMU = 0,
+			INITIATED,
+			DISTRIBUTED,
+			INTERNAL,
+			RESPONSES,
+			INTERNAL_QUEUE,
+			EXTERNAL_QUEUE,
+			LUA_CALLBACKS,
+			COUNTER_AMOUNT
+		};
+
+		void publishLoop();
+		void publish();
+		unsigned long long residentKB();
+
+		std::string filename;
+		std::thread publishThread;
+		std::mutex publishMutex;
+		std::condition_variable publishCondition;
+		bool stopping;
+
+		std::atomic<bool> running;
+		std::atomic<unsigned long long> iterations;
+		std::atomic<double> timeResolution;
+		std::atomic<long long> runStart; //[ns] since the clock epoch
+		std::atomic<double> runSeconds; //wall time of the last run, once done
+		std::atomic<unsigned long long> counters[COUNTER_AMOUNT];
+
+		//values of the last publication, used for the rates:
+		unsigned long long lastCounters[COUNTER_AMOUNT];
+		clock::time_point lastPublish;
+};
+
+#endif // METRICS_H
@@ -27,6 +27,9 @@
 #include <panel.h>
 //THREAD:
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
 //STL:
 #include <list>
 //STD:
@@ -36,11 +39,16 @@
 #include <stdlib.h>
 #include <climits>
 #include <cfloat>
+#include <algorithm>
 
 #include "output.h"
+#include "memaccount.h"
+#include "positionsnapshot.h"
 #include "../build/kasterborous.h"
 
 Output* Output::output;
+bool Output::headless = false;
+const int Output::STATUS_INTERVAL;
 
 /**
  * Singleton accessor.
@@ -57,14 +65,39 @@ Output* Output::Inst()
 	return output;
 }
 
+/**
+ * Run without Ncurses.
+ * Used for batch runs without a terminal, must be set before the first
+ * call to Inst().
+ */
+void Output::setHeadless(bool enabled){
+	headless = enabled;
+}
+
 /**
  * Outputs private constructor.
  * sets up the different ncurses modes, colors etc.
  */
 	Output::Output()
-:currentDebugLine(0), currentInfoLine(0)
+:mapPanels(false), mapSnapshot(NULL), mapZoom(0), mapCenterX(0.5), mapCenterY(0.5), drawnMapVersion(0),
+	currentDebugLine(0), currentInfoLine(0), rendering(true), logQueue(LOG_CAPACITY),
+	droppedLines(0), statusSeq(0), statusTmu(0), statusInit(0), statusInternal(0),
+	statusExternal(0), progressCurrent(0), progressMaximum(0), phaseAmount(0), eventRate(0),
+	rateSamples(0), drawnSeq(0), drawnRateSample(0), drawnCells(0)
 {
+	for(int i = 0; i < MAX_PHASES; i++){
+		phaseNames[i] = NULL;
+		phaseShares[i] = 0;
+	}
 	std::lock_guard<std::mutex> lock(outputMutex);
+	c_mode = MODE_RUNNING;
+	debugVector = new std::vector<std::string>;
+	infoVector = new std::vector<int>;
+	lastStatusLine = std::chrono::steady_clock::now();
+	if(headless){
+		renderThread = std::thread(&Output::renderLoop, this);
+		return;
+	}
 	//init all the Ncurses stuff:
 	initscr();
 	keypad(stdscr,TRUE);
@@ -85,8 +118,8 @@ Output* Output::Inst()
 	update_panels();
 	doupdate();
 	c_mode = MODE_INPUT;
-	debugVector = new std::vector<std::string>;
-	infoVector = new std::vector<int>;
+	//will wait for the lock until the constructor is done:
+	renderThread = std::thread(&Output::renderLoop, this);
 }
 
 /**
@@ -96,6 +129,8 @@ Output* Output::Inst()
  * @param ch input character.
  */
 void Output::keyHandler(int ch){
+	if(headless)
+		return;
 	std::lock_guard<std::mutex> lock(outputMutex);
 	refresh();
 	switch(ch){
@@ -171,6 +206,8 @@ void Output::handleInput(int ch){
  * @param ch input character
  */
 void Output::handleMap(int ch){
+	//pan by a quarter of the view:
+	double step = 0.25 / (1 << mapZoom);
 	switch(ch){
 		case 9 :
 			rMapTop = (PANEL *)panel_userptr(rMapTop);
@@ -178,8 +215,38 @@ void Output::handleMap(int ch){
 			update_panels();
 			doupdate();
 			//refresh();
+			return;
+		case '+' :
+		case '=' :
+			mapZoom = std::min(mapZoom + 1, MAX_ZOOM);
+			break;
+		case '-' :
+			mapZoom = std::max(mapZoom - 1, 0);
 			break;
+		case '0' :
+			mapZoom = 0;
+			mapCenterX = mapCenterY = 0.5;
+			break;
+		case KEY_LEFT :
+			mapCenterX -= step;
+			break;
+		case KEY_RIGHT :
+			mapCenterX += step;
+			break;
+		case KEY_UP :
+			mapCenterY -= step;
+			break;
+		case KEY_DOWN :
+			mapCenterY += step;
+			break;
+		default :
+			return;
 	}
+	//keep the center where the view stays within the map:
+	double half = 0.5 / (1 << mapZoom);
+	mapCenterX = std::min(std::max(mapCenterX, half), 1 - half);
+	mapCenterY = std::min(std::max(mapCenterY, half), 1 - half);
+	renderMaps();
 }
 
 /**
@@ -333,6 +400,9 @@ void Output::resetAll(){
 	update_panels();
 	doupdate();
 	c_mode = MODE_INPUT;
+	//the new windows are empty, have the render thread redraw everything:
+	drawnSeq = ULLONG_MAX;
+	drawnCells = 0;
 }
 
 
@@ -393,28 +463,49 @@ void Output::getInputData(int &screamerAmount, int &listenerAmount, int &luaAmou
 /**
  * printf wrapper function.
  * printf wrapper which writes the msg on the currently active output screen.
+ * The formatted line is queued for the render thread, if the queue is full
+ * the line is dropped and counted, the caller never waits on the terminal.
  * @param msg
  * @param variable list
  * @see vwprintw
  * @see printf
  */
 void Output::kprintf(const char* msg, ...){
-	std::lock_guard<std::mutex> lock(outputMutex);
-	va_list args;
+	char buffer[256];
+	std::string line;
+	va_list args, copy;
 	va_start(args,msg);
-	switch(c_mode){
-		case MODE_INPUT:
-			vwprintw(rInputEchoWin,msg,args);
-			wrefresh(rInputEchoWin);
-			break;
-		case MODE_RUNNING:
-			vwprintw(rRunningEchoWin,msg,args);
-			wrefresh(rRunningEchoWin);
-			break;
-		default:
-			break;
-	}
+	va_copy(copy,args);
+	int size = vsnprintf(buffer, sizeof(buffer), msg, args);
 	va_end(args);
+	if(size >= (int)sizeof(buffer)){
+		line.resize(size + 1);
+		vsnprintf(&line[0], size + 1, msg, copy);
+		line.resize(size);
+	}else if(size > 0)
+		line.assign(buffer, size);
+	va_end(copy);
+
+	if(size > 0 && !logQueue.push(std::move(line)))
+		droppedLines.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Start writing the status snapshot.
+ * Waits for a concurrent writer to finish, the render thread ignores
+ * the snapshot while the sequence is odd.
+ */
+void Output::beginPublish(){
+	unsigned long long seq = statusSeq.load(std::memory_order_relaxed);
+	do{
+		seq &= ~1ULL;
+	}while(!statusSeq.compare_exchange_weak(seq, seq + 1,
+				std::memory_order_acquire, std::memory_order_relaxed));
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Output::endPublish(){
+	statusSeq.fetch_add(1, std::memory_order_release);
 }
 
 /**
@@ -422,67 +513,24 @@ void Output::kprintf(const char* msg, ...){
  * Renders a progress bar in the 'Running' panel, fills ~1/6 of the screen width
  * colours are: red progress < 30%, yellow (30%< progress <70%),
  * green progress > 70%.
+ * The progress is published to the render thread, which only draws the 
+ * cells added since the last frame.
  * @param current current value of progress.
  * @param maximum value of progress, ie when it's done.
  */
 void Output::progressBar(unsigned long long current, unsigned long long maximum){
-	std::lock_guard<std::mutex> lock(outputMutex);
-
-	//if(c_mode == MODE_RUNNING){
-		int barmaxX, barmaxY, barHeight, barSize;
-
-		//getting the max y,x sizes for the bar:
-		getmaxyx(rRunningProgressWin, barmaxY, barmaxX);
-
-		int total = barmaxY * barmaxX;
-		int complete = (total * current)/maximum;
-
-		wattron(rRunningProgressWin,A_BOLD);
-		curs_set(0);
-		int j = 0;
-		int k = 0;
-		
-		for(int i=0; i<complete; i++){
-			if(i % (barmaxX) == 0){
-				j++; //the row:
-				//wmove(rRunningProgressWin, barmaxY-j,0);
-				//wclrtoeol(rRunningProgressWin);
-				k=0; //the colum:
-			}
-			if((i*100)/total < 30){
-				wattron(rRunningProgressWin,COLOR_PAIR(1));
-				mvwprintw(rRunningProgressWin,barmaxY-j,k,"=");
-				wattroff(rRunningProgressWin,COLOR_PAIR(1));
-			} else if((i*100)/total > 70 ){
-				wattron(rRunningProgressWin,COLOR_PAIR(2));
-				mvwprintw(rRunningProgressWin,barmaxY-j,k,"=");
-				wattroff(rRunningProgressWin,COLOR_PAIR(2));
-			} else{
-				wattron(rRunningProgressWin,COLOR_PAIR(3));		
-				mvwprintw(rRunningProgressWin,barmaxY-j,k,"=");
-				wattroff(rRunningProgressWin,COLOR_PAIR(3));
-			}
-			k++;
-		}
-		wattroff(rRunningProgressWin,A_BOLD);
-		double percentage = (double)(current *100) /(double)maximum;
-		mvwprintw(rRunningStatusWin, 10, 1, "%*f",12, percentage);
-		updateScr();
-	//}
+	beginPublish();
+	progressCurrent.store(current, std::memory_order_relaxed);
+	progressMaximum.store(maximum, std::memory_order_relaxed);
+	endPublish();
 }
 
 void Output::updatePercentageDone(unsigned long long current, unsigned long long maximum){
-	std::lock_guard<std::mutex> lock(outputMutex);
-	double percentage = (double)(current *100) /(double)maximum;
-	mvwprintw(rRunningStatusWin, 10, 1, "%*f",12, percentage);
-	updateScr();
+	progressBar(current, maximum);
 }
 
 void Output::clearProgressBar(){
-	std::lock_guard<std::mutex> lock(outputMutex);
-	wclear(rRunningProgressWin);
-	updateScr();
-	//wrefresh(rRunningStatusWin);
+	progressBar(0, 0);
 }
 
 /**
@@ -496,158 +544,485 @@ void Output::clearProgressBar(){
  */
 void Output::updateStatus(unsigned long long ms, unsigned long long eventInit,
 		unsigned long long internalEvents, unsigned long long externalEvents){
+	beginPublish();
+	statusTmu.store(ms, std::memory_order_relaxed);
+	statusInit.store(eventInit, std::memory_order_relaxed);
+	statusInternal.store(internalEvents, std::memory_order_relaxed);
+	statusExternal.store(externalEvents, std::memory_order_relaxed);
+	endPublish();
+}
+
+/**
+ * Phase timing in the status screen.
+ * Shows the share of the wall time spent in each phase, and adds the
+ * event rate to a sparkline.
+ * @param names names of the phases, must stay valid, string literals.
+ * @param shares share of the wall time of each phase, 0-1.
+ * @param amount number of phases, at most MAX_PHASES are shown.
+ * @param rate events pr. second.
+ */
+void Output::updatePhases(const char *const *names, const double *shares, int amount,
+		double rate){
+	if(amount > MAX_PHASES)
+		amount = MAX_PHASES;
+	beginPublish();
+	for(int i = 0; i < amount; i++){
+		phaseNames[i].store(names[i], std::memory_order_relaxed);
+		phaseShares[i].store(shares[i], std::memory_order_relaxed);
+	}
+	phaseAmount.store(amount, std::memory_order_relaxed);
+	eventRate.store(rate, std::memory_order_relaxed);
+	rateSamples.fetch_add(1, std::memory_order_relaxed);
+	endPublish();
+}
+
+/*------------------------------------------------------------------
+ * The render thread:
+ *------------------------------------------------------------------*/
+
+/**
+ * Render loop.
+ * Draws a frame every 1/FRAME_RATE second until stopRender() is called.
+ */
+void Output::renderLoop(){
+	using namespace std::chrono;
+	const steady_clock::duration interval = milliseconds(1000/FRAME_RATE);
+	steady_clock::time_point next = steady_clock::now();
+
+	while(rendering.load(std::memory_order_acquire)){
+		renderFrame();
+		next += interval;
+		//do not try to catch up on frames missed:
+		steady_clock::time_point now = steady_clock::now();
+		if(next < now)
+			next = now;
+		std::this_thread::sleep_until(next);
+	}
+}
+
+/**
+ * Stop the render thread.
+ * Draws the log lines still queued, after this call nothing is drawn
+ * so it is safe to end the Ncurses session.
+ */
+void Output::stopRender(){
+	rendering.store(false, std::memory_order_release);
+	if(renderThread.joinable()){
+		renderThread.join();
+		renderFrame();
+	}
+}
+
+/**
+ * Draw a single frame.
+ * Writes the queued log lines to the output box of the current mode and
+ * redraws the status and progress bar if a new snapshot is published.
+ * Only the windows of the current mode are refreshed.
+ */
+void Output::renderFrame(){
+	if(headless){
+		renderHeadless();
+		return;
+	}
 	std::lock_guard<std::mutex> lock(outputMutex);
-	//curs_set(0);
+	bool dirty = false;
+
+	WINDOW *echoWin = NULL;
+	if(c_mode == MODE_INPUT)
+		echoWin = rInputEchoWin;
+	else if(c_mode == MODE_RUNNING)
+		echoWin = rRunningEchoWin;
+
+	//bounded, a flood of lines should not stall the frame:
+	std::string line;
+	for(size_t i = 0; i < LOG_CAPACITY && logQueue.pop(line); i++){
+		if(echoWin != NULL){
+			waddstr(echoWin, line.c_str());
+			dirty = true;
+		}
+	}
+	unsigned long long dropped = droppedLines.exchange(0, std::memory_order_relaxed);
+	if(dropped > 0 && echoWin != NULL){
+		wprintw(echoWin, "[%llu lines dropped]\n", dropped);
+		dirty = true;
+	}
+
+	Snapshot snapshot;
+	if(readSnapshot(snapshot)){
+		//nothing is published before the first run:
+		if(snapshot.seq != 0)
+			drawStatus(snapshot.status);
+		drawProgress(snapshot.progress, snapshot.progressMax);
+		drawPhases(snapshot);
+		drawnSeq = snapshot.seq;
+		dirty = true;
+	}
+
+	//redraw the maps when the run has published new positions:
+	if(c_mode == MODE_MAP && mapPanels && mapSnapshot != NULL
+			&& mapSnapshot->getVersion() != drawnMapVersion)
+		renderMaps();
+
+	if(!dirty)
+		return;
+
 	switch(c_mode){
-		case MODE_RUNNING :{
-					   //clear the lines:
-					   for(int i = 2; i <= 8 ;){
-						   wmove(rRunningStatusWin, i,1);	
-						   wclrtoeol(rRunningStatusWin);
-						   i += 2;
-					   }
-					   wattron(rRunningStatusWin,COLOR_PAIR(2));	
-					   box(rRunningStatusWin,0,0);
-					   wattroff(rRunningStatusWin,COLOR_PAIR(2));
-					   int padding = 12;
-					   //then the outputs:
-					   mvwprintw(rRunningStatusWin, 2, 1, "%*llu", padding,ms);
-					   mvwprintw(rRunningStatusWin, 4, 1, "%*i", padding,eventInit);
-					   mvwprintw(rRunningStatusWin, 6, 1, "%*i", padding,internalEvents);
-					   mvwprintw(rRunningStatusWin, 8, 1, "%*i", padding,externalEvents);
-					   //wrefresh(rRunningStatusWin);
-				   }
-				   break;
+		case MODE_INPUT:
+			wnoutrefresh(rInputEchoWin);
+			doupdate();
+			break;
+		case MODE_RUNNING:
+			wnoutrefresh(rRunningEchoWin);
+			wnoutrefresh(rRunningStatusWin);
+			wnoutrefresh(rRunningProgressWin);
+			doupdate();
+			break;
 		default:
-				   break;
+			break;
 	}
-	//curs_set(1);
-	doupdate();
+}
+
+/**
+ * Headless version of a frame.
+ * Writes the queued log lines to stderr, and a line with the status and
+ * progress every STATUS_INTERVAL seconds.
+ */
+void Output::renderHeadless(){
+	std::lock_guard<std::mutex> lock(outputMutex);
+	std::string line;
+	bool written = false;
+	for(size_t i = 0; i < LOG_CAPACITY && logQueue.pop(line); i++){
+		fputs(line.c_str(), stderr);
+		written = true;
+	}
+	unsigned long long dropped = droppedLines.exchange(0, std::memory_order_relaxed);
+	if(dropped > 0){
+		fprintf(stderr, "[%llu lines dropped]\n", dropped);
+		written = true;
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	Snapshot snapshot;
+	if(now - lastStatusLine >= std::chrono::seconds(STATUS_INTERVAL)
+			&& readSnapshot(snapshot) && snapshot.progressMax > 0){
+		fprintf(stderr, "[status] %6.2f%% tmu %llu, initiated %llu, queued internal %llu, "
+				"external %llu, %.0f events/s, %.1f MB accounted\n",
+				(double)(snapshot.progress*100)/(double)snapshot.progressMax,
+				snapshot.status[0], snapshot.status[1], snapshot.status[2],
+				snapshot.status[3], snapshot.eventRate,
+				MemAccount::liveTotal() / (1024.0 * 1024.0));
+		drawnSeq = snapshot.seq;
+		lastStatusLine = now;
+		written = true;
+	}
+	if(written)
+		fflush(stderr);
+}
+
+/**
+ * Read the status snapshot.
+ * @return false if nothing new is published since the last snapshot drawn,
+ * or if it is being written, it is then read again next frame.
+ */
+bool Output::readSnapshot(Snapshot &snapshot){
+	unsigned long long seq = statusSeq.load(std::memory_order_acquire);
+	if(seq == drawnSeq || (seq & 1) == 1)
+		return false;
+
+	snapshot.seq = seq;
+	snapshot.status[0] = statusTmu.load(std::memory_order_relaxed);
+	snapshot.status[1] = statusInit.load(std::memory_order_relaxed);
+	snapshot.status[2] = statusInternal.load(std::memory_order_relaxed);
+	snapshot.status[3] = statusExternal.load(std::memory_order_relaxed);
+	snapshot.progress = progressCurrent.load(std::memory_order_relaxed);
+	snapshot.progressMax = progressMaximum.load(std::memory_order_relaxed);
+	snapshot.phaseAmount = phaseAmount.load(std::memory_order_relaxed);
+	for(int i = 0; i < snapshot.phaseAmount; i++){
+		snapshot.phaseNames[i] = phaseNames[i].load(std::memory_order_relaxed);
+		snapshot.phaseShares[i] = phaseShares[i].load(std::memory_order_relaxed);
+	}
+	snapshot.eventRate = eventRate.load(std::memory_order_relaxed);
+	snapshot.rateSample = rateSamples.load(std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return statusSeq.load(std::memory_order_relaxed) == seq;
+}
+
+/**
+ * Draw the status values.
+ * @param status current tmu, events initiated, internal and external
+ * events in the queue.
+ */
+void Output::drawStatus(const unsigned long long *status){
+	//clear the lines:
+	for(int i = 2; i <= 8 ;){
+		wmove(rRunningStatusWin, i,1);	
+		wclrtoeol(rRunningStatusWin);
+		i += 2;
+	}
+	wattron(rRunningStatusWin,COLOR_PAIR(2));	
+	box(rRunningStatusWin,0,0);
+	wattroff(rRunningStatusWin,COLOR_PAIR(2));
+	int padding = 12;
+	//then the outputs:
+	for(int i = 0; i < 4; i++)
+		mvwprintw(rRunningStatusWin, 2 + 2*i, 1, "%*llu", padding, status[i]);
+}
+
+/**
+ * Draw the phase shares and the event rate sparkline.
+ * Drawn below the status values, as far as the status window goes.
+ */
+void Output::drawPhases(const Snapshot &snapshot){
+	if(snapshot.phaseAmount == 0)
+		return;
+	if(snapshot.rateSample != drawnRateSample){
+		drawnRateSample = snapshot.rateSample;
+		rateHistory.push_back(snapshot.eventRate);
+		if(rateHistory.size() > RATE_HISTORY)
+			rateHistory.erase(rateHistory.begin());
+	}
+
+	int maxY, maxX;
+	getmaxyx(rRunningStatusWin, maxY, maxX);
+	int width = maxX - 2;
+	int row = 12;
+	for(int i = row; i < maxY - 1; i++){
+		wmove(rRunningStatusWin, i, 1);
+		wclrtoeol(rRunningStatusWin);
+	}
+
+	wattron(rRunningStatusWin,COLOR_PAIR(2));
+	wattron(rRunningStatusWin,A_BOLD);
+	if(row < maxY - 1)
+		mvwprintw(rRunningStatusWin, row++, 1, "Share of wall time pr. phase");
+	wattroff(rRunningStatusWin,A_BOLD);
+	for(int i = 0; i < snapshot.phaseAmount && row < maxY - 1; i++, row++){
+		double share = snapshot.phaseShares[i];
+		mvwprintw(rRunningStatusWin, row, 1, "%-8.8s%6.1f%% ", snapshot.phaseNames[i], share*100);
+		int bar = (int)((width - 16) * share + 0.5);
+		for(int j = 0; j < bar && 16 + j < width; j++)
+			waddch(rRunningStatusWin, '#');
+	}
+	wattron(rRunningStatusWin,A_BOLD);
+	if(row < maxY - 1)
+		mvwprintw(rRunningStatusWin, ++row, 1, "Events/s %*.0f", 12, snapshot.eventRate);
+	wattroff(rRunningStatusWin,A_BOLD);
+	wattroff(rRunningStatusWin,COLOR_PAIR(2));
+
+	//the sparkline of the last samples, scaled to the highest of them:
+	if(++row < maxY - 1 && width > 0){
+		static const char levels[] = " _.-=+*#";
+		size_t amount = std::min(rateHistory.size(), (size_t)width);
+		size_t first = rateHistory.size() - amount;
+		double highest = 0;
+		for(size_t i = first; i < rateHistory.size(); i++)
+			highest = std::max(highest, rateHistory[i]);
+		wmove(rRunningStatusWin, row, 1);
+		for(size_t i = first; i < rateHistory.size(); i++){
+			int level = highest > 0 ? (int)(rateHistory[i] / highest * 7 + 0.5) : 0;
+			waddch(rRunningStatusWin, levels[level]);
+		}
+	}
+
+	//memory pr. subsystem, read directly from the relaxed counters:
+	row += 2;
+	wattron(rRunningStatusWin,COLOR_PAIR(2));
+	wattron(rRunningStatusWin,A_BOLD);
+	if(row < maxY - 1)
+		mvwprintw(rRunningStatusWin, row++, 1, "%-8s%9s%9s%11s", "Memory", "live[MB]",
+				"peak[MB]", "allocs/s");
+	wattroff(rRunningStatusWin,A_BOLD);
+	for(int i = 0; i < MemAccount::TAG_AMOUNT && row < maxY - 1; i++, row++)
+		mvwprintw(rRunningStatusWin, row, 1, "%-8.8s%9.2f%9.2f%11.0f", MemAccount::name(i),
+				MemAccount::live(i) / (1024.0 * 1024.0), MemAccount::peak(i) / (1024.0 * 1024.0),
+				MemAccount::rate(i));
+	wattroff(rRunningStatusWin,COLOR_PAIR(2));
+
+	wattron(rRunningStatusWin,COLOR_PAIR(2));
+	box(rRunningStatusWin,0,0);
+	wattroff(rRunningStatusWin,COLOR_PAIR(2));
+}
+
+/**
+ * Draw the progress bar.
+ * Only the cells added since the last call are drawn, the bar is cleared
+ * if the progress goes backwards. A maximum of zero clears the bar.
+ * @param current current value of progress.
+ * @param maximum value of progress, ie when it's done.
+ */
+void Output::drawProgress(unsigned long long current, unsigned long long maximum){
+	int barmaxX, barmaxY;
+
+	//getting the max y,x sizes for the bar:
+	getmaxyx(rRunningProgressWin, barmaxY, barmaxX);
+
+	int total = barmaxY * barmaxX;
+	int complete = 0;
+	if(maximum > 0 && current < maximum)
+		complete = (int)(((double)total * current)/maximum);
+	else if(maximum > 0)
+		complete = total;
+
+	if(complete < drawnCells){
+		wclear(rRunningProgressWin);
+		drawnCells = 0;
+	}
+	if(maximum == 0)
+		return;
+
+	wattron(rRunningProgressWin,A_BOLD);
+	curs_set(0);
+	for(int i = drawnCells; i < complete; i++){
+		int j = i / barmaxX + 1; //the row:
+		int k = i % barmaxX; //the colum:
+		int pair = 3;
+		if((i*100)/total < 30)
+			pair = 1;
+		else if((i*100)/total > 70)
+			pair = 2;
+		wattron(rRunningProgressWin,COLOR_PAIR(pair));
+		mvwprintw(rRunningProgressWin,barmaxY-j,k,"=");
+		wattroff(rRunningProgressWin,COLOR_PAIR(pair));
+	}
+	wattroff(rRunningProgressWin,A_BOLD);
+	drawnCells = complete;
+
+	double percentage = (double)(current *100) /(double)maximum;
+	mvwprintw(rRunningStatusWin, 10, 1, "%*f",12, percentage);
 }
 
 /** 
  * Generate Map panels
- * Generates the maps based on position data received on the three populations
- * one map for each population and one for all of the different populations.
- * @param sylist y positions of all Screamer autons
- * @param sxlist x positions of all Screamer autons
- * @param lylist y positions of all Listener autons
- * @param lxlist x positions of all Listener autons
- * @param aylist y positions of all Lua autons
- * @param axlist x positions of all Lua autons
- * @param yMax maps maximum height
- * @param xMax maps maximum width
+ * Generates the map panels, one map for each population and one for all
+ * of the different populations, and renders the latest published position
+ * snapshot in them. While a simulation runs the maps are redrawn by the
+ * render thread whenever a new snapshot is published.
+ * @param snapshot the positions of the simulation, read until releaseMap().
+ * @see PositionSnapshot
  */
-void Output::generateMapPanels(std::list<double> sylist, std::list<double> sxlist,
-		std::list<double> lylist, std::list<double> lxlist,
-		std::list<double> aylist, std::list<double> axlist, double yMax, double xMax){
+void Output::generateMapPanels(PositionSnapshot *snapshot){
 	std::lock_guard<std::mutex> lock(outputMutex);
+	mapSnapshot = snapshot;
+
+	//the panels are replaced, the terminal may have been resized:
+	if(mapPanels){
+		for(int i=0; i<4;i++){
+			del_panel(rMapPanels[i]);
+			delwin(rMapWindows[i]);
+			delwin(rMapBorderWin[i]);
+		}
+	}
 
 	//Generate the map panels:
 	for(int i=0; i<4;i++){
 		rMapBorderWin[i] = newwin(LINES-2,COLS-2,1,1);
-		wattron(rMapBorderWin[i],COLOR_PAIR(i));		
-		box(rMapBorderWin[i],0,0);
-		wattroff(rMapBorderWin[i],COLOR_PAIR(i));
 		rMapWindows[i] = derwin(rMapBorderWin[i],LINES-4,COLS-4,1,1);
 		rMapPanels[i] = new_panel(rMapBorderWin[i]);
 	}
-
-	mvwprintw(rMapBorderWin[0],0,1,"Screamer Placement, area: %ix%i[m]", (int)xMax, (int)yMax);
-	mvwprintw(rMapBorderWin[1],0,1,"Listener Placement, area: %ix%i[m]", (int)xMax, (int)yMax);
-	mvwprintw(rMapBorderWin[2],0,1,"LUA Placement, area: %ix%i[m]", (int)xMax, (int)yMax);
-	mvwprintw(rMapBorderWin[3],0,1,"ALL Placement, area: %ix%i[m]", (int)xMax, (int)yMax);
+	mapPanels = true;
 
 	set_panel_userptr(rMapPanels[0],rMapPanels[1]);	
 	set_panel_userptr(rMapPanels[1],rMapPanels[2]);	
 	set_panel_userptr(rMapPanels[2],rMapPanels[3]);	
 	set_panel_userptr(rMapPanels[3],rMapPanels[0]);
 
-	update_panels();	 
-	//Populate the maps with data:
-	mapRender(sylist,sxlist,yMax,xMax,0);
-	mapRender(lylist,lxlist,yMax,xMax,1);
-	mapRender(aylist,axlist,yMax,xMax,2);
-
-
-	std::list<double> allY;
-	allY.insert(allY.end(), sylist.begin(), sylist.end());
-	allY.insert(allY.end(), lylist.begin(), lylist.end());
-	allY.insert(allY.end(), aylist.begin(), aylist.end());
-	std::list<double> allX;
-	allX.insert(allX.end(), sxlist.begin(), sxlist.end());
-	allX.insert(allX.end(), lxlist.begin(), lxlist.end());
-	allX.insert(allX.end(), axlist.begin(), axlist.end());
-
-	mapRender(allY,allX,yMax,xMax,3);
 	rMapTop = rMapPanels[3];
 	top_panel(rMapTop);
-	update_panels();
-	doupdate();
+	renderMaps();
+}
 
+/**
+ * Stop reading the position snapshot of the maps.
+ * Must be called before the simulation owning it is deleted.
+ */
+void Output::releaseMap(){
+	std::lock_guard<std::mutex> lock(outputMutex);
+	mapSnapshot = NULL;
 }
 
 /**
- * Renders the a population distribution map.
- * Will render the populations given by positions in the x,y lists given.
- * @param ylist y positions
- * @param xlist x positions
- * @yMax maps height.
- * @xMax maps width.
- * @mapIndex the index of this map in the mappanel, which can contain several maps.
+ * Render the maps from the position snapshot.
+ * The positions within the zoomed view are counted into a density grid
+ * pr. auton type, the grid of all autons is their sum.
  */
-void Output::mapRender(std::list<double> ylist, std::list<double> xlist, double yMax, double xMax , int mapIndex){
-	std::list<double>::iterator xit;
-	std::list<double>::iterator yit;
-	double cX, cY;
+void Output::renderMaps(){
+	static const char *titles[4] = {"Screamer", "Listener", "LUA", "ALL"};
+	if(mapSnapshot == NULL)
+		return;
+	drawnMapVersion = mapSnapshot->getVersion();
+
+	PositionSnapshot::Reader reader(mapSnapshot);
+	const PositionSnapshot::Frame *frame = reader.frame();
+	if(frame == NULL)
+		return;
+
+	//the zoomed view, kept within the map:
+	double zoom = (double)(1 << mapZoom);
+	double viewWidth = frame->width / zoom;
+	double viewHeight = frame->height / zoom;
+	double viewX = std::min(std::max(mapCenterX * frame->width - viewWidth/2, 0.0),
+			frame->width - viewWidth);
+	double viewY = std::min(std::max(mapCenterY * frame->height - viewHeight/2, 0.0),
+			frame->height - viewHeight);
+
 	int wX, wY;
-	getmaxyx(rMapWindows[mapIndex], wY, wX);
-	//Make a map matrix
-	int mapValues[wY][wX];
-	//fill it with 0s
-	for(int i = 0; i<wY; i++){
-		for(int j = 0; j<wX; j++){
-			mapValues[i][j] = 0;
-			//kprintf("%i",mapValues[i][j]);
-		}
+	getmaxyx(rMapWindows[3], wY, wX);
+	for(int i=0; i<4;i++){
+		mapGrids[i].resize(wY, wX);
+		mapGrids[i].setView(viewX, viewY, viewWidth, viewHeight);
+		if(i < PositionSnapshot::TYPE_AMOUNT)
+			mapGrids[i].add(frame->x[i], frame->y[i]);
+		else
+			for(int type = 0; type < PositionSnapshot::TYPE_AMOUNT; type++)
+				mapGrids[i].add(mapGrids[type]);
 	}
 
-	for(xit=xlist.begin(), yit=ylist.begin(); xit!=xlist.end();++xit,++yit){
-		double tmpX = *xit;
-		double tmpY = *yit;
-		cX = (tmpX*wX)/xMax;
-		//if( (cX - (int)cX) > 0.5)
-		//	cX++;
-		cY = (tmpY *wY)/yMax;
-		//if( (cY - (int)cY) > 0.5)
-		//printf("positions read are, %f,%f\n", cX, cY);
-
-		//	cY++;
-		//kprintf("testing maprender y:%i, x:%i", (int)cX, (int)cY);
-
-		mapValues[(int)cY-0][(int)cX-0]++;
+	for(int i=0; i<4;i++){
+		werase(rMapBorderWin[i]);
+		wattron(rMapBorderWin[i],COLOR_PAIR(i));		
+		box(rMapBorderWin[i],0,0);
+		wattroff(rMapBorderWin[i],COLOR_PAIR(i));
+		mvwprintw(rMapBorderWin[i],0,1,"%s Placement, area: %ix%i[m], step: %llu",
+				titles[i], (int)frame->width, (int)frame->height, frame->tmu);
+		mvwprintw(rMapBorderWin[i],LINES-3,1,
+				"zoom x%i, view %i-%i x %i-%i[m], %llu autons, max %u/cell"
+				" (+/- zoom, arrows pan, 0 reset, tab next)",
+				1 << mapZoom, (int)viewX, (int)(viewX+viewWidth),
+				(int)viewY, (int)(viewY+viewHeight),
+				mapGrids[i].getInside(), mapGrids[i].getMax());
+		mapRender(mapGrids[i], i);
 	}
+	update_panels();
+	doupdate();
+}
 
-	for(int i=0; i<wY;i++){
-		for(int j=0; j<wX; j++){
-			//kprintf("%i",mapValues[i][j]);
-			if(mapValues[i][j] == 0){
-				wattron(rMapWindows[mapIndex],COLOR_PAIR(4));
-				mvwprintw(rMapWindows[mapIndex],i,j,".");
-				wattroff(rMapWindows[mapIndex],COLOR_PAIR(4));
-
-			}else {
-				wattron(rMapWindows[mapIndex],COLOR_PAIR(2));
-				wattron(rMapWindows[mapIndex],A_BOLD);	
-				mvwprintw(rMapWindows[mapIndex], i, j, "%i", mapValues[i][j]);
-				wattroff(rMapWindows[mapIndex],COLOR_PAIR(2));
-				wattroff(rMapWindows[mapIndex],A_BOLD);
-			}
-
+/**
+ * Renders the a population distribution map.
+ * Draws the density grid with a logarithmic ramp of glyphs and colours,
+ * the cost depends on the window size only.
+ * @param grid the density grid, sized to the window.
+ * @mapIndex the index of this map in the mappanel, which can contain several maps.
+ */
+void Output::mapRender(const DensityGrid &grid, int mapIndex){
+	//ramp from sparse to crowded, level 0 is an empty cell:
+	static const char glyphs[] = ".-:=+*#%@";
+	static const int colours[] = {4, 5, 5, 2, 2, 3, 3, 1, 1};
+	static const int levels = sizeof(glyphs) - 1;
+
+	WINDOW *win = rMapWindows[mapIndex];
+	unsigned int max = grid.getMax();
+	for(int i=0; i<grid.getRows();i++){
+		wmove(win, i, 0);
+		for(int j=0; j<grid.getCols(); j++){
+			int level = DensityGrid::level(grid.at(i,j), max, levels);
+			chtype attributes = COLOR_PAIR(colours[level]);
+			if(level >= levels - 2)
+				attributes |= A_BOLD;
+			waddch(win, glyphs[level] | attributes);
 		}
 	}
-	wrefresh(rMapWindows[mapIndex]);
-
+	wnoutrefresh(win);
 }
 
 /**
@@ -791,6 +1166,8 @@ void Output::setFields(){
 
 
 void Output::setFields(std::string s_filename, std::string s_luaAmount, std::string s_screamerAmount, std::string s_listenerAmount, std::string s_macroFactor, std::string s_timeResolution, std::string s_cmd, std::string s_height, std::string s_width, std::string s_time){
+	if(headless)
+		return;
 	
 	set_field_buffer(input[0],0,s_screamerAmount.c_str());
 	set_field_buffer(input[1],0,s_listenerAmount.c_str());
@@ -29,6 +29,13 @@
 #include<form.h>
 #include<panel.h>
 #include<mutex>
+#include<atomic>
+#include<thread>
+#include<chrono>
+
+#include "ringqueue.h"
+#include "positionsnapshot.h"
+#include "densitygrid.h"
 
 #define MODE_START	510
 #define MODE_INPUT 	520
@@ -50,6 +57,14 @@
  * is protected by the outputMutex in order to prevent screen
  * corruption.
  *
+ * The simulation never touches the framebuffer itself. Log lines are
+ * pushed to a lock-free queue and the status and progress are published
+ * as a snapshot, a render thread draws both at a capped frame rate. So
+ * kprintf, updateStatus and progressBar never wait on the terminal.
+ *
+ * In headless mode Ncurses is never initialized, the render thread writes
+ * the log lines to stderr and the progress as a line every STATUS_INTERVAL.
+ *
  * @author Soeren Vissing Joergensen
  * @email sojoe02@gmail.com 
  */
@@ -59,6 +74,9 @@ class Output
 	public:
 
 		static Output* Inst();
+		//run without Ncurses, must be set before the first call to Inst():
+		static void setHeadless(bool enabled);
+		static bool isHeadless(){ return headless; }
 		//function for writing msg to the current active ouput box, if enabled.
 		void kprintf(const char* msg, ...);
 		//function for handling information, so information can be treated differently
@@ -75,18 +93,29 @@ class Output
 
 		void updateStatus(unsigned long long ms, unsigned long long eventInit,
 	       		unsigned long long internalEvents, unsigned long long externalEvents);
+		void updatePhases(const char *const *names, const double *shares, int amount,
+				double eventRate);
 		//get the data from the input fields, returns 0 if successfull:
 		void getInputData(int &screamerAmount, int &listenerAmount, int &luaAmount,
 				int &nestSquareAmount, double &width, double &height, int &runtime, 
 				double &microStepRes, int &macroStepRes,
 				std::string &filename, std::string &command);
 		
-		void generateMapPanels(std::list<double> sylist, std::list<double> sxlist,
-		std::list<double> lylist, std::list<double> lxlist,
-		std::list<double> aylist, std::list<double> axlist, double yMax, double xMax);
+		void generateMapPanels(PositionSnapshot *snapshot);
+		//stop reading the positions, before their simulation is deleted:
+		void releaseMap();
 		int getCMode();
 		void updatePercentageDone(unsigned long long current, unsigned long long maximum);
 		void setFields(std::string s_filename, std::string s_luaAmount, std::string s_screamerAmount, std::string s_listenerAmount, std::string s_macroFactor, std::string s_timeResolution, std::string s_cmd, std::string s_height, std::string s_width, std::string s_time);
+		//stop the render thread, must be called before endwin():
+		void stopRender();
+
+		static const int FRAME_RATE = 30;
+		static const size_t LOG_CAPACITY = 4096;
+		static const int STATUS_INTERVAL = 5; //[s], headless mode
+		static const int MAX_PHASES = 8;
+		static const size_t RATE_HISTORY = 256;
+		static const int MAX_ZOOM = 10;
 		
 	private:
 
@@ -94,6 +123,7 @@ class Output
 		Output(Output const&){};
 		Output& operator=(Output const&){};
 		static Output* output; //the instance of the output singleton
+		static bool headless;
 		//Mode of the screen
 		//this should be set whenever the simulator changes mode:
 		int c_mode;
@@ -130,14 +160,24 @@ class Output
 		PANEL *rMapTop;
 		WINDOW *rMapBorderWin[4];
 		WINDOW *rMapWindows[4];
+		bool mapPanels;
+		//positions of the simulation shown, owned by its SimContext:
+		PositionSnapshot *mapSnapshot;
+		//density of each map, and the zoomed view, the view is zoomed by
+		//2^mapZoom around the center given as shares of the map size:
+		DensityGrid mapGrids[4];
+		int mapZoom;
+		double mapCenterX;
+		double mapCenterY;
+		unsigned long long drawnMapVersion;
 
 		//Functions to handle the different modes:
 		void modeInput();
 		void modeRunning();
 		void handleInput(int ch);
 		void handleMap(int ch);
-		void mapRender(std::list<double> xList, std::list<double> yList, 
-				double yMax, double xMax, int mapIndex);
+		void renderMaps();
+		void mapRender(const DensityGrid &grid, int mapIndex);
 
 		//Buffering vectors:
 		//Debug buffer
@@ -160,5 +200,59 @@ class Output
 		//which prevents screen corruption, strange crashes etc.
 		std::mutex outputMutex;
 
+		/*
+		 * The render thread and the data it draws:
+		 */
+		void renderLoop();
+		void renderFrame();
+		void renderHeadless();
+		struct Snapshot{
+			unsigned long long seq;
+			unsigned long long status[4];
+			unsigned long long progress;
+			unsigned long long progressMax;
+			int phaseAmount;
+			const char *phaseNames[MAX_PHASES];
+			double phaseShares[MAX_PHASES];
+			double eventRate;
+			unsigned long long rateSample;
+		};
+		bool readSnapshot(Snapshot &snapshot);
+		void drawStatus(const unsigned long long *status);
+		void drawProgress(unsigned long long current, unsigned long long maximum);
+		void drawPhases(const Snapshot &snapshot);
+		//publish values to the status snapshot:
+		void beginPublish();
+		void endPublish();
+
+		std::thread renderThread;
+		std::atomic<bool> rendering;
+
+		//log lines waiting to be drawn, lines are dropped when it is full:
+		RingQueue<std::string> logQueue;
+		std::atomic<unsigned long long> droppedLines;
+
+		//status snapshot, guarded by a sequence lock, the sequence is odd
+		//while a snapshot is being written:
+		std::atomic<unsigned long long> statusSeq;
+		std::atomic<unsigned long long> statusTmu;
+		std::atomic<unsigned long long> statusInit;
+		std::atomic<unsigned long long> statusInternal;
+		std::atomic<unsigned long long> statusExternal;
+		std::atomic<unsigned long long> progressCurrent;
+		std::atomic<unsigned long long> progressMaximum;
+		//share of the wall time spent in each engine phase:
+		std::atomic<int> phaseAmount;
+		std::atomic<const char*> phaseNames[MAX_PHASES];
+		std::atomic<double> phaseShares[MAX_PHASES];
+		std::atomic<double> eventRate;
+		std::atomic<unsigned long long> rateSamples;
+
+		//what the render thread has drawn so far:
+		unsigned long long drawnSeq;
+		unsigned long long drawnRateSample;
+		std::vector<double> rateHistory;
+		int drawnCells;
+		std::chrono::steady_clock::time_point lastStatusLine;
 };
 #endif // OUTPUT_H
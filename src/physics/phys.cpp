@@ -30,14 +30,10 @@
 
 
 
-typedef std::mt19937_64 MyRNG;  // the Mersenne Twister with a popular choice of parameters
-double Phys::timeResolution = 0;
-int Phys::macroFactor = 0;
-unsigned long long Phys::c_timeStep = 0;
-MyRNG Phys::rng;
-std::uniform_int_distribution<uint64_t> Phys::uint_dist;
-double Phys::env_x = 0;
-double Phys::env_y = 0;
+	Phys::Phys()
+:env_x(0), env_y(0), macroFactor(0), timeResolution(0), c_timeStep(0)
+{
+}
 
 
 void Phys::seedMersenne(){
@@ -47,23 +43,15 @@ void Phys::seedMersenne(){
 
 
 void Phys::incTime(){
-	Phys::c_timeStep++;
+	c_timeStep++;
 }
 
 void Phys::setTimeRes(double timeResolution){
-	Phys::timeResolution = timeResolution;
-}
-
-double Phys::getTimeRes(){
-	return Phys::timeResolution;
+	this->timeResolution = timeResolution;
 }
 
 void Phys::setMacroFactor(int macroFactor){
-	Phys::macroFactor = macroFactor;
-}
-
-int Phys::getMacroFactor(){
-	return Phys::macroFactor;
+	this->macroFactor = macroFactor;
 }
 
 unsigned long long Phys::speedOfSound(double x_origin, double y_origin,
@@ -71,8 +59,8 @@ unsigned long long Phys::speedOfSound(double x_origin, double y_origin,
 
 	double distance = sqrt( pow((x_origin-x_dest), 2) + pow((y_origin-y_dest),2) );
 
-	unsigned long long tmp = uint64_t (distance / (343.2 * Phys::timeResolution));
-	unsigned long long a_timestep = tmp + Phys::c_timeStep;
+	unsigned long long tmp = uint64_t (distance / (343.2 * timeResolution));
+	unsigned long long a_timestep = tmp + c_timeStep;
 
 	return a_timestep;
 }
@@ -82,44 +70,55 @@ unsigned long long Phys::speedOfSound(double x_origin, double y_origin,
 
 	double distance = sqrt( pow((x_origin-x_dest), 2) + pow((y_origin-y_dest),2) );
 
-	double tmp = distance / (propagationSpeed * Phys::timeResolution);
-	unsigned long long a_timestep = tmp + Phys::c_timeStep;
+	double tmp = distance / (propagationSpeed * timeResolution);
+	unsigned long long a_timestep = tmp + c_timeStep;
 
 	return a_timestep;
 }
 
+/**
+ * Speed of sound for a group of receivers.
+ * Calculates the arrival time at every destination in one pass over
+ * contiguous position arrays, so the compiler can vectorize it.
+ * @param x_dest destination x positions.
+ * @param y_dest destination y positions.
+ * @param times array the n arrival times are written to.
+ * @param n number of destinations.
+ */
+void Phys::speedOfSound(double x_origin, double y_origin,
+		const double *x_dest, const double *y_dest,
+		unsigned long long *times, int n){
+
+	const double speed = 343.2 * timeResolution;
+	const unsigned long long cTime = c_timeStep;
+
+	for(int i = 0; i < n; i++){
+		double dx = x_origin - x_dest[i];
+		double dy = y_origin - y_dest[i];
+		times[i] = uint64_t(sqrt(dx*dx + dy*dy) / speed) + cTime;
+	}
+}
+
 double Phys::calcDistance(double x_origin, double y_origin, 
 		double x_dest, double y_dest){
 	return  sqrt( pow((x_origin-x_dest), 2) + pow((y_origin-y_dest),2) );
 }
 
-unsigned long long Phys::getCTime(){
-	return Phys::c_timeStep;
-}
-
 void Phys::setCTime(unsigned long long ctime){
-	Phys::c_timeStep = ctime;
+	c_timeStep = ctime;
 }
 
 void Phys::setEnvironment(double x, double y){
-	Phys::env_x = x;
-	Phys::env_y = y;
-}
-
-double Phys::getEnvX(){
-	return env_x;
-}
-
-double Phys::getEnvY(){
-	return env_y;
+	env_x = x;
+	env_y = y;
 }
 
 double Phys::getMersenneFloat(double min=0, double max=1){
 
-	return min + (double)Phys::uint_dist(Phys::rng)/((double)ULLONG_MAX/(max-min));
+	return min + (double)uint_dist(rng)/((double)ULLONG_MAX/(max-min));
 }
 
 uint64_t Phys::getMersenneInteger(uint64_t min=0, uint64_t max=ULLONG_MAX){
 
-	return min + Phys::uint_dist(Phys::rng)%max;
+	return min + uint_dist(rng)%max;
 }
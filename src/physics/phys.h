@@ -26,47 +26,55 @@
 #include <random>
 #include <chrono>
 
+/**
+ * Physics and time of a simulation.
+ * Every simulation owns its own instance through its SimContext, so
+ * several simulations can run side by side in one process.
+ */
 class Phys
 {
 	public:
-		Phys(){
-		};
+		Phys();
 
-		static unsigned long long speedOfSound(double x_origin, double y_origin,
+		unsigned long long speedOfSound(double x_origin, double y_origin,
 				double x_dest, double y_dest);
 
-		static unsigned long long speedOfSound(double x_origin, double y_origin,
+		unsigned long long speedOfSound(double x_origin, double y_origin,
 				double x_dest, double y_dest, double propagationSpeed);
 
+		void speedOfSound(double x_origin, double y_origin,
+				const double *x_dest, const double *y_dest, 
+				unsigned long long *times, int n);
+
 		static double calcDistance(double x_origin, double y_origin, 
 				double x_dest, double y_dest);
-		static unsigned long long getCTime();
+		unsigned long long getCTime(){ return c_timeStep; }
 
-		static void incTime();
-		static void seedMersenne();
-		static void setTimeRes(double timeResolution);
-		static double getTimeRes();
-		static int getMacroFactor();
-		static void setMacroFactor(int macroFactor);
-		static void setCTime(unsigned long long ctime);
-		static double getMersenneFloat(double min, double max);
-		static uint64_t getMersenneInteger(uint64_t min, uint64_t max);
+		void incTime();
+		void seedMersenne();
+		void setTimeRes(double timeResolution);
+		double getTimeRes(){ return timeResolution; }
+		int getMacroFactor(){ return macroFactor; }
+		void setMacroFactor(int macroFactor);
+		void setCTime(unsigned long long ctime);
+		double getMersenneFloat(double min, double max);
+		uint64_t getMersenneInteger(uint64_t min, uint64_t max);
 
-		static void setEnvironment(double x, double y);
-		static double getEnvX();
-		static double getEnvY();
+		void setEnvironment(double x, double y);
+		double getEnvX(){ return env_x; }
+		double getEnvY(){ return env_y; }
 
 	private:
-		static double env_x;
-		static double env_y;
+		double env_x;
+		double env_y;
 
-		static int macroFactor;
-		static double timeResolution;
-		static unsigned long long c_timeStep;
+		int macroFactor;
+		double timeResolution;
+		unsigned long long c_timeStep;
 		//random distribution 0-INT_MAX
-		static std::uniform_int_distribution<uint64_t> uint_dist;
+		std::uniform_int_distribution<uint64_t> uint_dist;
 		typedef std::mt19937_64 MyRNG;
-		static MyRNG rng;
+		MyRNG rng;
 
 };
 
@@ -0,0 +1,137 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <math.h>
+
+#include "propagation.h"
+
+	Propagation::Propagation()
+:maxDistance(1000)
+{
+}
+
+/**
+ * Set the largest distance covered by the lookup tables.
+ * Normally the diagonal of the environment, tables already built are 
+ * rebuilt to cover the new distance.
+ * @param maxDistance distance in meters.
+ */
+void Propagation::setMaxDistance(double maxDistance){
+	if(maxDistance <= 0 || maxDistance == this->maxDistance)
+		return;
+
+	this->maxDistance = maxDistance;
+	std::unordered_map<std::string, Model>::iterator it;
+	for(it = models.begin(); it != models.end(); ++it){
+		buildTable(it->second);
+	}
+}
+
+/**
+ * Set the propagation model for an event type.
+ * All Lua autons usually set the same model, so the table is only
+ * rebuilt if the parameters differ from the current model.
+ * @param desc the event description the model applies to.
+ * @param type spherical spreading or sigmoid thresholding.
+ * @param sourceLevel level at the reference distance (spherical).
+ * @param referenceDistance distance of the source level (spherical).
+ * @param distanceThreshold distance at which the intensity is 1/2 (sigmoid).
+ * @param absorption attenuation pr. meter.
+ * @param threshold receivers below this level will not receive the event.
+ */
+void Propagation::setModel(std::string desc, ModelType type, double sourceLevel,
+		double referenceDistance, double distanceThreshold,
+		double absorption, double threshold){
+
+	std::unordered_map<std::string, Model>::iterator it = models.find(desc);
+	if(it != models.end()){
+		Model &m = it->second;
+		if(m.type == type && m.sourceLevel == sourceLevel 
+				&& m.referenceDistance == referenceDistance
+				&& m.distanceThreshold == distanceThreshold
+				&& m.absorption == absorption && m.threshold == threshold)
+			return;
+	}
+
+	Model model;
+	model.type = type;
+	model.sourceLevel = sourceLevel;
+	model.referenceDistance = referenceDistance > 0 ? referenceDistance : 1;
+	model.distanceThreshold = distanceThreshold > 0 ? distanceThreshold : 1;
+	model.absorption = absorption;
+	model.threshold = threshold;
+	buildTable(model);
+
+	models[desc] = model;
+}
+
+/**
+ * Get the propagation model of an event type.
+ * @return the model, or NULL if there is no model for the event type.
+ */
+const Propagation::Model* Propagation::getModel(const std::string &desc) const{
+	if(models.empty())
+		return NULL;
+
+	std::unordered_map<std::string, Model>::const_iterator it = models.find(desc);
+	if(it == models.end())
+		return NULL;
+	return &it->second;
+}
+
+/**
+ * Remove all models, when a new environment is generated.
+ */
+void Propagation::clear(){
+	models.clear();
+}
+
+/**
+ * Evaluate a model at a distance.
+ * spherical: sourceLevel - 20*log10(d/referenceDistance) - absorption*d
+ * sigmoid: 1/(exp(d/distanceThreshold - 1) + 1) * exp(-absorption*d)
+ */
+double Propagation::evaluate(const Model &model, double distance){
+	switch(model.type){
+		case SPHERICAL:{
+				       double d = distance > model.referenceDistance ? 
+					       distance : model.referenceDistance;
+				       return model.sourceLevel 
+					       - 20*log10(d/model.referenceDistance)
+					       - model.absorption*distance;
+			       }
+		case SIGMOID:
+			       return 1/(exp(distance/model.distanceThreshold - 1) + 1)
+				       * exp(-model.absorption*distance);
+		default:
+			       return 0;
+	}
+}
+
+void Propagation::buildTable(Model &model){
+	model.table.resize(tableSize);
+	double step = maxDistance / (tableSize - 1);
+	model.invStep = 1 / step;
+
+	for(int i = 0; i < tableSize; i++){
+		model.table[i] = evaluate(model, i * step);
+	}
+}
@@ -0,0 +1,87 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef PROPAGATION_H
+#define PROPAGATION_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * Sound propagation models.
+ * A propagation model can be selected for each event type (the events
+ * desc string). It gives the level an event is received with as a 
+ * function of distance, precomputed in a lookup table when the model is
+ * set, so receivers get their level without calling into Lua.
+ * Receivers where the level is below the models threshold do not receive
+ * the event at all.
+ */
+class Propagation
+{
+	public:
+		enum ModelType { SPHERICAL, SIGMOID };
+
+		struct Model {
+			ModelType type;
+			double sourceLevel; /*!< level at the reference distance [dB] (spherical)*/
+			double referenceDistance; /*!< reference distance [m] (spherical)*/
+			double distanceThreshold; /*!< distance of half intensity [m] (sigmoid)*/
+			double absorption; /*!< attenuation pr. meter, [dB/m] or [1/m] for sigmoid*/
+			double threshold; /*!< events received below this level are dropped*/
+
+			std::vector<double> table;
+			double invStep;
+
+			/**
+			 * Received level at a distance.
+			 * Linear interpolation in the lookup table, distances beyond 
+			 * the table get the level at its end.
+			 */
+			double level(double distance) const{
+				double x = distance * invStep;
+				unsigned int i = (unsigned int)x;
+				if(i >= table.size() - 1)
+					return table.back();
+				double frac = x - i;
+				return table[i] + (table[i+1] - table[i]) * frac;
+			}
+		};
+
+		Propagation();
+
+		void setMaxDistance(double maxDistance);
+		void setModel(std::string desc, ModelType type, double sourceLevel,
+				double referenceDistance, double distanceThreshold,
+				double absorption, double threshold);
+		const Model* getModel(const std::string &desc) const;
+		void clear();
+
+	private:
+		static double evaluate(const Model &model, double distance);
+		void buildTable(Model &model);
+
+		std::unordered_map<std::string, Model> models;
+		double maxDistance;
+		static const int tableSize = 4096;
+};
+
+#endif // PROPAGATION_H
@@ -0,0 +1,128 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+/**
+ * Example native auton plugin.
+ * A compiled version of the frog in frog.lua: each frog builds up energy
+ * and calls when it has enough, frogs hearing a call within 'hearingRange'
+ * get a small energy boost, which synchronises the chorus.
+ * Build it as a shared object and run with: -n <amount> -N libfrogplugin.so
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "ranaplugin.h"
+
+namespace {
+	const double hearingRange = 50;
+
+	struct frog{
+		double energy;
+	};
+
+	frog *getFrog(rana_auton &auton){
+		return static_cast<frog*>(auton.data);
+	}
+
+	int init(const rana_host *host, rana_auton *autons, int count){
+		for(int i = 0; i < count; i++){
+			frog *f = new frog;
+			f->energy = host->getMersenneFloat(host->ctx, 0, 0.5);
+			autons[i].data = f;
+		}
+		return 0;
+	}
+
+	int initiate(const rana_host *host, rana_auton *autons, int count, 
+			rana_response *out){
+		double gain = 0.1 * host->getMacroFactor(host->ctx) 
+			* host->getTimeResolution(host->ctx);
+		int n = 0;
+
+		for(int i = 0; i < count; i++){
+			frog *f = getFrog(autons[i]);
+			if(f->energy > 0.5){
+				f->energy = 0;
+				rana_response &r = out[n++];
+				r.auton = i;
+				r.id = host->generateEventID(host->ctx);
+				r.activationTime = host->currentTime(host->ctx);
+				r.duration = 5;
+				r.propagationSpeed = 343.2;
+				strncpy(r.desc, "sound", RANA_DESC_SIZE);
+				strncpy(r.table, "{name = \"soundIntensity\", index = 1}", RANA_TABLE_SIZE);
+			} else
+				f->energy += gain;
+		}
+		return n;
+	}
+
+	int handleExternal(const rana_host *host, rana_auton *autons, int count,
+			const rana_event *event, rana_response *out){
+		int n = 0;
+
+		for(int i = 0; i < count; i++){
+			double dx = autons[i].posX - event->originX;
+			double dy = autons[i].posY - event->originY;
+			if(dx*dx + dy*dy > hearingRange*hearingRange)
+				continue;
+
+			rana_response &r = out[n++];
+			r.auton = i;
+			r.id = host->generateEventID(host->ctx);
+			r.activationTime = host->speedOfSound(host->ctx, autons[i].posX, 
+					autons[i].posY, event->originX, event->originY, 
+					event->propagationSpeed);
+			strncpy(r.desc, "heard", RANA_DESC_SIZE);
+		}
+		return n;
+	}
+
+	int handleInternal(const rana_host * /*host*/, rana_auton *autons, int /*count*/,
+			const rana_ievent *events, int n, rana_response * /*out*/){
+		for(int i = 0; i < n; i++){
+			getFrog(autons[events[i].auton])->energy += 0.05;
+		}
+		return 0;
+	}
+
+	void done(const rana_host * /*host*/, rana_auton *autons, int count){
+		for(int i = 0; i < count; i++){
+			delete getFrog(autons[i]);
+			autons[i].data = NULL;
+		}
+	}
+
+	const rana_plugin plugin = {
+		RANA_PLUGIN_ABI_VERSION,
+		"frog",
+		init,
+		initiate,
+		handleExternal,
+		handleInternal,
+		done
+	};
+}
+
+extern "C" const rana_plugin* rana_plugin_entry(){
+	return &plugin;
+}
@@ -0,0 +1,100 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include "positionsnapshot.h"
+
+	PositionSnapshot::PositionSnapshot()
+:published(-1), version(0), writing(-1), lastPublish(std::chrono::steady_clock::now())
+{
+	for(int i = 0; i < FRAME_AMOUNT; i++)
+		readers[i].store(0);
+}
+
+/**
+ * Check if the positions should be published during a run.
+ * @return true at most once every INTERVAL.
+ */
+bool PositionSnapshot::due(){
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(now - lastPublish < std::chrono::milliseconds(INTERVAL))
+		return false;
+	lastPublish = now;
+	return true;
+}
+
+/**
+ * Get an empty frame to write the positions to.
+ * The arrays keep their memory between frames.
+ * @return the frame, or NULL if all other frames are being read.
+ */
+PositionSnapshot::Frame* PositionSnapshot::beginWrite(){
+	int current = published.load();
+	writing = -1;
+	for(int i = 0; i < FRAME_AMOUNT; i++){
+		if(i != current && readers[i].load() == 0){
+			writing = i;
+			break;
+		}
+	}
+	if(writing < 0)
+		return NULL;
+
+	Frame &frame = frames[writing];
+	for(int i = 0; i < TYPE_AMOUNT; i++){
+		frame.x[i].clear();
+		frame.y[i].clear();
+	}
+	return &frame;
+}
+
+/**
+ * Publish the frame from beginWrite().
+ */
+void PositionSnapshot::publish(){
+	if(writing < 0)
+		return;
+	published.store(writing);
+	version.fetch_add(1, std::memory_order_release);
+	writing = -1;
+}
+
+	PositionSnapshot::Reader::Reader(PositionSnapshot *snapshot)
+:snapshot(snapshot), index(-1)
+{
+	//count on the published frame, and check the writer did not pick it
+	//before it was counted:
+	while(true){
+		int current = snapshot->published.load();
+		if(current < 0)
+			return;
+		snapshot->readers[current].fetch_add(1);
+		if(snapshot->published.load() == current){
+			index = current;
+			return;
+		}
+		snapshot->readers[current].fetch_sub(1);
+	}
+}
+
+PositionSnapshot::Reader::~Reader(){
+	if(index >= 0)
+		snapshot->readers[index].fetch_sub(1);
+}
@@ -0,0 +1,100 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef POSITIONSNAPSHOT_H
+#define POSITIONSNAPSHOT_H
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+/**
+ * Snapshot of the auton positions, shared between the engine and readers.
+ * The engine writes the positions of every auton type to contiguous
+ * arrays at a macro step boundary, and publishes them. Readers such as the
+ * map view get the latest published frame without locks or copies, while
+ * the engine keeps running.
+ *
+ * There are three frames, each counting its readers. The writer fills a
+ * frame that is neither published nor read, and publishes it with an
+ * atomic store, a reader pins the published frame by counting itself on
+ * it and checking it is still published. If readers hold both other
+ * frames, the positions are not published this time. Every simulation
+ * has a snapshot in its SimContext, written only by the thread running it.
+ */
+class PositionSnapshot
+{
+	public:
+		enum Type{
+			SCREAMER = 0,
+			LISTENER,
+			LUA,		//Lua autons and native plugin autons
+			TYPE_AMOUNT
+		};
+
+		struct Frame{
+			std::vector<double> x[TYPE_AMOUNT];
+			std::vector<double> y[TYPE_AMOUNT];
+			double width;
+			double height;
+			unsigned long long tmu;
+		};
+
+		/**
+		 * Holds the published frame while in scope, frame() is NULL if
+		 * nothing is published.
+		 */
+		class Reader{
+			public:
+				Reader(PositionSnapshot *snapshot);
+				~Reader();
+				const Frame* frame(){ return index < 0 ? NULL : &snapshot->frames[index]; }
+			private:
+				Reader(Reader const&){};
+				PositionSnapshot *snapshot;
+				int index;
+		};
+
+		static const int INTERVAL = 250; //[ms] between publications during a run
+
+		PositionSnapshot();
+
+		bool due();
+		Frame* beginWrite();
+		void publish();
+		unsigned long long getVersion(){ return version.load(std::memory_order_acquire); }
+
+	private:
+		PositionSnapshot(PositionSnapshot const&);
+		PositionSnapshot& operator=(PositionSnapshot const&);
+
+		static const int FRAME_AMOUNT = 3;
+		Frame frames[FRAME_AMOUNT];
+		std::atomic<int> readers[FRAME_AMOUNT];
+		//published frame, -1 if none:
+		std::atomic<int> published;
+		std::atomic<unsigned long long> version;
+		//frame being written by the writer:
+		int writing;
+		std::chrono::steady_clock::time_point lastPublish;
+};
+
+#endif // POSITIONSNAPSHOT_H
@@ -0,0 +1,243 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include "../debuglog.h"
+
+/**
+ * Decoder for the binary debug log written by DebugLog.
+ * Prints one line pr. message:
+ * seconds since the log was enabled, level, tmu, auton ID and the message.
+ *
+ * usage: ranalog <logfile> [maximum level, error|warn|info|debug]
+ */
+
+namespace {
+	struct Arg{
+		unsigned char tag;
+		long long i;
+		double d;
+		std::string s;
+	};
+
+	class Input{
+		public:
+			Input(const std::string &data) :data(data), pos(0), failed(false){}
+
+			bool atEnd(){ return pos >= data.size(); }
+			bool ok(){ return !failed; }
+
+			unsigned char u8(){
+				if(!need(1)) return 0;
+				return (unsigned char)data[pos++];
+			}
+			unsigned long long u64(){ return number(8); }
+			unsigned int u32(){ return (unsigned int)number(4); }
+			std::string bytes(size_t length){
+				if(!need(length)) return std::string();
+				std::string value = data.substr(pos, length);
+				pos += length;
+				return value;
+			}
+		private:
+			bool need(size_t length){
+				if(pos + length > data.size())
+					failed = true;
+				return !failed;
+			}
+			unsigned long long number(int size){
+				if(!need(size)) return 0;
+				unsigned long long value = 0;
+				for(int i = 0; i < size; i++)
+					value |= (unsigned long long)(unsigned char)data[pos++] << (8*i);
+				return value;
+			}
+			const std::string &data;
+			size_t pos;
+			bool failed;
+	};
+
+	/**
+	 * printf style formatting of logged arguments, integer and floating
+	 * point conversions accept both kinds of numbers.
+	 */
+	std::string format(const std::string &fmt, const std::vector<Arg> &args){
+		std::string out;
+		size_t next = 0;
+		char buffer[1200];
+
+		for(size_t i = 0; i < fmt.size(); i++){
+			if(fmt[i] != '%'){
+				out.push_back(fmt[i]);
+				continue;
+			}
+			if(i + 1 < fmt.size() && fmt[i+1] == '%'){
+				out.push_back('%');
+				i++;
+				continue;
+			}
+			//flags, width and precision, length modifiers are dropped:
+			std::string spec = "%";
+			size_t j = i + 1;
+			while(j < fmt.size() && strchr("-+ #0123456789.", fmt[j]))
+				spec.push_back(fmt[j++]);
+			while(j < fmt.size() && strchr("hlLqjzt", fmt[j]))
+				j++;
+			if(j >= fmt.size() || next >= args.size()){
+				out.append(fmt, i, j - i + 1);
+				i = j;
+				continue;
+			}
+			char conversion = fmt[j];
+			const Arg &arg = args[next++];
+			i = j;
+
+			if(strchr("diouxX", conversion)){
+				long long value = arg.tag == DebugLog::ARG_DOUBLE ? (long long)arg.d : arg.i;
+				spec += "ll";
+				spec.push_back(conversion);
+				snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+			}else if(conversion == 'c'){
+				int value = arg.tag == DebugLog::ARG_DOUBLE ? (int)arg.d : (int)arg.i;
+				spec.push_back(conversion);
+				snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+			}else if(strchr("eEfFgGaA", conversion)){
+				double value = arg.tag == DebugLog::ARG_INT ? (double)arg.i : arg.d;
+				spec.push_back(conversion);
+				snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+			}else{
+				std::string value = arg.s;
+				if(arg.tag == DebugLog::ARG_INT)
+					value = std::to_string(arg.i);
+				else if(arg.tag == DebugLog::ARG_DOUBLE){
+					snprintf(buffer, sizeof(buffer), "%.14g", arg.d);
+					value = buffer;
+				}
+				spec.push_back('s');
+				snprintf(buffer, sizeof(buffer), spec.c_str(), value.c_str());
+			}
+			out.append(buffer);
+		}
+		//arguments without a conversion are appended:
+		for(; next < args.size(); next++){
+			out.push_back(' ');
+			out.append(format(args[next].tag == DebugLog::ARG_STRING ? "%s" : "%.14g",
+						std::vector<Arg>(1, args[next])));
+		}
+		return out;
+	}
+}
+
+int main(int argc, char *argv[]){
+	if(argc < 2){
+		fprintf(stderr, "usage: %s <logfile> [error|warn|info|debug]\n", argv[0]);
+		return 1;
+	}
+	int maxLevel = DebugLog::LEVEL_AMOUNT - 1;
+	if(argc > 2){
+		for(maxLevel = 0; maxLevel < DebugLog::LEVEL_AMOUNT; maxLevel++)
+			if(strcmp(argv[2], DebugLog::levelName(maxLevel)) == 0)
+				break;
+		if(maxLevel == DebugLog::LEVEL_AMOUNT){
+			fprintf(stderr, "unknown level '%s'\n", argv[2]);
+			return 1;
+		}
+	}
+
+	std::ifstream file(argv[1], std::ios::in | std::ios::binary);
+	if(!file.is_open()){
+		fprintf(stderr, "can't open '%s'\n", argv[1]);
+		return 1;
+	}
+	std::stringstream content;
+	content << file.rdbuf();
+	std::string data = content.str();
+
+	if(data.size() < sizeof(DebugLog::MAGIC) 
+			|| memcmp(data.data(), DebugLog::MAGIC, sizeof(DebugLog::MAGIC)) != 0){
+		fprintf(stderr, "'%s' is not a debug log\n", argv[1]);
+		return 1;
+	}
+	Input in(data);
+	in.bytes(sizeof(DebugLog::MAGIC));
+
+	std::vector<std::string> formats;
+	std::vector<Arg> args;
+	unsigned long long messages = 0, limited = 0, dropped = 0;
+
+	while(!in.atEnd() && in.ok()){
+		unsigned char type = in.u8();
+		if(type == DebugLog::RECORD_FORMAT){
+			unsigned int id = in.u32();
+			std::string fmt = in.bytes(in.u32());
+			if(formats.size() <= id)
+				formats.resize(id + 1);
+			formats[id] = fmt;
+		}else if(type == DebugLog::RECORD_MESSAGE){
+			unsigned int id = in.u32();
+			int level = in.u8();
+			int count = in.u8();
+			int auton = (int)in.u32();
+			unsigned long long tmu = in.u64();
+			unsigned long long ns = in.u64();
+			args.resize(count);
+			for(int i = 0; i < count; i++){
+				args[i].tag = in.u8();
+				if(args[i].tag == DebugLog::ARG_INT)
+					args[i].i = (long long)in.u64();
+				else if(args[i].tag == DebugLog::ARG_DOUBLE){
+					unsigned long long bits = in.u64();
+					memcpy(&args[i].d, &bits, sizeof(bits));
+				}else
+					args[i].s = in.bytes(in.u32());
+			}
+			if(!in.ok())
+				break;
+			messages++;
+			if(level > maxLevel)
+				continue;
+			std::string text = id < formats.size() ? format(formats[id], args)
+				: "<unknown format " + std::to_string(id) + ">";
+			if(!text.empty() && text[text.size()-1] == '\n')
+				text.erase(text.size()-1);
+			printf("%12.6f %-5s tmu=%llu auton=%d: %s\n", ns/1e9,
+					DebugLog::levelName(level), tmu, auton, text.c_str());
+		}else if(type == DebugLog::RECORD_DROPPED){
+			limited += in.u64();
+			dropped += in.u64();
+		}else{
+			fprintf(stderr, "unknown record type %d, stopping\n", type);
+			break;
+		}
+	}
+	if(!in.ok())
+		fprintf(stderr, "the log ends with a partial record\n");
+	fprintf(stderr, "%llu messages, %llu rate limited, %llu lost to full buffers\n",
+			messages, limited, dropped);
+	return 0;
+}
@@ -0,0 +1,128 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ * Bounded lock-free queue.
+ * Any number of threads can push and pop. Every cell carries a sequence
+ * number telling whether it is ready for the next push or the next pop,
+ * so a thread only claims a position with a single compare and swap and
+ * never waits on another thread. A push to a full queue fails instead of
+ * blocking, the caller decides what to do with the value.
+ *
+ * The capacity is rounded up to a power of two.
+ */
+template<typename T>
+class RingQueue
+{
+	public:
+		RingQueue(size_t capacity = 1024)
+			:enqueuePos(0), dequeuePos(0)
+		{
+			size_t size = 2;
+			while(size < capacity)
+				size <<= 1;
+			mask = size - 1;
+			cells = new Cell[size];
+			for(size_t i = 0; i < size; i++)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		~RingQueue(){
+			delete[] cells;
+		}
+
+		/**
+		 * Push a value to the back of the queue.
+		 * @return false if the queue is full, the value is then untouched.
+		 */
+		bool push(T &&value){
+			Cell *cell;
+			size_t pos = enqueuePos.load(std::memory_order_relaxed);
+			while(true){
+				cell = &cells[pos & mask];
+				size_t seq = cell->sequence.load(std::memory_order_acquire);
+				long diff = (long)seq - (long)pos;
+				if(diff == 0){
+					if(enqueuePos.compare_exchange_weak(pos, pos + 1,
+								std::memory_order_relaxed))
+						break;
+				}else if(diff < 0){
+					return false;
+				}else
+					pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+			cell->data = std::move(value);
+			cell->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * Pop the value at the front of the queue.
+		 * @return false if the queue is empty.
+		 */
+		bool pop(T &value){
+			Cell *cell;
+			size_t pos = dequeuePos.load(std::memory_order_relaxed);
+			while(true){
+				cell = &cells[pos & mask];
+				size_t seq = cell->sequence.load(std::memory_order_acquire);
+				long diff = (long)seq - (long)(pos + 1);
+				if(diff == 0){
+					if(dequeuePos.compare_exchange_weak(pos, pos + 1,
+								std::memory_order_relaxed))
+						break;
+				}else if(diff < 0){
+					return false;
+				}else
+					pos = dequeuePos.load(std::memory_order_relaxed);
+			}
+			value = std::move(cell->data);
+			cell->sequence.store(pos + mask + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		RingQueue(RingQueue const&);
+		RingQueue& operator=(RingQueue const&);
+
+		struct Cell{
+			std::atomic<size_t> sequence;
+			T data;
+		};
+
+		Cell *cells;
+		size_t mask;
+		//kept on separate cache lines, pushing and popping threads
+		//should not invalidate each others position:
+		char padding0[64];
+		std::atomic<size_t> enqueuePos;
+		char padding1[64];
+		std::atomic<size_t> dequeuePos;
+};
+
+#endif // RINGQUEUE_H
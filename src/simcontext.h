@@ -0,0 +1,47 @@
+//--begin_license--
+//
+//Copyright 	2013 	Søren Vissing Jørgensen.
+//			2014	Søren Vissing Jørgensen, Center for Biorobotics, Sydansk Universitet MMMI.  
+//
+//This file is part of RANA.
+//
+//RANA is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//RANA is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with RANA.  If not, see <http://www.gnu.org/licenses/>.
+//
+//--end_license--
+#ifndef SIMCONTEXT_H
+#define SIMCONTEXT_H
+
+#include "phys.h"
+#include "ID.h"
+#include "doctor.h"
+#include "positionsnapshot.h"
+
+/**
+ * The state of a single simulation.
+ * Holds the time, resolution, environment size, random generator and ID
+ * counters that used to be static, the health monitor of the runs and the
+ * published auton positions. It is owned by the Master. Nestenes, autons
+ * and the event queue keep a pointer to it, so two simulations can exist
+ * in one process without sharing any of it.
+ */
+class SimContext
+{
+	public:
+		Phys phys;
+		ID id;
+		Doctor doctor;
+		PositionSnapshot positions;
+};
+
+#endif // SIMCONTEXT_H